@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "hardware.h"
+#include "assembler.h"
+#include "logger.h"
+
+/*
+ * ENSAMBLADOR
+ * Pasa de mnemonicos a las palabras de 8 digitos que carga el loader.
+ * Trabaja en dos pasadas: primero arma una lista de instrucciones con
+ * operandos simbolicos (etiquetas), opcionalmente la optimiza, y al final
+ * le asigna direcciones y resuelve las etiquetas.
+ */
+
+#define ASM_MAX_LINE   512
+#define ASM_MAX_NAME   32
+#define ASM_MAX_INST   100000
+#define ASM_MAX_LABELS 4096
+#define ASM_MAX_CHAIN  16      // Saltos maximos a seguir en una cadena de J
+
+typedef struct {
+    int opcode;                 // -1 = palabra de datos (.word)
+    int mode;                   // ADDR_DIRECT / ADDR_IMMEDIATE / ADDR_INDEXED
+    int value;                  // Operando numerico (o dato si es .word)
+    char label_ref[ASM_MAX_NAME]; // Operando simbolico ("" si es numerico)
+    int is_target;              // 1 si alguna etiqueta apunta aqui
+    int removed;                // 1 si el optimizador la elimino
+    int line;                   // Linea del fuente (para errores)
+} AsmInst;
+
+typedef struct {
+    char name[ASM_MAX_NAME];
+    int index;                  // Indice de la instruccion a la que apunta
+} AsmLabel;
+
+typedef struct {
+    AsmInst *inst;
+    int count;
+    AsmLabel labels[ASM_MAX_LABELS];
+    int label_count;
+    int start;
+    int base;
+    char name[64];
+} AsmProgram;
+
+/* =========================================================================
+ * AYUDAS
+ * ========================================================================= */
+
+static char *trim(char *s) {
+    while (isspace((unsigned char)*s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = 0;
+    return s;
+}
+
+static int is_identifier(const char *s) {
+    if (!isalpha((unsigned char)*s) && *s != '_') return 0;
+    for (s++; *s; s++) {
+        if (!isalnum((unsigned char)*s) && *s != '_') return 0;
+    }
+    return 1;
+}
+
+static int find_label(const AsmProgram *p, const char *name) {
+    for (int i = 0; i < p->label_count; i++) {
+        if (strcmp(p->labels[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int is_jump(int opcode) {
+    return opcode == OP_J || opcode == OP_JMPE || opcode == OP_JMPNE ||
+           opcode == OP_JMPLT || opcode == OP_JMPLGT;
+}
+
+static int is_arith(int opcode) {
+    return opcode == OP_SUM || opcode == OP_RES || opcode == OP_MULT || opcode == OP_DIVI;
+}
+
+// Mismo operando (directo) en dos instrucciones?
+static int same_direct_operand(const AsmInst *a, const AsmInst *b) {
+    if (a->mode != ADDR_DIRECT || b->mode != ADDR_DIRECT) return 0;
+    if (a->label_ref[0] || b->label_ref[0]) return strcmp(a->label_ref, b->label_ref) == 0;
+    return a->value == b->value;
+}
+
+// Lee un numero o una etiqueta como operando
+static int parse_operand_value(char *text, AsmInst *in) {
+    text = trim(text);
+    if (*text == 0) return -1;
+    if (is_identifier(text)) {
+        if (strlen(text) >= ASM_MAX_NAME) return -1;
+        strcpy(in->label_ref, text);
+        return 0;
+    }
+    char *end;
+    long v = strtol(text, &end, 10);
+    if (*trim(end) != 0 || v < 0 || v > 99999) return -1;
+    in->value = (int)v;
+    return 0;
+}
+
+/* =========================================================================
+ * PASADA 1: LECTURA DEL FUENTE
+ * ========================================================================= */
+
+static int asm_error(int line, const char *msg, const char *detail) {
+    printf("Error ensamblando (linea %d): %s '%s'\n", line, msg, detail);
+    log_event("Ensamblador: linea %d: %s '%s'", line, msg, detail);
+    return -1;
+}
+
+static int add_label(AsmProgram *p, const char *name, int line) {
+    if (find_label(p, name) >= 0) return asm_error(line, "Etiqueta repetida", name);
+    if (p->label_count >= ASM_MAX_LABELS) return asm_error(line, "Demasiadas etiquetas", name);
+    strcpy(p->labels[p->label_count].name, name);
+    p->labels[p->label_count].index = p->count;
+    p->label_count++;
+    return 0;
+}
+
+static int parse_line(AsmProgram *p, char *line, int line_no) {
+    // Quitar comentarios
+    char *c = strstr(line, "//");
+    if (c) *c = 0;
+    c = strchr(line, ';');
+    if (c) *c = 0;
+
+    char *s = trim(line);
+    if (*s == 0) return 0;
+
+    // Metadatos (mismos que el loader)
+    if (strncmp(s, "_start", 6) == 0) {
+        if (sscanf(s, "_start %d", &p->start) != 1) return asm_error(line_no, "_start invalido", s);
+        return 0;
+    }
+    if (strncmp(s, ".NombreProg", 11) == 0) {
+        snprintf(p->name, sizeof(p->name), "%s", trim(s + 11));
+        return 0;
+    }
+    if (strncmp(s, ".base", 5) == 0) {
+        if (sscanf(s, ".base %d", &p->base) != 1) return asm_error(line_no, ".base invalido", s);
+        return 0;
+    }
+
+    // Etiqueta "nombre:" al inicio
+    char *colon = strchr(s, ':');
+    if (colon) {
+        *colon = 0;
+        char *label = trim(s);
+        if (!is_identifier(label) || strlen(label) >= ASM_MAX_NAME) {
+            return asm_error(line_no, "Etiqueta invalida", label);
+        }
+        if (add_label(p, label, line_no) < 0) return -1;
+        s = trim(colon + 1);
+        if (*s == 0) return 0;
+    }
+
+    if (p->count >= ASM_MAX_INST) return asm_error(line_no, "Programa demasiado grande", s);
+    AsmInst *in = &p->inst[p->count];
+    memset(in, 0, sizeof(*in));
+    in->line = line_no;
+
+    // Separar mnemonico del operando
+    char *operand = s;
+    while (*operand && !isspace((unsigned char)*operand)) operand++;
+    if (*operand) *operand++ = 0;
+    operand = trim(operand);
+
+    if (strcmp(s, ".word") == 0) {
+        char *end;
+        long v = strtol(operand, &end, 10);
+        if (*operand == 0 || *trim(end) != 0 || v > 99999999 || v < -9999999) {
+            return asm_error(line_no, "Dato invalido", operand);
+        }
+        in->opcode = -1;
+        in->value = (int)v;
+        p->count++;
+        return 0;
+    }
+
+    int op = isa_lookup(s);
+    if (op < 0) return asm_error(line_no, "Mnemonico desconocido", s);
+    in->opcode = op;
+    in->mode = ADDR_DIRECT;
+
+    int kind = isa_operand_kind(op);
+    if (kind == ISA_ARG_NONE) {
+        if (*operand) return asm_error(line_no, "Esta instruccion no lleva operando", operand);
+        p->count++;
+        return 0;
+    }
+    if (*operand == 0) return asm_error(line_no, "Falta el operando de", s);
+
+    size_t len = strlen(operand);
+    if (operand[0] == '#') {
+        if (kind == ISA_ARG_ADDR) return asm_error(line_no, "No se permite inmediato en", s);
+        if (kind == ISA_ARG_DATA) in->mode = ADDR_IMMEDIATE;
+        operand++;
+    } else if (operand[0] == '[' && operand[len - 1] == ']') {
+        if (kind == ISA_ARG_VALUE) return asm_error(line_no, "No se permite indexado en", s);
+        in->mode = ADDR_INDEXED;
+        operand[len - 1] = 0;
+        operand++;
+    }
+    if (parse_operand_value(operand, in) < 0) return asm_error(line_no, "Operando invalido", operand);
+
+    p->count++;
+    return 0;
+}
+
+/* =========================================================================
+ * OPTIMIZADOR PEEPHOLE
+ * Trabaja sobre la lista simbolica, antes de asignar direcciones, para que
+ * las etiquetas se resuelvan bien aunque se borren instrucciones.
+ *
+ *  1. Cadenas de saltos: "j A" donde A: "j B" pasa a ser "j B".
+ *  2. Pares LOAD/STR redundantes: "str x; load x" y "load x; str x"
+ *     dejan la segunda sin efecto.
+ *  3. Plegado de inmediatos: "load #a; sum #b" -> "load #(a+b)" (y res,
+ *     mult, divi), mientras el resultado quepa en un inmediato (0-99999).
+ *     Ojo: LOAD no actualiza el CC, pero ninguna instruccion de la ISA lee
+ *     el CC, asi que el programa se comporta igual.
+ *
+ * Las pasadas 2 y 3 BORRAN instrucciones y eso corre las direcciones. Las
+ * etiquetas se resuelven despues y siguen bien, pero un operando numerico
+ * (salto o dato, directo o indexado, y la direccion del DMA) que cae dentro
+ * del programa apuntaria a otra cosa. Si hay alguno no se borra nada, y
+ * nunca se borra una instruccion a la que apunta una etiqueta.
+ * ========================================================================= */
+
+// Siguiente instruccion viva despues de i (-1 si no hay)
+static int next_alive(const AsmProgram *p, int i) {
+    for (i++; i < p->count; i++) {
+        if (!p->inst[i].removed) return i;
+    }
+    return -1;
+}
+
+static int label_target(const AsmProgram *p, const char *name) {
+    int l = find_label(p, name);
+    return l < 0 ? -1 : p->labels[l].index;
+}
+
+// 1 si 'in' tiene un operando numerico que es una direccion dentro del
+// programa [start, start + count)
+static int numeric_operand_inside(const AsmProgram *p, const AsmInst *in) {
+    if (in->opcode < 0 || in->label_ref[0]) return 0;
+    int kind = isa_operand_kind(in->opcode);
+    int addr;
+    if ((kind == ISA_ARG_DATA || kind == ISA_ARG_ADDR) && in->mode != ADDR_IMMEDIATE) {
+        addr = in->value + p->base; // Igual que se resuelven las etiquetas
+    } else if (in->opcode == OP_SDMAM || in->opcode == OP_SDMAR) {
+        addr = in->value;           // El DMA usa direcciones fisicas
+    } else {
+        return 0;                   // Inmediato, timer, registros del DMA...
+    }
+    return addr >= p->start && addr < p->start + p->count;
+}
+
+static int fold_immediate(int opcode, int acc, int operand, int *result) {
+    long long r;
+    switch (opcode) {
+        case OP_SUM:  r = (long long)acc + operand; break;
+        case OP_RES:  r = (long long)acc - operand; break;
+        case OP_MULT: r = (long long)acc * operand; break;
+        case OP_DIVI:
+            if (operand == 0) return 0; // Dejamos que truene en ejecucion
+            r = acc / operand;
+            break;
+        default: return 0;
+    }
+    if (r < 0 || r > 99999) return 0;
+    *result = (int)r;
+    return 1;
+}
+
+static int optimize_program(AsmProgram *p) {
+    int removed = 0;
+
+    // Se pueden borrar instrucciones?
+    int can_delete = 1;
+    for (int i = 0; i < p->count && can_delete; i++) {
+        if (numeric_operand_inside(p, &p->inst[i])) {
+            can_delete = 0;
+            log_event("Optimizador: la linea %d usa una direccion numerica del programa, "
+                      "solo se acortan cadenas de saltos", p->inst[i].line);
+        }
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 0; i < p->count; i++) {
+            AsmInst *a = &p->inst[i];
+            if (a->removed) continue;
+
+            // 1. Cadenas de saltos
+            if (is_jump(a->opcode) && a->mode == ADDR_DIRECT && a->label_ref[0]) {
+                for (int hops = 0; hops < ASM_MAX_CHAIN; hops++) {
+                    int t = label_target(p, a->label_ref);
+                    if (t < 0 || t >= p->count) break;
+                    // Si la etiqueta cae en algo borrado, seguimos a la siguiente viva
+                    if (p->inst[t].removed) t = next_alive(p, t);
+                    if (t < 0) break;
+                    AsmInst *target = &p->inst[t];
+                    if (target == a || target->opcode != OP_J || target->mode != ADDR_DIRECT ||
+                        target->label_ref[0] == 0 || strcmp(target->label_ref, a->label_ref) == 0) break;
+                    strcpy(a->label_ref, target->label_ref);
+                    changed = 1;
+                }
+            }
+
+            if (!can_delete) continue;
+            int j = next_alive(p, i);
+            if (j < 0) continue;
+            AsmInst *b = &p->inst[j];
+            if (b->is_target) continue;
+
+            // 2. LOAD/STR redundantes
+            if ((a->opcode == OP_STR && b->opcode == OP_LOAD && same_direct_operand(a, b)) ||
+                (a->opcode == OP_LOAD && b->opcode == OP_STR && same_direct_operand(a, b))) {
+                b->removed = 1;
+                removed++;
+                changed = 1;
+                continue;
+            }
+
+            // 3. Plegado de inmediatos
+            if (a->opcode == OP_LOAD && a->mode == ADDR_IMMEDIATE && a->label_ref[0] == 0 &&
+                is_arith(b->opcode) && b->mode == ADDR_IMMEDIATE && b->label_ref[0] == 0) {
+                int r;
+                if (fold_immediate(b->opcode, a->value, b->value, &r)) {
+                    a->value = r;
+                    b->removed = 1;
+                    removed++;
+                    changed = 1;
+                }
+            }
+        }
+    }
+    return removed;
+}
+
+/* =========================================================================
+ * PASADA 2: DIRECCIONES, ETIQUETAS Y SALIDA
+ * ========================================================================= */
+
+static int write_output(AsmProgram *p, const char *out_filename, int *words) {
+    // Direccion final de cada instruccion viva (las borradas heredan la de
+    // la siguiente, asi una etiqueta "suelta" sigue apuntando bien)
+    int *addr = malloc(sizeof(int) * (p->count + 1));
+    if (!addr) return -1;
+    int next = p->start;
+    for (int i = 0; i < p->count; i++) {
+        addr[i] = next;
+        if (!p->inst[i].removed) next++;
+    }
+    addr[p->count] = next;
+    *words = next - p->start;
+
+    FILE *f = fopen(out_filename, "w");
+    if (!f) {
+        printf("Error: No se pudo crear el archivo %s\n", out_filename);
+        free(addr);
+        return -1;
+    }
+
+    fprintf(f, "_start %d\n", p->start);
+    fprintf(f, ".NumeroPalabras %d\n", *words);
+    fprintf(f, ".NombreProg %s\n", p->name[0] ? p->name : "SinNombre");
+
+    int rc = 0;
+    for (int i = 0; i < p->count && rc == 0; i++) {
+        AsmInst *in = &p->inst[i];
+        if (in->removed) continue;
+
+        if (in->opcode < 0) {
+            fprintf(f, "%08d // %d: .word\n", in->value, addr[i]);
+            continue;
+        }
+
+        int value = in->value;
+        if (in->label_ref[0]) {
+            int l = find_label(p, in->label_ref);
+            if (l < 0) {
+                rc = asm_error(in->line, "Etiqueta no definida", in->label_ref);
+                break;
+            }
+            value = addr[p->labels[l].index] - p->base;
+            if (value < 0 || value > 99999) {
+                rc = asm_error(in->line, "Etiqueta fuera de rango para .base", in->label_ref);
+                break;
+            }
+        }
+
+        int word = in->opcode * 1000000 + in->mode * 100000 + value;
+        const char *prefix = in->mode == ADDR_IMMEDIATE ? "#" : (in->mode == ADDR_INDEXED ? "[" : "");
+        const char *suffix = in->mode == ADDR_INDEXED ? "]" : "";
+        if (isa_operand_kind(in->opcode) == ISA_ARG_NONE) {
+            fprintf(f, "%08d // %d: %s\n", word, addr[i], isa_mnemonic(in->opcode));
+        } else {
+            fprintf(f, "%08d // %d: %s %s%d%s\n", word, addr[i], isa_mnemonic(in->opcode),
+                    prefix, value, suffix);
+        }
+    }
+
+    fclose(f);
+    free(addr);
+    return rc;
+}
+
+int assemble_file(const char *src_filename, const char *out_filename, int optimize) {
+    FILE *f = fopen(src_filename, "r");
+    if (!f) {
+        printf("Error: No se pudo abrir el archivo %s\n", src_filename);
+        return -1;
+    }
+
+    AsmProgram *p = calloc(1, sizeof(AsmProgram));
+    if (p) p->inst = malloc(sizeof(AsmInst) * ASM_MAX_INST);
+    if (!p || !p->inst) {
+        printf("Error: Sin memoria para ensamblar\n");
+        if (p) free(p);
+        fclose(f);
+        return -1;
+    }
+    p->start = USER_MEM_START;
+    p->base = USER_MEM_START;
+
+    log_event("Ensamblando %s -> %s (optimizar=%d)", src_filename, out_filename, optimize);
+
+    char line[ASM_MAX_LINE];
+    int line_no = 0;
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        line_no++;
+        line[strcspn(line, "\n")] = 0;
+        rc = parse_line(p, line, line_no);
+    }
+    fclose(f);
+
+    // Marcamos las instrucciones que son destino de alguna etiqueta
+    for (int i = 0; rc == 0 && i < p->label_count; i++) {
+        if (p->labels[i].index < p->count) p->inst[p->labels[i].index].is_target = 1;
+    }
+
+    int removed = 0;
+    if (rc == 0 && optimize) removed = optimize_program(p);
+
+    int words = 0;
+    if (rc == 0) rc = write_output(p, out_filename, &words);
+
+    if (rc == 0) {
+        printf("Ensamblado OK: %d palabras en %s", words, out_filename);
+        if (optimize) printf(" (%d eliminadas por el optimizador)", removed);
+        printf("\n");
+        log_event("Ensamblado terminado: %d palabras, %d eliminadas", words, removed);
+    }
+
+    free(p->inst);
+    free(p);
+    return rc;
+}
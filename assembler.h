@@ -0,0 +1,24 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+// Ensambla un programa escrito con mnemonicos (tabla ISA_OPCODES de
+// hardware.h) y etiquetas, y lo deja en el formato que entiende el loader.
+//
+// Sintaxis (una instruccion por linea, comentarios con // o ;):
+//   _start 300          Direccion de carga (igual que en el loader)
+//   .NombreProg Nombre  Nombre del programa
+//   .base 300           Las etiquetas se resuelven como (direccion - base).
+//                       Por defecto USER_MEM_START, porque en modo usuario la
+//                       CPU le suma RB a toda direccion. Usa .base 0 para
+//                       programas que corren en modo kernel (debug).
+//   ciclo:  res #1      Etiqueta opcional al inicio de la linea
+//           load #5     Inmediato
+//           str  x      Directo (numero o etiqueta)
+//           load [x]    Indexado (x + AC)
+//   x:      .word 0     Palabra de datos
+//
+// Si optimize != 0 se aplica una pasada "peephole" (ver assembler.c).
+// Retorna 0 si éxito, -1 si error.
+int assemble_file(const char *src_filename, const char *out_filename, int optimize);
+
+#endif // ASSEMBLER_H
@@ -0,0 +1,489 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <glob.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "hardware.h"
+#include "loader.h"
+#include "logger.h"
+#include "fuzzer.h"
+
+/*
+ * FUZZER
+ * Cada trabajador es un proceso aparte (fork), asi que tiene su propia
+ * maquina completa (memoria, registros, DMA) y si algo lo tumba los demas
+ * siguen. Lo que se comparte va en memoria compartida (mmap):
+ *   - El mapa de cobertura: tuplas (opcode, direccionamiento, interrupcion)
+ *   - El corpus: entradas que dieron cobertura nueva, para seguir mutandolas
+ *   - La entrada que cada trabajador esta corriendo (para rescatarla si muere)
+ *   - Cuantas ejecuciones lleva cada uno (para el reporte y el watchdog)
+ *
+ * Las entradas son texto en el formato del loader, asi se fuzzea el loader
+ * y la CPU a la vez, y cualquier hallazgo se reproduce con --batch.
+ *
+ * Para que vaya rapido: sin log, sin stdout (va a /dev/null), el DMA sin
+ * hilo ni sleep, y la cobertura se revisa primero en una copia local (solo
+ * se toca el mapa compartido cuando la tupla es nueva para el trabajador).
+ * Para encontrar mas crashes conviene compilar con -fsanitize=address.
+ */
+
+#define FUZZ_INPUT_MAX   2048   // Bytes maximos de una entrada
+#define FUZZ_CORPUS_MAX  4096   // Entradas maximas en el corpus compartido
+#define FUZZ_MAX_JOBS    64
+#define FUZZ_MAX_CYCLES  1000   // Por ejecucion (que el programa se cicle es normal)
+#define FUZZ_IDLE_CYCLES 200    // Se corta si en tantos ciclos no vio nada nuevo
+#define FUZZ_HANG_SECS   3      // Un trabajador sin avanzar este tiempo esta trabado
+#define FUZZ_MUTATIONS   4      // Mutaciones apiladas maximas por entrada
+
+// Dimensiones del mapa de cobertura. La ultima fila de opcodes es para
+// palabras con opcode imposible, y la ultima columna es "sin interrupcion".
+#define FUZZ_OPS   (ISA_MAX_OPCODE + 1)
+#define FUZZ_MODES 10
+#define FUZZ_INTS  (INT_MAX_CODE + 2)
+#define FUZZ_NO_INT (FUZZ_INTS - 1)
+
+typedef struct {
+    int ready;                  // 1 cuando data/len ya estan escritos
+    int len;
+    char data[FUZZ_INPUT_MAX];
+} FuzzInput;
+
+typedef struct {
+    unsigned char coverage[FUZZ_OPS][FUZZ_MODES][FUZZ_INTS];
+    int coverage_count;
+    int corpus_count;           // Puede pasarse de FUZZ_CORPUS_MAX (se ignoran)
+    FuzzInput corpus[FUZZ_CORPUS_MAX];
+    long execs[FUZZ_MAX_JOBS];
+    FuzzInput current[FUZZ_MAX_JOBS];
+} FuzzShared;
+
+static FuzzShared *shared;
+static const char *fuzz_dir;
+static volatile sig_atomic_t fuzz_stop = 0;
+
+// Estado de cada trabajador
+static unsigned long long rng_state;
+static unsigned char local_cov[FUZZ_OPS][FUZZ_MODES][FUZZ_INTS];
+static int valid_ops[ISA_MAX_OPCODE];
+static int valid_op_count;
+
+// Valores que suelen pegarle a los bordes (areas del SO, vectores, RB, pila)
+static const int interesting[] = {
+    0, 1, 2, 4, 9, 10, 99, 100, 199, 200, 209, 210, 299, 300, 301,
+    1000, 1699, 1700, 1995, 1999, 2000, 9999, 50000, 99999
+};
+#define INTERESTING_COUNT (int)(sizeof(interesting) / sizeof(interesting[0]))
+
+// Semillas a mano para los casos raros que conocemos
+static const char *builtin_seeds[] = {
+    "_start 300\n05100005\n",                       // STR inmediato
+    "_start 300\n04100007\n03100000\n",             // DIVI entre cero
+    "_start 300\n04100000\n01100005\n04200000\n",   // Indexado con AC negativo
+    "_start 300\n26000000\n26000000\n",             // POP con la pila vacia
+    "_start 300\n27001699\n",                       // PC >= MEM_SIZE
+    "_start 300\n31100000\n32100500\n33000000\n15000000\n00000000\n", // DMA
+    ".NumeroPalabras 99999\n00000000\n",            // No cabe
+};
+#define BUILTIN_SEED_COUNT (int)(sizeof(builtin_seeds) / sizeof(builtin_seeds[0]))
+
+static unsigned rnd(unsigned n) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    unsigned long long r = rng_state * 2685821657736338717ULL;
+    return n ? (unsigned)((r >> 32) % n) : 0;
+}
+
+static int random_instruction() {
+    int op = rnd(16) == 0 ? (int)rnd(ISA_MAX_OPCODE) : valid_ops[rnd(valid_op_count)];
+    int mode = rnd(8) == 0 ? (int)rnd(10) : (int)rnd(3);
+    int value = rnd(2) ? interesting[rnd(INTERESTING_COUNT)] : (int)rnd(100000);
+    return op * 1000000 + mode * 100000 + value;
+}
+
+/* =========================================================================
+ * MUTACIONES (sobre el texto, linea por linea)
+ * ========================================================================= */
+
+static int count_lines(const char *buf, int len) {
+    int n = 1;
+    for (int i = 0; i < len; i++) {
+        if (buf[i] == '\n') n++;
+    }
+    return n;
+}
+
+// Donde empieza y termina (sin el '\n') la linea k
+static void line_bounds(const char *buf, int len, int k, int *start, int *end) {
+    int i = 0;
+    while (k > 0 && i < len) {
+        if (buf[i++] == '\n') k--;
+    }
+    *start = i;
+    while (i < len && buf[i] != '\n') i++;
+    *end = i;
+}
+
+// Cambia buf[start..end) por txt. Si no cabe no hace nada.
+static void replace_range(char *buf, int *len, int start, int end, const char *txt, int tlen) {
+    int new_len = *len - (end - start) + tlen;
+    if (new_len > FUZZ_INPUT_MAX) return;
+    memmove(buf + start + tlen, buf + end, *len - end);
+    memcpy(buf + start, txt, tlen);
+    *len = new_len;
+}
+
+static void mutate(char *buf, int *len) {
+    int rounds = 1 + rnd(FUZZ_MUTATIONS);
+    for (int r = 0; r < rounds; r++) {
+        char txt[FUZZ_INPUT_MAX];
+        int tlen, start, end;
+        int k = rnd(count_lines(buf, *len));
+        line_bounds(buf, *len, k, &start, &end);
+
+        switch (rnd(9)) {
+        case 0: // Cambiar la linea por una instruccion al azar
+            tlen = sprintf(txt, "%08d", random_instruction());
+            replace_range(buf, len, start, end, txt, tlen);
+            break;
+        case 1: // Meter una instruccion nueva
+            tlen = sprintf(txt, "%08d\n", random_instruction());
+            replace_range(buf, len, start, start, txt, tlen);
+            break;
+        case 2: // Borrar la linea (con su salto)
+            replace_range(buf, len, start, end < *len ? end + 1 : end, "", 0);
+            break;
+        case 3: // Duplicar la linea
+            tlen = end - start;
+            memcpy(txt, buf + start, tlen);
+            txt[tlen++] = '\n';
+            replace_range(buf, len, start, start, txt, tlen);
+            break;
+        case 4: // Cambiar un digito (opcode, modo o valor)
+            if (end > start) {
+                int i = start + rnd(end - start);
+                if (isdigit((unsigned char)buf[i])) buf[i] = '0' + rnd(10);
+            }
+            break;
+        case 5: { // Una linea rara para el loader
+            static const char *loader_lines[] = {
+                "_start %d", ".NumeroPalabras %d", "-%d", "%d", "%d9999999",
+                ".", "", "/ comentario %d", ".NombreProg x%d", "_start", ".NumeroPalabras -%d",
+            };
+            const char *fmt = loader_lines[rnd(sizeof(loader_lines) / sizeof(loader_lines[0]))];
+            tlen = snprintf(txt, sizeof(txt), fmt, interesting[rnd(INTERESTING_COUNT)]);
+            txt[tlen++] = '\n';
+            replace_range(buf, len, start, start, txt, tlen);
+            break;
+        }
+        case 6: // Un byte al azar
+            if (*len > 0) {
+                int i = rnd(*len);
+                buf[i] = rnd(2) ? (char)(buf[i] ^ (1 << rnd(8))) : (char)rnd(256);
+            }
+            break;
+        case 7: { // Cambiar el operando por uno interesante
+            int word;
+            if (end - start == 8 && sscanf(buf + start, "%d", &word) == 1) {
+                word = word - word % 100000 + interesting[rnd(INTERESTING_COUNT)];
+                tlen = sprintf(txt, "%08d", word);
+                replace_range(buf, len, start, end, txt, tlen);
+            }
+            break;
+        }
+        case 8: { // Cruzar con otra entrada del corpus
+            int count = __atomic_load_n(&shared->corpus_count, __ATOMIC_ACQUIRE);
+            if (count > FUZZ_CORPUS_MAX) count = FUZZ_CORPUS_MAX;
+            if (count == 0) break;
+            FuzzInput *other = &shared->corpus[rnd(count)];
+            if (!__atomic_load_n(&other->ready, __ATOMIC_ACQUIRE)) break;
+            int ostart, oend;
+            line_bounds(other->data, other->len, rnd(count_lines(other->data, other->len)), &ostart, &oend);
+            replace_range(buf, len, start, *len, other->data + ostart, other->len - ostart);
+            break;
+        }
+        }
+    }
+}
+
+/* =========================================================================
+ * UNA EJECUCION
+ * ========================================================================= */
+
+// Carga y corre la entrada. Retorna cuantas tuplas nuevas (globales) vio.
+static int fuzz_exec(const char *data, int len) {
+    int new_tuples = 0;
+
+    memory_init();
+    cpu_reset();
+    interrupt_pending_dma = 0;
+    dma_selected = 0;
+    memset(dma_channels, 0, sizeof(dma_channels));
+    dma_ring_reset();
+
+    // fmemopen no acepta tamaño 0 en todas las versiones
+    if (len == 0) return 0;
+    FILE *f = fmemopen((void *)data, len, "r");
+    if (!f) return 0;
+    int rc = load_program_stream(f, "fuzz");
+    fclose(f);
+    if (rc != 0) return 0;
+
+    // Igual que "run": modo usuario hasta que termine o se acaben los ciclos
+    cpu_registers.PSW.operation_mode = MODE_USER;
+    cpu_refresh_translation();
+    cpu_running = 1;
+
+    int last_new = 0;
+    for (int c = 0; c < FUZZ_MAX_CYCLES && cpu_running && c - last_new < FUZZ_IDLE_CYCLES; c++) {
+        cpu_last_interrupt = FUZZ_NO_INT;
+        cpu_cycle();
+
+        unsigned op = cpu_registers.IR.cod_op;
+        unsigned mode = cpu_registers.IR.direccionamiento;
+        unsigned code = cpu_last_interrupt;
+        if (op >= ISA_MAX_OPCODE) op = ISA_MAX_OPCODE;
+        if (mode >= FUZZ_MODES) mode = 0;
+        if (code >= FUZZ_INTS) code = FUZZ_NO_INT;
+
+        if (!local_cov[op][mode][code]) {
+            local_cov[op][mode][code] = 1;
+            last_new = c;
+            if (!__atomic_exchange_n(&shared->coverage[op][mode][code], 1, __ATOMIC_RELAXED)) {
+                __atomic_add_fetch(&shared->coverage_count, 1, __ATOMIC_RELAXED);
+                new_tuples++;
+            }
+        }
+    }
+    return new_tuples;
+}
+
+static void save_file(const char *subdir, const char *name, const char *data, int len) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s/%s", fuzz_dir, subdir, name);
+    FILE *f = fopen(path, "w");
+    if (!f) return;
+    fwrite(data, 1, len, f);
+    fclose(f);
+}
+
+static void corpus_add(const char *data, int len) {
+    int slot = __atomic_fetch_add(&shared->corpus_count, 1, __ATOMIC_ACQ_REL);
+    if (slot >= FUZZ_CORPUS_MAX) return; // Lleno: la cobertura igual quedo marcada
+    FuzzInput *in = &shared->corpus[slot];
+    memcpy(in->data, data, len);
+    in->len = len;
+    __atomic_store_n(&in->ready, 1, __ATOMIC_RELEASE);
+
+    char name[32];
+    snprintf(name, sizeof(name), "id_%06d.txt", slot);
+    save_file("corpus", name, data, len);
+}
+
+/* =========================================================================
+ * TRABAJADOR (proceso hijo)
+ * ========================================================================= */
+
+static void fuzz_worker(int id, unsigned long seed) {
+    signal(SIGINT, SIG_IGN); // Al Ctrl+C lo detiene el padre
+    if (!freopen("/dev/null", "w", stdout)) exit(1);
+    logger_mute(1);
+    dma_synchronous = 1;
+    rng_state = (seed + 1) * 0x9E3779B97F4A7C15ULL + id;
+
+    valid_op_count = 0;
+    for (int op = 0; op < ISA_MAX_OPCODE; op++) {
+        if (isa_mnemonic(op)) valid_ops[valid_op_count++] = op;
+    }
+
+    char buf[FUZZ_INPUT_MAX];
+    FuzzInput *current = &shared->current[id];
+
+    for (;;) {
+        int len = 0;
+        int count = __atomic_load_n(&shared->corpus_count, __ATOMIC_ACQUIRE);
+        if (count > FUZZ_CORPUS_MAX) count = FUZZ_CORPUS_MAX;
+        if (count > 0) {
+            FuzzInput *src = &shared->corpus[rnd(count)];
+            if (__atomic_load_n(&src->ready, __ATOMIC_ACQUIRE)) {
+                len = src->len;
+                memcpy(buf, src->data, len);
+            }
+        }
+        mutate(buf, &len);
+
+        // Se anota antes de correr: si el proceso muere, el padre la rescata
+        memcpy(current->data, buf, len);
+        current->len = len;
+
+        if (fuzz_exec(buf, len) > 0) corpus_add(buf, len);
+        __atomic_store_n(&shared->execs[id], shared->execs[id] + 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* =========================================================================
+ * PADRE: arranca trabajadores, vigila y reporta
+ * ========================================================================= */
+
+static void on_sigint(int sig) {
+    (void)sig;
+    fuzz_stop = 1;
+}
+
+static int read_seed(const char *filename, char *buf) {
+    FILE *f = fopen(filename, "r");
+    if (!f) return -1;
+    int len = fread(buf, 1, FUZZ_INPUT_MAX, f);
+    int too_big = fgetc(f) != EOF;
+    fclose(f);
+    return too_big ? -1 : len;
+}
+
+static void seed_corpus() {
+    char buf[FUZZ_INPUT_MAX];
+    for (int i = 0; i < BUILTIN_SEED_COUNT; i++) {
+        corpus_add(builtin_seeds[i], strlen(builtin_seeds[i]));
+    }
+
+    // Los programas de ejemplo del repo (si estamos en su carpeta)
+    glob_t g;
+    if (glob("prueba*.txt", 0, NULL, &g) == 0) {
+        for (size_t i = 0; i < g.gl_pathc; i++) {
+            int len = read_seed(g.gl_pathv[i], buf);
+            if (len >= 0) corpus_add(buf, len);
+        }
+        globfree(&g);
+    }
+}
+
+static pid_t spawn_worker(int id, unsigned long seed) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        fuzz_worker(id, seed);
+        _exit(0);
+    }
+    return pid;
+}
+
+static int save_finding(const char *subdir, const char *kind, int job, int n) {
+    char name[64];
+    FuzzInput *in = &shared->current[job];
+    snprintf(name, sizeof(name), "%s_%04d.txt", kind, n);
+    save_file(subdir, name, in->data, in->len);
+    printf("[fuzz] %s/%s/%s\n", fuzz_dir, subdir, name);
+    return n + 1;
+}
+
+int fuzz_run(const char *out_dir, int jobs, int seconds, unsigned long seed) {
+    if (jobs <= 0) jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if (jobs > FUZZ_MAX_JOBS) jobs = FUZZ_MAX_JOBS;
+    fuzz_dir = out_dir;
+
+    const char *subdirs[] = {"", "/corpus", "/crashes", "/hangs"};
+    for (int i = 0; i < 4; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s%s", out_dir, subdirs[i]);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            printf("Error: No se pudo crear %s\n", path);
+            return -1;
+        }
+    }
+
+    shared = mmap(NULL, sizeof(FuzzShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        printf("Error: Sin memoria compartida para el fuzzer\n");
+        return -1;
+    }
+    seed_corpus();
+    printf("[fuzz] %d trabajadores, %d semillas, salida en %s\n", jobs, shared->corpus_count, out_dir);
+
+    pid_t pids[FUZZ_MAX_JOBS];
+    long last_execs[FUZZ_MAX_JOBS];
+    int stalled[FUZZ_MAX_JOBS];
+    int hung[FUZZ_MAX_JOBS];
+    int crashes = 0, hangs = 0, restarts = 0;
+    for (int j = 0; j < jobs; j++) {
+        pids[j] = spawn_worker(j, seed + j);
+        last_execs[j] = 0;
+        stalled[j] = 0;
+        hung[j] = 0;
+    }
+
+    signal(SIGINT, on_sigint);
+    struct timespec t0, now;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    long prev_total = 0;
+    double prev_secs = 0;
+
+    while (!fuzz_stop) {
+        sleep(1);
+
+        // Trabajadores que murieron: si fue por una señal es un crash
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (int j = 0; j < jobs; j++) {
+                if (pids[j] != pid) continue;
+                if (hung[j]) {
+                    hung[j] = 0;
+                } else if (WIFSIGNALED(status)) {
+                    char kind[32];
+                    snprintf(kind, sizeof(kind), "crash_sig%d", WTERMSIG(status));
+                    crashes = save_finding("crashes", kind, j, crashes);
+                }
+                restarts++;
+                stalled[j] = 0;
+                pids[j] = spawn_worker(j, seed + j + (unsigned long)restarts * 7919);
+            }
+        }
+
+        // Watchdog: si un trabajador no avanza, el simulador se trabo
+        long total = 0;
+        for (int j = 0; j < jobs; j++) {
+            long e = __atomic_load_n(&shared->execs[j], __ATOMIC_RELAXED);
+            total += e;
+            if (e != last_execs[j]) {
+                last_execs[j] = e;
+                stalled[j] = 0;
+            } else if (++stalled[j] >= FUZZ_HANG_SECS && !hung[j]) {
+                hangs = save_finding("hangs", "hang", j, hangs);
+                hung[j] = 1;
+                kill(pids[j], SIGKILL);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double secs = (now.tv_sec - t0.tv_sec) + (now.tv_nsec - t0.tv_nsec) / 1e9;
+        int corpus = shared->corpus_count < FUZZ_CORPUS_MAX ? shared->corpus_count : FUZZ_CORPUS_MAX;
+        printf("[fuzz] %4.0fs: %ld ejecuciones (%.0f/s), cobertura %d tuplas, corpus %d, crashes %d, hangs %d\n",
+               secs, total, (total - prev_total) / (secs - prev_secs), shared->coverage_count,
+               corpus, crashes, hangs);
+        prev_total = total;
+        prev_secs = secs;
+
+        if (seconds > 0 && secs >= seconds) break;
+    }
+
+    for (int j = 0; j < jobs; j++) kill(pids[j], SIGKILL);
+    for (int j = 0; j < jobs; j++) waitpid(pids[j], NULL, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double secs = (now.tv_sec - t0.tv_sec) + (now.tv_nsec - t0.tv_nsec) / 1e9;
+    long total = 0;
+    for (int j = 0; j < jobs; j++) total += shared->execs[j];
+    printf("[fuzz] Fin: %ld ejecuciones en %.1f s (%.0f/s), %d tuplas, %d crashes, %d hangs\n",
+           total, secs, total / secs, shared->coverage_count, crashes, hangs);
+
+    munmap(shared, sizeof(FuzzShared));
+    return (crashes || hangs) ? 1 : 0;
+}
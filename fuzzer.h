@@ -0,0 +1,18 @@
+#ifndef FUZZER_H
+#define FUZZER_H
+
+// Fuzzer de la CPU y del loader (ver fuzzer.c)
+//
+// Arranca 'jobs' procesos (uno por nucleo si jobs <= 0), cada uno con su
+// propia maquina, que mutan programas en formato del loader y los corren.
+// La cobertura son las tuplas (opcode, direccionamiento, interrupcion).
+// En out_dir quedan:
+//   corpus/   Entradas que encontraron cobertura nueva
+//   crashes/  Entradas que tumbaron al simulador (con la señal en el nombre)
+//   hangs/    Entradas que dejaron al simulador trabado (no al programa)
+// Corre 'seconds' segundos (0 = hasta Ctrl+C).
+// Cualquier entrada guardada se reproduce con ./machine --batch <archivo>.
+// Retorna 0 si no hubo crashes ni hangs, 1 si hubo, -1 si error.
+int fuzz_run(const char *out_dir, int jobs, int seconds, unsigned long seed);
+
+#endif // FUZZER_H
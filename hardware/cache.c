@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hardware.h"
+#include "../logger.h"
+
+/*
+ * SIMULADOR DE CACHE
+ * La memoria de la maquina cuesta lo mismo en cualquier direccion, asi que
+ * no se nota cuando un programa brinca por toda la memoria. Esto simula
+ * (solo las etiquetas, los datos siguen en main_memory) una jerarquia:
+ *
+ *   L1I (instrucciones) ─┐
+ *                        ├─ L2 unificada (opcional) ── memoria
+ *   L1D (datos)        ──┘
+ *
+ * Cada nivel: tamaño y linea en palabras, vias (asociatividad, reemplazo
+ * LRU) y politica de escritura:
+ *   write-back : la escritura se queda en la cache (linea sucia) y baja al
+ *                siguiente nivel cuando la linea sale
+ *   write-through: toda escritura baja al siguiente nivel; si falla no se
+ *                trae la linea (no-write-allocate)
+ *
+ * El costo es un estimado en ciclos (CACHE_*_CYCLES) y se le anota a la
+ * instruccion que hizo el acceso, para ver que PCs son los caros.
+ * Apagado (lo normal) la CPU solo checa cache_enabled y no llama nada.
+ */
+
+typedef struct {
+    const char *name;
+    int enabled;
+    int words;              // Tamaño total en palabras
+    int line_words;
+    int ways;
+    int write_back;
+    int line_shift;         // log2(line_words)
+    int set_mask;           // sets - 1
+    int *tags;              // [sets * ways] numero de linea, -1 = vacia
+    unsigned char *dirty;
+    unsigned long *stamp;   // Ultimo uso (para LRU)
+    unsigned long clock;
+    int hit_cycles;
+
+    long reads, writes, misses, writebacks;
+} CacheLevel;
+
+enum { LEVEL_L1I, LEVEL_L1D, LEVEL_L2, LEVEL_COUNT };
+
+static CacheLevel levels[LEVEL_COUNT] = {
+    {.name = "L1I", .hit_cycles = CACHE_HIT_CYCLES},
+    {.name = "L1D", .hit_cycles = CACHE_HIT_CYCLES},
+    {.name = "L2",  .hit_cycles = CACHE_L2_CYCLES},
+};
+
+int cache_enabled = 0;
+long cache_stall_cycles = 0;    // Ciclos de mas sobre un acierto (nunca se borra)
+
+// Costo por instruccion (indexado por el PC que hizo el acceso)
+static int cache_pc = 0;
+static int pc_slots = 0;
+static long *pc_cycles;
+static long *pc_misses;
+static long total_cycles;
+static long fetches;
+
+static int log2_exact(int n) {
+    int s = 0;
+    while ((1 << s) < n) s++;
+    return (1 << s) == n ? s : -1;
+}
+
+/* =========================================================================
+ * ACCESOS
+ * ========================================================================= */
+
+static int level_access(CacheLevel *c, int addr, int write);
+
+// Lo que cuesta ir al nivel de abajo (L2 si esta prendida, si no memoria)
+static int next_level(CacheLevel *c, int addr, int write) {
+    if (c != &levels[LEVEL_L2] && levels[LEVEL_L2].enabled) {
+        return level_access(&levels[LEVEL_L2], addr, write);
+    }
+    return CACHE_MEM_CYCLES;
+}
+
+// Ciclos que tarda el acceso en este nivel (contando los de abajo)
+static int level_access(CacheLevel *c, int addr, int write) {
+    int line = addr >> c->line_shift;
+    int base = (line & c->set_mask) * c->ways;
+    int cycles = c->hit_cycles;
+    c->clock++;
+    if (write) c->writes++;
+    else c->reads++;
+
+    for (int w = base; w < base + c->ways; w++) {
+        if (c->tags[w] != line) continue;
+        c->stamp[w] = c->clock;
+        if (write) {
+            if (c->write_back) c->dirty[w] = 1;
+            else cycles += next_level(c, addr, 1);
+        }
+        return cycles;
+    }
+
+    c->misses++;
+    if (write && !c->write_back) return cycles + next_level(c, addr, 1);
+
+    // Victima: una via vacia o la que lleva mas tiempo sin usarse
+    int victim = base;
+    for (int w = base; w < base + c->ways; w++) {
+        if (c->tags[w] < 0) {
+            victim = w;
+            break;
+        }
+        if (c->stamp[w] < c->stamp[victim]) victim = w;
+    }
+    if (c->tags[victim] >= 0 && c->dirty[victim]) {
+        c->writebacks++;
+        cycles += next_level(c, c->tags[victim] << c->line_shift, 1);
+    }
+    cycles += next_level(c, addr, 0);
+    c->tags[victim] = line;
+    c->dirty[victim] = write;
+    c->stamp[victim] = c->clock;
+    return cycles;
+}
+
+int cache_access(int kind, int addr, int write) {
+    if (addr < 0 || addr >= MEM_SIZE) return 0;
+    CacheLevel *l1 = &levels[kind == CACHE_INST ? LEVEL_L1I : LEVEL_L1D];
+    if (kind == CACHE_INST) {
+        cache_pc = addr;
+        fetches++;
+    }
+
+    int cycles;
+    if (l1->enabled) {
+        long misses = l1->misses;
+        cycles = level_access(l1, addr, write);
+        if (cache_pc < pc_slots) pc_misses[cache_pc] += l1->misses - misses;
+    } else {
+        cycles = next_level(l1, addr, write);
+    }
+    total_cycles += cycles;
+    cache_stall_cycles += cycles - CACHE_HIT_CYCLES;
+    if (cache_pc < pc_slots) pc_cycles[cache_pc] += cycles;
+    return cycles;
+}
+
+/* =========================================================================
+ * CONFIGURACION Y ESTADISTICAS
+ * ========================================================================= */
+
+static void level_free(CacheLevel *c) {
+    free(c->tags);
+    free(c->dirty);
+    free(c->stamp);
+    c->tags = NULL;
+    c->dirty = NULL;
+    c->stamp = NULL;
+    c->enabled = 0;
+}
+
+// Vacia todas las caches y pone las estadisticas en cero (programa nuevo)
+void cache_reset() {
+    for (int i = 0; i < LEVEL_COUNT; i++) {
+        CacheLevel *c = &levels[i];
+        c->reads = c->writes = c->misses = c->writebacks = 0;
+        c->clock = 0;
+        if (!c->enabled) continue;
+        int lines = c->words / c->line_words;
+        memset(c->tags, 0xff, lines * sizeof(int)); // -1 = vacia
+        memset(c->dirty, 0, lines);
+        memset(c->stamp, 0, lines * sizeof(unsigned long));
+    }
+    if (pc_slots) {
+        memset(pc_cycles, 0, pc_slots * sizeof(long));
+        memset(pc_misses, 0, pc_slots * sizeof(long));
+    }
+    total_cycles = 0;
+    fetches = 0;
+    cache_pc = 0;
+}
+
+/*
+ * Prende un nivel (CACHE_INST, CACHE_DATA o CACHE_L2) con la geometria
+ * dada. Tamaño, linea y numero de conjuntos tienen que ser potencias de 2.
+ * Retorna 0, o -1 si la geometria no sirve.
+ */
+int cache_configure(int level, int words, int line_words, int ways, int write_back) {
+    CacheLevel *c = &levels[level == CACHE_INST ? LEVEL_L1I : level == CACHE_DATA ? LEVEL_L1D : LEVEL_L2];
+    int line_shift = log2_exact(line_words);
+    int sets = (line_words > 0 && ways > 0) ? words / (line_words * ways) : 0;
+    if (line_shift < 0 || sets <= 0 || sets * line_words * ways != words || log2_exact(sets) < 0) {
+        printf("Error: Cache %s invalida (%d palabras, lineas de %d, %d vias): "
+               "linea y conjuntos deben ser potencias de 2\n", c->name, words, line_words, ways);
+        return -1;
+    }
+
+    level_free(c);
+    int lines = sets * ways;
+    c->tags = malloc(lines * sizeof(int));
+    c->dirty = malloc(lines);
+    c->stamp = malloc(lines * sizeof(unsigned long));
+    if (!c->tags || !c->dirty || !c->stamp) {
+        printf("Error: Sin memoria para la cache %s\n", c->name);
+        level_free(c);
+        return -1;
+    }
+    if (pc_slots < MEM_SIZE) {
+        free(pc_cycles);
+        free(pc_misses);
+        pc_cycles = calloc(MEM_SIZE, sizeof(long));
+        pc_misses = calloc(MEM_SIZE, sizeof(long));
+        pc_slots = (pc_cycles && pc_misses) ? MEM_SIZE : 0;
+    }
+
+    c->words = words;
+    c->line_words = line_words;
+    c->ways = ways;
+    c->write_back = write_back;
+    c->line_shift = line_shift;
+    c->set_mask = sets - 1;
+    c->enabled = 1;
+    cache_enabled = 1;
+    cache_reset();
+    log_event("Cache %s: %d palabras, lineas de %d, %d vias, %s", c->name, words, line_words, ways,
+              write_back ? "write-back" : "write-through");
+    return 0;
+}
+
+void cache_disable() {
+    for (int i = 0; i < LEVEL_COUNT; i++) level_free(&levels[i]);
+    free(pc_cycles);
+    free(pc_misses);
+    pc_cycles = pc_misses = NULL;
+    pc_slots = 0;
+    cache_enabled = 0;
+}
+
+static void level_print(FILE *out, const CacheLevel *c) {
+    if (!c->enabled) {
+        fprintf(out, "  %-3s: apagada\n", c->name);
+        return;
+    }
+    long total = c->reads + c->writes;
+    fprintf(out, "  %-3s: %d palabras, lineas de %d, %d vias, %s\n", c->name, c->words, c->line_words,
+            c->ways, c == &levels[LEVEL_L1I] ? "solo lectura" : c->write_back ? "write-back" : "write-through");
+    fprintf(out, "       %ld accesos (%ld escrituras), %ld fallos (%.2f%% acierto), %ld write-backs\n",
+            total, c->writes, c->misses, total ? 100.0 * (total - c->misses) / total : 0.0, c->writebacks);
+}
+
+void cache_print_stats(FILE *out) {
+    if (!cache_enabled) {
+        fprintf(out, " Cache: apagada (cache i|d|l2 <palabras> <linea> <vias> [wb|wt])\n");
+        return;
+    }
+    fprintf(out, " Cache (acierto %d ciclo, L2 %d, memoria %d):\n", CACHE_HIT_CYCLES, CACHE_L2_CYCLES,
+            CACHE_MEM_CYCLES);
+    for (int i = 0; i < LEVEL_COUNT; i++) level_print(out, &levels[i]);
+    fprintf(out, "  Ciclos de memoria estimados: %ld (%.2f por instruccion)\n", total_cycles,
+            fetches ? (double)total_cycles / fetches : 0.0);
+
+    // Las instrucciones mas caras (seleccion simple, son pocas)
+    int shown[CACHE_TOP_PCS];
+    int n = 0;
+    for (; n < CACHE_TOP_PCS; n++) {
+        int best = -1;
+        for (int pc = 0; pc < pc_slots; pc++) {
+            if (!pc_cycles[pc] || (best >= 0 && pc_cycles[pc] <= pc_cycles[best])) continue;
+            int seen = 0;
+            for (int k = 0; k < n; k++) seen |= shown[k] == pc;
+            if (!seen) best = pc;
+        }
+        if (best < 0) break;
+        shown[n] = best;
+    }
+    if (n) fprintf(out, "  Instrucciones con mas ciclos de memoria:\n");
+    for (int k = 0; k < n; k++) {
+        fprintf(out, "   PC %05d: %ld ciclos, %ld fallos en L1\n", shown[k], pc_cycles[shown[k]],
+                pc_misses[shown[k]]);
+    }
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "hardware.h"
+#include "../logger.h"
+
+/*
+ * CONSOLA
+ * Un dispositivo de salida (y entrada) para que los programas puedan
+ * mostrar resultados sin andar viendo la memoria con "memory <dir>".
+ *
+ * Se usa con SVC: AC = servicio (SVC_PUT_NUMBER, ...), el dato en el tope
+ * de la pila (los servicios estan en svc.c). Lo que se escribe se junta en
+ * un buffer y sale al host de un jalon: cuando se llena, cuando el programa
+ * termina y, si la salida es una terminal, en cada fin de linea. Asi no hay
+ * una llamada al sistema del host por cada caracter.
+ *
+ * La entrada sale de un archivo (--input o "console input <archivo>").
+ */
+
+Console console;
+
+void console_init(FILE *out) {
+    console.out_len = 0;
+    console.host_out = out;
+    console.line_mode = out && isatty(fileno(out));
+    console.chars_out = console.flushes = console.chars_in = 0;
+}
+
+int console_open_input(const char *filename) {
+    if (console.host_in && console.host_in != stdin) fclose(console.host_in);
+    console.host_in = NULL;
+    if (!filename) return 0;
+
+    console.host_in = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+    if (!console.host_in) {
+        printf("Error: No se pudo abrir la entrada de la consola %s\n", filename);
+        return -1;
+    }
+    log_event("Consola: entrada desde %s", filename);
+    return 0;
+}
+
+void console_flush() {
+    if (console.out_len == 0) return;
+    if (console.host_out) {
+        fwrite(console.out, 1, console.out_len, console.host_out);
+        fflush(console.host_out);
+        console.flushes++;
+    }
+    console.out_len = 0;
+}
+
+void console_write(const char *text, int len) {
+    for (int i = 0; i < len; i++) {
+        if (console.out_len == CONSOLE_BUF_SIZE) console_flush();
+        console.out[console.out_len++] = text[i];
+        if (text[i] == '\n' && console.line_mode) console_flush();
+    }
+    console.chars_out += len;
+}
+
+// Un numero (con signo). Retorna 0, o -1 al final de la entrada
+int console_read_number(int *value) {
+    if (!console.host_in) return -1;
+    int c;
+    // Nos saltamos lo que no sea numero (espacios, comas, etc)
+    while ((c = fgetc(console.host_in)) != EOF && c != '-' && (c < '0' || c > '9')) console.chars_in++;
+    if (c == EOF) return -1;
+
+    int sign = 1;
+    long n = 0;
+    if (c == '-') {
+        sign = -1;
+        c = fgetc(console.host_in);
+        console.chars_in++;
+    }
+    while (c >= '0' && c <= '9') {
+        if (n <= 9999999) n = n * 10 + (c - '0');
+        console.chars_in++;
+        c = fgetc(console.host_in);
+    }
+    if (c != EOF) ungetc(c, console.host_in);
+    if (n > 9999999) n = 9999999; // Lo que cabe en una palabra
+    *value = (int)(sign * n);
+    return 0;
+}
+
+// Un caracter, o -1 al final de la entrada
+int console_read_char() {
+    int c = console.host_in ? fgetc(console.host_in) : EOF;
+    if (c == EOF) return -1;
+    console.chars_in++;
+    return c;
+}
+
+void console_print_stats() {
+    printf(" Consola: %ld caracteres escritos en %ld escrituras al host (%s), %ld leidos\n",
+           console.chars_out, console.flushes, console.line_mode ? "por linea" : "por bloques",
+           console.chars_in);
+    printf(" Pendiente en el buffer: %d de %d bytes\n", console.out_len, CONSOLE_BUF_SIZE);
+}
@@ -1,14 +1,66 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <strings.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include "hardware.h"
 #include "../logger.h"
 
 // Aqui estan todos los registros de mi CPU
-Registers cpu_registers;
+// (__thread: con varias CPUs cada hilo tiene los suyos, ver smp.c)
+__thread Registers cpu_registers;
+__thread int cpu_id = 0;
+// Lineas del DMA que revisa esta CPU: solo la 0 atiende al DMA
+static int no_dma_lines = 0;
+static __thread int *cpu_dma_lines = &interrupt_pending_dma;
+
+// Modo paginado (apagado = proteccion RB/RL de siempre)
+int paging_enabled = 0;
+
+// TLB por software: cache de traducciones pagina virtual -> marco.
+// Es de mapeo directo (la pagina v va a la entrada v % TLB_ENTRIES).
+typedef struct {
+    int valid;
+    int vpn;      // Pagina virtual
+    int frame;    // Marco fisico
+} TlbEntry;
+
+static TlbEntry tlb[TLB_ENTRIES];
+
+// Copia de la Tabla de Vectores (0-INT_MAX_CODE) para no ir a memoria en
+// cada interrupcion. Se invalida cuando alguien escribe en esas direcciones.
+static int vector_cache[INT_MAX_CODE + 1];
+static volatile int vector_cache_valid = 0;
+static long tlb_hits = 0;
+static long tlb_misses = 0;
+static long page_faults = 0;
 
 // Forward Declaration
+static void cpu_idle();
 void generate_interrupt(int code);
+static void cpu_build_handlers();
+static void paging_update_watch();
+
+// Accesos de la CPU a memoria: los de siempre, pero si el simulador de
+// cache esta prendido primero se le avisa (ver cache.c). Apagado es un if.
+static inline Word cpu_mem_read(int address) {
+    if (cache_enabled) cache_access(CACHE_DATA, address, 0);
+    return mem_read(address);
+}
+
+static inline void cpu_mem_write(int address, Word data) {
+    if (cache_enabled) cache_access(CACHE_DATA, address, 1);
+    mem_write(address, data);
+}
+
+// Para los bloques (contexto de las interrupciones)
+static inline void cpu_mem_note(int address, int n, int write) {
+    if (!cache_enabled) return;
+    for (int i = 0; i < n; i++) cache_access(CACHE_DATA, address + i, write);
+}
 
 /* =========================================================================
  * FUNCIONES DE AYUDA
@@ -37,6 +89,40 @@ Word int_to_word(int val) {
     return w;
 }
 
+/* =========================================================================
+ * TABLA DE INSTRUCCIONES
+ * Se arma expandiendo ISA_OPCODES (hardware.h), la misma lista que usa el
+ * ensamblador. Indexada por opcode; los huecos quedan en NULL.
+ * ========================================================================= */
+
+typedef struct {
+    const char *mnemonic;
+    int operand_kind;
+} IsaEntry;
+
+#define ISA_TABLE_ENTRY(name, code, mnem, arg) [code] = { mnem, arg },
+static const IsaEntry isa_table[ISA_MAX_OPCODE] = { ISA_OPCODES(ISA_TABLE_ENTRY) };
+#undef ISA_TABLE_ENTRY
+
+const char *isa_mnemonic(int opcode) {
+    if (opcode < 0 || opcode >= ISA_MAX_OPCODE) return NULL;
+    return isa_table[opcode].mnemonic;
+}
+
+int isa_operand_kind(int opcode) {
+    if (!isa_mnemonic(opcode)) return -1;
+    return isa_table[opcode].operand_kind;
+}
+
+int isa_lookup(const char *mnemonic) {
+    for (int op = 0; op < ISA_MAX_OPCODE; op++) {
+        if (isa_table[op].mnemonic && strcasecmp(isa_table[op].mnemonic, mnemonic) == 0) {
+            return op;
+        }
+    }
+    return -1;
+}
+
 /*
  * Esta funcion pone todo en cero para empezar desde el principio
  * Es como reiniciar la maquina.
@@ -47,6 +133,10 @@ void cpu_reset() {
     cpu_registers.RX = 0;
     cpu_registers.RB = 0;
     cpu_registers.RL = MEM_SIZE - 1; // Al principio dejamos acceso a todo
+    cpu_registers.PTBR = PAGE_TABLE_BASE;
+    cpu_registers.PTLR = 0;          // Sin tabla hasta que el loader la arme
+    tlb_flush();
+    paging_update_watch();
     
     // PSW Inicial: 
     // Arrancamos en Modo Kernel (1) para poder cargar cosas.
@@ -55,23 +145,44 @@ void cpu_reset() {
     cpu_registers.PSW.interrupt_enable = INT_DISABLED; // 0
     cpu_registers.PSW.condition_code = CC_ZERO;
     cpu_registers.PSW.pc = 0; // Empezamos en la direccion 0
+    cpu_refresh_translation();
     
     // Limpiamos los registros de trabajo
     cpu_registers.AC.sign = 0; cpu_registers.AC.digits = 0;
     cpu_registers.IR.cod_op = 0; cpu_registers.IR.direccionamiento = 0; cpu_registers.IR.valor = 0;
     
-    // Inicializar Vector de Interrupciones (0-8)
+    // Inicializar Vector de Interrupciones (0-INT_MAX_CODE)
     // Apuntar a una rutina de "Panico" o "Default" en caso de que no haya SO
     // Digamos la direccion 200 para pruebas
-    for (int i=0; i<=8; i++) {
-        mem_write(i, int_to_word(200)); 
+    for (int i=0; i<=INT_MAX_CODE; i++) {
+        mem_write(i, int_to_word(DEFAULT_HANDLER)); 
     }
     // Escribimos un RETRN en la direccion 200, para que si salta ahi, solo regrese.
     // Opcode RETRN = 14 -> 14000000
-    mem_write(200, int_to_word(14000000));
+    mem_write(DEFAULT_HANDLER, int_to_word(14000000));
     
+    cpu_build_handlers();
+    cpu_trust_drop();
+    cpu_cycle_count = 0;
+    cpu_idle_halt = 0;
     cpu_running = 1; // Encendemos motores
-    log_event("CPU Reiniciada. Tabla de Vectores (0-8) apunta a 200. RUNNING=1");
+    log_event("CPU Reiniciada. Tabla de Vectores (0-%d) apunta a 200. RUNNING=1", INT_MAX_CODE);
+}
+
+// Deja lista la CPU 'id' en el hilo que la va a correr (ver smp.c): los
+// registros de la CPU 0 al arrancar, con su propia pila
+void cpu_start_secondary(int id, const Registers *boot) {
+    cpu_id = id;
+    cpu_registers = *boot;
+    cpu_registers.SP -= id * SMP_STACK_WORDS;
+    cpu_registers.RX = cpu_registers.SP;
+    cpu_dma_lines = id == 0 ? &interrupt_pending_dma : &no_dma_lines;
+    dma_selected = 0;
+    cpu_cycle_count = 0;
+    cpu_last_interrupt = -1;
+    cpu_idle_halt = 0;
+    cpu_running = 1;
+    cpu_refresh_translation();
 }
 
 // Esta funcion actualiza los codigos CC del PSW segun como quedo el Acumulador
@@ -103,13 +214,77 @@ int check_memory_protection(int address) {
     return 1; // Todo bien
 }
 
+// Secuencia de interrupciones que hubo (para las pruebas golden).
+// Se guarda comprimida: codigo y cuantas veces seguidas se repitio.
+#define INT_TRACE_RUNS 64
+
+typedef struct {
+    int code;
+    long count;
+} IntTraceRun;
+
+static IntTraceRun int_trace[INT_TRACE_RUNS];
+static int int_trace_len = 0;
+static long int_trace_lost = 0;   // Las que no cupieron
+static pthread_mutex_t int_trace_lock = PTHREAD_MUTEX_INITIALIZER; // Varias CPUs
+
+void cpu_trace_reset() {
+    int_trace_len = 0;
+    int_trace_lost = 0;
+}
+
+// La maquina de referencia del lockstep no cuenta (ver LOCKSTEP)
+static int lockstep_in_reference = 0;
+
+static void cpu_trace_add(int code) {
+    if (lockstep_in_reference) return;
+    if (smp_cpus > 1) pthread_mutex_lock(&int_trace_lock);
+    if (int_trace_len > 0 && int_trace[int_trace_len - 1].code == code) {
+        int_trace[int_trace_len - 1].count++;
+    } else if (int_trace_len < INT_TRACE_RUNS) {
+        int_trace[int_trace_len].code = code;
+        int_trace[int_trace_len].count = 1;
+        int_trace_len++;
+    } else {
+        int_trace_lost++;
+    }
+    if (smp_cpus > 1) pthread_mutex_unlock(&int_trace_lock);
+}
+
+void cpu_trace_print(FILE *out) {
+    fprintf(out, "INTERRUPCIONES");
+    if (int_trace_len == 0) fprintf(out, " ninguna");
+    for (int i = 0; i < int_trace_len; i++) {
+        fprintf(out, " %dx%ld", int_trace[i].code, int_trace[i].count);
+    }
+    if (int_trace_lost) fprintf(out, " (+%ld mas)", int_trace_lost);
+    fprintf(out, "\n");
+}
+
 // Aqui manejamos las interrupciones
 // Es cuando pasa algo importante y hay que parar lo que haciamos
+// Direccion del manejador de 'code' (Memoria[code])
+// Si la copia esta vieja, la traemos completa de un jalon
+static int interrupt_vector(int code) {
+    // Con varias CPUs otra podria estar llenando la copia: directo a memoria.
+    // La referencia del lockstep tambien, para que la copia se compare con algo
+    if (smp_cpus > 1 || lockstep_in_reference) return word_to_int(mem_read(code));
+    if (!vector_cache_valid) {
+        Word vectors[INT_MAX_CODE + 1];
+        vector_cache_valid = 1; // Antes de leer: si alguien escribe mientras, se vuelve a invalidar
+        mem_read_block(0, vectors, INT_MAX_CODE + 1);
+        for (int i = 0; i <= INT_MAX_CODE; i++) vector_cache[i] = word_to_int(vectors[i]);
+    }
+    return vector_cache[code];
+}
+
 void generate_interrupt(int code) {
     log_instruction(cpu_registers.PSW.pc, "INTERRUPCION", code);
+    cpu_trace_add(code);
+    cpu_last_interrupt = code;
     
-    // Validar codigo de interrupcion (0-8)
-    if (code < 0 || code > 8) {
+    // Validar codigo de interrupcion (0-INT_MAX_CODE)
+    if (code < 0 || code > INT_MAX_CODE) {
         // Evitar recursion infinita si el mismo INT_CODE_INVALID falla
         if (code != INT_CODE_INVALID) {
              generate_interrupt(INT_CODE_INVALID);
@@ -124,35 +299,221 @@ void generate_interrupt(int code) {
     
     cpu_registers.PSW.operation_mode = MODE_KERNEL;
     cpu_registers.PSW.interrupt_enable = INT_DISABLED; // Apagamos interrupciones anidadas
+    cpu_refresh_translation();
     
     // IMPORTANTE: Hay que guardar TODO EL CONTEXTO para poder volver.
     // Registros a guardar: PC, PSW, AC, RX.
-    
-    // 1. Push PC
-    cpu_registers.SP--; 
-    mem_write(cpu_registers.SP, int_to_word(cpu_registers.PSW.pc));
-    
-    // 2. Push Flags (Empaquetamos en un numero: 100*CC + 10*Mode + Int)
+    // Van a la pila en este orden (PC queda mas arriba, RX en el tope),
+    // pero los escribimos como un solo bloque: una sola toma del bus.
+    //   SP-1: PC
+    //   SP-2: Flags (Empaquetados: 100*CC + 10*Mode + Int)
+    //   SP-3: AC
+    //   SP-4: RX
     int flags_packed = (old_cc * 100) + (old_mode * 10) + old_int;
-    cpu_registers.SP--;
-    mem_write(cpu_registers.SP, int_to_word(flags_packed));
-    
-    // 3. Push AC
-    cpu_registers.SP--;
-    mem_write(cpu_registers.SP, cpu_registers.AC);
-    
-    // 4. Push RX
-    cpu_registers.SP--;
-    mem_write(cpu_registers.SP, int_to_word(cpu_registers.RX));
+    Word context[4];
+    context[0] = int_to_word(cpu_registers.RX);
+    context[1] = cpu_registers.AC;
+    context[2] = int_to_word(flags_packed);
+    context[3] = int_to_word(cpu_registers.PSW.pc);
+    cpu_registers.SP -= 4;
+    mem_write_block(cpu_registers.SP, context, 4);
+    cpu_mem_note(cpu_registers.SP, 4, 1);
     
     // Buscamos la direccion del manejador en la Tabla de Vectores (Memoria[code])
-    Word handler_word = mem_read(code);
-    int handler_addr = word_to_int(handler_word);
+    int handler_addr = interrupt_vector(code);
+    cpu_mem_note(code, 1, 0); // Para la cache cuenta como leerlo de memoria
     
     log_event("Saltando a Manejador en %d (Leido de Memoria[%d])", handler_addr, code);
     cpu_registers.PSW.pc = handler_addr; 
 }
 
+/* =========================================================================
+ * MEMORIA PAGINADA
+ * ========================================================================= */
+
+// Olvida todas las traducciones (cambio la tabla o su base)
+void tlb_flush() {
+    for (int i = 0; i < TLB_ENTRIES; i++) tlb[i].valid = 0;
+}
+
+// La tabla de paginas esta en [PTBR, PTBR + PTLR): si alguien escribe ahi
+// la memoria nos avisa por mem_watch_hit para que la TLB no quede vieja.
+static void paging_update_watch() {
+    if (paging_enabled) {
+        mem_watch[MEM_WATCH_PAGE_TABLE].lo = cpu_registers.PTBR;
+        mem_watch[MEM_WATCH_PAGE_TABLE].len = cpu_registers.PTLR;
+    } else {
+        mem_watch[MEM_WATCH_PAGE_TABLE].lo = 0;
+        mem_watch[MEM_WATCH_PAGE_TABLE].len = 0;
+    }
+}
+
+// Modo confiable (ver "MODO CONFIABLE" mas abajo): solo vale con el modo y
+// los RB/RL con los que se verifico, asi que se recalcula junto con xlat
+static struct {
+    int valid;          // Hay codigo verificado y nadie lo ha escrito
+    int lo, len;
+    int rb, rl;
+    struct TrustedInst *code;
+    long executed;      // Instrucciones que corrieron sin chequeos
+    long drops;         // Veces que una escritura lo tumbo
+    int drop_addr;
+} trust;
+static volatile int trust_active = 0;
+
+void mem_watch_hit(int which, int address) {
+    if (which == MEM_WATCH_VECTORS) {
+        vector_cache_valid = 0;
+    } else if (which == MEM_WATCH_CODE) {
+        // Escribieron en codigo verificado: de aqui en adelante todo revisado
+        trust_active = 0;
+        if (!trust.valid) return;
+        trust.valid = 0;
+        trust.drops++;
+        trust.drop_addr = address;
+        mem_watch[MEM_WATCH_CODE].len = 0;
+        log_event("Modo confiable: escritura en el codigo verificado (%d), sigue en modo revisado", address);
+    } else {
+        tlb_flush();
+    }
+}
+
+void paging_set(int enabled) {
+    paging_enabled = enabled ? 1 : 0;
+    cpu_refresh_translation();
+    tlb_flush();
+    paging_update_watch();
+    log_event("Modo paginado: %s", paging_enabled ? "ON" : "OFF");
+}
+
+void paging_print_stats() {
+    long total = tlb_hits + tlb_misses;
+    printf(" Paginado: %s  PTBR=%d PTLR=%d (paginas de %d)\n", paging_enabled ? "ON" : "OFF",
+           cpu_registers.PTBR, cpu_registers.PTLR, VM_PAGE_SIZE);
+    printf(" TLB: %ld aciertos, %ld fallos (%.1f%% acierto), %ld fallos de pagina\n",
+           tlb_hits, tlb_misses, total ? 100.0 * tlb_hits / total : 0.0, page_faults);
+}
+
+// Fallo de pagina: dejamos la direccion virtual en MAR y avisamos al SO
+static int page_fault(int vaddr) {
+    if (!lockstep_in_reference) page_faults++;
+    cpu_registers.MAR = int_to_word(vaddr);
+    log_interrupt(INT_PAGE_FAULT, "Fallo de Pagina (pagina no presente)");
+    generate_interrupt(INT_PAGE_FAULT);
+    return -2;
+}
+
+/*
+ * Traduce una direccion virtual de usuario a fisica usando la TLB y, si no
+ * esta ahi, la tabla de paginas en memoria. Retorna -2 si hubo fallo.
+ * La referencia del lockstep no usa la TLB: siempre va a la tabla.
+ */
+static int paging_translate(int vaddr) {
+    if (vaddr < 0) return page_fault(vaddr);
+    int vpn = vaddr / VM_PAGE_SIZE;
+    int offset = vaddr % VM_PAGE_SIZE;
+
+    TlbEntry *e = &tlb[vpn % TLB_ENTRIES];
+    if (!lockstep_in_reference) {
+        if (e->valid && e->vpn == vpn) {
+            tlb_hits++;
+            return e->frame * VM_PAGE_SIZE + offset;
+        }
+        tlb_misses++;
+    }
+
+    // Fallo de TLB: vamos a la tabla de paginas
+    if (vpn >= cpu_registers.PTLR) return page_fault(vaddr);
+    int pte = word_to_int(cpu_mem_read(cpu_registers.PTBR + vpn));
+    if (pte < PTE_VALID) return page_fault(vaddr);
+
+    int frame = pte % PTE_VALID;
+    if ((frame + 1) * VM_PAGE_SIZE > MEM_SIZE) return page_fault(vaddr);
+
+    if (lockstep_in_reference) return frame * VM_PAGE_SIZE + offset;
+    e->valid = 1;
+    e->vpn = vpn;
+    e->frame = frame;
+    return frame * VM_PAGE_SIZE + offset;
+}
+
+/* =========================================================================
+ * TRADUCCION DE DIRECCIONES (Relocalizacion + Proteccion en un solo paso)
+ * En vez de preguntar por el modo y por RB/RL en cada acceso, guardamos los
+ * limites ya calculados para el modo actual:
+ *   Kernel : base = 0,  rango = [0, MEM_SIZE-1]
+ *   Usuario: base = RB, rango = [RB, RL]
+ * y solo los recalculamos cuando cambian (STRRB, STRRL, CHMOD, interrupcion,
+ * RETRN, loader...). El caso normal es una suma y una comparacion sin signo.
+ * Todo lo que se sale del rango va al camino lento, que hace exactamente lo
+ * de antes (incluida la INT_ADDR_INVALID).
+ * ========================================================================= */
+
+// Nunca coincide con una direccion real: manda todo al camino lento
+#define XLAT_NEVER ((unsigned)INT_MIN)
+
+typedef struct {
+    int base;         // Lo que se le suma a la direccion del programa
+    unsigned lo;      // Primera direccion fisica permitida
+    unsigned span;    // Cuantas mas se permiten despues de lo
+} XlatBounds;
+
+static __thread XlatBounds xlat = {0, 0, MEM_SIZE_DEFAULT - 1};
+
+void cpu_refresh_translation() {
+    if (lockstep_in_reference) {
+        // La referencia del lockstep va siempre por translate_slow()
+        xlat.base = 0;
+        xlat.lo = XLAT_NEVER;
+        xlat.span = 0;
+    } else if (cpu_registers.PSW.operation_mode != MODE_USER) {
+        xlat.base = 0;
+        xlat.lo = 0;
+        xlat.span = (unsigned)(MEM_SIZE - 1);
+    } else if (paging_enabled || cpu_registers.RL < cpu_registers.RB) {
+        // Paginado (o RB/RL imposibles): siempre por el camino lento
+        xlat.base = 0;
+        xlat.lo = XLAT_NEVER;
+        xlat.span = 0;
+    } else {
+        xlat.base = cpu_registers.RB;
+        xlat.lo = (unsigned)cpu_registers.RB;
+        xlat.span = (unsigned)(cpu_registers.RL - cpu_registers.RB);
+    }
+    trust_active = trust.valid && cpu_registers.PSW.operation_mode == MODE_USER && !paging_enabled &&
+                   cpu_registers.RB == trust.rb && cpu_registers.RL == trust.rl;
+}
+
+// Camino lento: la logica original, paso por paso
+static int translate_slow(int addr) {
+    // Si soy Kernel no hay relocalizacion ni proteccion
+    if (cpu_registers.PSW.operation_mode != MODE_USER) return addr;
+
+    // Paginado: la tabla de paginas hace de relocalizacion y proteccion
+    if (paging_enabled) return paging_translate(addr);
+
+    // Sumamos el Registro Base
+    addr += cpu_registers.RB;
+
+    // Usamos la funcion centralizada de proteccion
+    if (!check_memory_protection(addr)) {
+        // El log ya se hizo adentro de check_memory_protection
+        return -2; // Codigo de error especial
+    }
+    return addr;
+}
+
+static inline int translate_address(int addr) {
+    unsigned phys = (unsigned)addr + (unsigned)xlat.base;
+    if (phys - xlat.lo <= xlat.span) return (int)phys;
+    return translate_slow(addr);
+}
+
+// Para los que no son la CPU pero trabajan con direcciones del programa (svc.c)
+int cpu_translate(int address) {
+    return translate_address(address);
+}
+
 /* 
  * Esta funcion calcula cual es la direccion real que queremos usar
  * Revisa si es Directo o Indexado.
@@ -174,19 +535,8 @@ int get_effective_address() {
         return -1;
     }
     
-    // Ahora revisamos proteccion y relocalizacion si somos Usuario
-    if (cpu_registers.PSW.operation_mode == MODE_USER) {
-        // Sumamos el Registro Base
-        addr += cpu_registers.RB;
-        
-        // Usamos la funcion centralizada de proteccion
-        if (!check_memory_protection(addr)) {
-            // El log ya se hizo adentro de check_memory_protection
-            return -2; // Codigo de error especial
-        }
-    }
-    
-    return addr;
+    // Relocalizacion y proteccion segun el modo actual
+    return translate_address(addr);
 }
 
 /* =========================================================================
@@ -203,7 +553,7 @@ void exec_arithmetic(int opcode) {
     } else {
         int addr = get_effective_address();
         if (addr < 0) return; // Si fallo la direccion, abortamos
-        operand_val = word_to_int(mem_read(addr)); // Vamos a buscarlo a memoria
+        operand_val = word_to_int(cpu_mem_read(addr)); // Vamos a buscarlo a memoria
     }
     
     int ac_val = word_to_int(cpu_registers.AC);
@@ -247,8 +597,8 @@ void exec_arithmetic(int opcode) {
 // Mueve cosas entre Memoria y CPU
 void exec_transfer_mem(int opcode) {
     int addr = get_effective_address();
-    // LOAD con inmediato es especial, no necesita direccion
-    if (addr < 0 && !(opcode == OP_LOAD && cpu_registers.IR.direccionamiento == ADDR_IMMEDIATE)) return; 
+    // Con inmediato no hay direccion: LOAD usa el valor y STR solo avisa
+    if (addr < 0 && cpu_registers.IR.direccionamiento != ADDR_IMMEDIATE) return;
     
     if (opcode == OP_LOAD) {
         if (cpu_registers.IR.direccionamiento == ADDR_IMMEDIATE) {
@@ -257,7 +607,7 @@ void exec_transfer_mem(int opcode) {
         } else {
             // LOAD Memoria: AC = Memoria[addr]
             if (addr < 0) return;
-            cpu_registers.AC = mem_read(addr);
+            cpu_registers.AC = cpu_mem_read(addr);
         }
     } else if (opcode == OP_STR) {
         // STR (Store): Guardar AC en Memoria
@@ -266,7 +616,7 @@ void exec_transfer_mem(int opcode) {
             return;
         }
         if (addr < 0) return;
-        mem_write(addr, cpu_registers.AC);
+        cpu_mem_write(addr, cpu_registers.AC);
     }
 }
 
@@ -280,7 +630,7 @@ void exec_jump(int opcode) {
     
     // Para los saltos condicionales, comparamos AC con lo que hay en el tope de la Pila
     if (opcode != OP_J) {
-        Word sp_val = mem_read(cpu_registers.SP);
+        Word sp_val = cpu_mem_read(cpu_registers.SP);
         sp_val_int = word_to_int(sp_val);
     }
     
@@ -296,7 +646,9 @@ void exec_jump(int opcode) {
     
     if (jump) {
         // Cambiamos el PC para saltar a esa instruccion
+        int self = opcode == OP_J && addr == cpu_registers.PSW.pc - 1;
         cpu_registers.PSW.pc = addr;
+        if (self) cpu_idle();
     }
 }
 
@@ -308,7 +660,7 @@ void exec_comp() {
     } else {
         int addr = get_effective_address();
         if (addr < 0) return;
-        val = word_to_int(mem_read(addr));
+        val = word_to_int(cpu_mem_read(addr));
     }
     
     int ac_val = word_to_int(cpu_registers.AC);
@@ -328,7 +680,7 @@ void exec_stack(int opcode) {
         // CHECK OVERFLOW DE PILA (Si se cruza con Kernel o OS?)
         // Por ahora solo verificamos que no sea negativo (aunque SP es int)
         // Pero mas importante es el UNDERFLOW en POP
-        mem_write(cpu_registers.SP, cpu_registers.AC); // Guardamos AC
+        cpu_mem_write(cpu_registers.SP, cpu_registers.AC); // Guardamos AC
     } else if (opcode == OP_POP) {
         // Pop: Sacar de la pila
         // CHECK UNDERFLOW
@@ -339,77 +691,41 @@ void exec_stack(int opcode) {
             return;
         }
         
-        cpu_registers.AC = mem_read(cpu_registers.SP); // Recuperamos a AC
+        cpu_registers.AC = cpu_mem_read(cpu_registers.SP); // Recuperamos a AC
         cpu_registers.SP++; // "Borramos" subiendo el puntero
     }
 }
 
-/* =========================================================================
- * CICLO PRINCIPAL DE LA CPU
- * Instruccion por instruccion
- * ========================================================================= */
-
-// Flag de ejecucion
-int cpu_running = 0;
-
-/* =========================================================================
- * CICLO PRINCIPAL DE LA CPU
- * Instruccion por instruccion
- * ========================================================================= */
-
-void cpu_cycle() {
-    // 0. Si la CPU esta apagada, no hacemos nada
-    if (!cpu_running) return;
-
-    // 0.1 Chequear INT Harware (como la del DMA)
-    // Si hay una pendiente y estan habilitadas, la atendemos
-    if (interrupt_pending_dma && cpu_registers.PSW.interrupt_enable) {
-        interrupt_pending_dma = 0; // Ya la vimos
-        generate_interrupt(INT_IO_DONE);
-        return; // Prioridad a la interrupcion
-    }
-
-    // 1. FETCH (Busqueda)
-    // Buscamos la siguiente instruccion en memoria donde apunte PC
-    int pc = cpu_registers.PSW.pc;
-    
-    // Seguridad para no leer mas alla del fin del mundo
-    if (pc >= MEM_SIZE) {
-        log_event("ERROR FATAL: El PC se salio de la memoria (%d)!", pc);
-        cpu_running = 0; // Detener CPU
+// FAA: suma atomica, para que varias CPUs se pongan de acuerdo (contadores,
+// candados). AC = lo que habia y M[dir] += AC (ver mem_fetch_add), sin
+// INT_OVERFLOW.
+static void exec_faa() {
+    if (cpu_registers.IR.direccionamiento == ADDR_IMMEDIATE) {
+        log_interrupt(INT_INST_INVALID, "FAA necesita una direccion");
+        generate_interrupt(INT_INST_INVALID);
         return;
     }
+    int addr = get_effective_address();
+    if (addr < 0) return;
+    cpu_mem_note(addr, 1, 1);
+    cpu_registers.AC = mem_fetch_add(addr, word_to_int(cpu_registers.AC));
+}
 
-    Word instruction_word = mem_read(pc);
-    
-    // CHEQUEO DE CENTINELA (END_PROGRAM)
-    // Si encontramos el valor magico, detenemos todo.
-    if (instruction_word.digits == SENTINEL_VAL) {
-        log_event("--- FIN DE PROGRAMA DETECTADO (Sentinel) ---");
-        cpu_running = 0; // Apagar motor
-        return; 
-    }
-    
-    // Anotamos en la bitacora que hicimos
-    log_instruction(pc, "FETCH (Buscando)", instruction_word.digits);
-
-    // Avanzamos el PC para la proxima
-    cpu_registers.PSW.pc++;
+// Llamada al sistema. Si no hay SO (el vector sigue en el manejador por
+// defecto) los servicios conocidos los hace el host directo (svc.c)
+static void exec_svc() {
+    if (interrupt_vector(INT_SVC) == DEFAULT_HANDLER && svc_call(word_to_int(cpu_registers.AC))) return;
+    generate_interrupt(INT_SVC);
+}
 
-    // 2. DECODE (Decodificacion)
-    // Desarmamos el numero para entender que instruccion es
-    int raw = instruction_word.digits;
-    
-    // Los ultimos 5 son el valor
-    cpu_registers.IR.valor = raw % 100000;
-    // El del medio es el modo de direccionamiento
-    cpu_registers.IR.direccionamiento = (raw / 100000) % 10;
-    // Los primeros 2 son el Codigo de Operacion (Opcode)
-    cpu_registers.IR.cod_op = (raw / 1000000);
-    
-    int op = cpu_registers.IR.cod_op;
+/* =========================================================================
+ * EJECUCION GENERICA (Implementacion de referencia)
+ * Un switch por opcode; cada exec_* vuelve a mirar el direccionamiento y el
+ * modo. Es la version "facil de leer" y la que usamos para comprobar que
+ * los manejadores especializados hacen exactamente lo mismo (selftest).
+ * ========================================================================= */
 
-    // 3. EXECUTE (Ejecucion)
+void cpu_execute_generic(int op) {
     // Dependiendo del Opcode, llamamos a la funcion que toca
     switch(op) {
         // Aritmética
@@ -440,32 +756,35 @@ void cpu_cycle() {
         // Sistema
         case OP_SVC:
             // Llamada al sistema (System Call)
-            generate_interrupt(INT_SVC);
+            exec_svc();
             break;
         case OP_RETRN:
              // Volver de una subrutina o interrupcion
              // Recuperamos CONTEXTO COMPLETO (orden inverso al push)
-             // 1. Pop RX
+             // Es un solo bloque de 4 palabras desde el tope: una toma del bus
              {
-                 cpu_registers.RX = word_to_int(mem_read(cpu_registers.SP));
-                 cpu_registers.SP++;
+                 Word context[4];
+                 mem_read_block(cpu_registers.SP, context, 4);
+                 cpu_mem_note(cpu_registers.SP, 4, 0);
+                 cpu_registers.SP += 4;
+
+                 // 1. Pop RX
+                 cpu_registers.RX = word_to_int(context[0]);
                  
                  // 2. Pop AC
-                 cpu_registers.AC = mem_read(cpu_registers.SP);
-                 cpu_registers.SP++;
+                 cpu_registers.AC = context[1];
                  
                  // 3. Pop Flags (PSW)
-                 int flags = word_to_int(mem_read(cpu_registers.SP));
-                 cpu_registers.SP++;
+                 int flags = word_to_int(context[2]);
                  
                  // Desempaquetar
                  cpu_registers.PSW.interrupt_enable = flags % 10;
                  cpu_registers.PSW.operation_mode = (flags / 10) % 10;
                  cpu_registers.PSW.condition_code = (flags / 100) % 10;
+                 cpu_refresh_translation();
                  
                  // 4. Pop PC
-                 cpu_registers.PSW.pc = word_to_int(mem_read(cpu_registers.SP));
-                 cpu_registers.SP++; 
+                 cpu_registers.PSW.pc = word_to_int(context[3]);
              }
              break;
         case OP_HAB:  cpu_registers.PSW.interrupt_enable = INT_ENABLED; break;
@@ -477,14 +796,15 @@ void cpu_cycle() {
              // Cambiar entre modo Usuario y Kernel
              if (cpu_registers.PSW.operation_mode == MODE_KERNEL) {
                  cpu_registers.PSW.operation_mode = (cpu_registers.PSW.operation_mode == MODE_KERNEL) ? MODE_USER : MODE_KERNEL;
+                 cpu_refresh_translation();
              }
              break;
              
         // Registros Base/Limite
         case OP_LOADRB: cpu_registers.AC = int_to_word(cpu_registers.RB); break;
-        case OP_STRRB:  cpu_registers.RB = word_to_int(cpu_registers.AC); break;
+        case OP_STRRB:  cpu_registers.RB = word_to_int(cpu_registers.AC); cpu_refresh_translation(); break;
         case OP_LOADRL: cpu_registers.AC = int_to_word(cpu_registers.RL); break;
-        case OP_STRRL:  cpu_registers.RL = word_to_int(cpu_registers.AC); break;
+        case OP_STRRL:  cpu_registers.RL = word_to_int(cpu_registers.AC); cpu_refresh_translation(); break;
         case OP_LOADSP: cpu_registers.AC = int_to_word(cpu_registers.SP); break;
         case OP_STRSP:  cpu_registers.SP = word_to_int(cpu_registers.AC); break;
         
@@ -494,12 +814,51 @@ void cpu_cycle() {
             break;
             
         // DMA (Discos)
-        case OP_SDMAP: dma.selected_track = cpu_registers.IR.valor; break;
-        case OP_SDMAC: dma.selected_cylinder = cpu_registers.IR.valor; break;
-        case OP_SDMAS: dma.selected_sector = cpu_registers.IR.valor; break;
-        case OP_SDMAIO:dma.io_direction = cpu_registers.IR.valor; break;
-        case OP_SDMAM: dma.memory_address = cpu_registers.IR.valor; break;
+        // Todas programan el canal que eligio SDMAD (0 al arrancar)
+        case OP_SDMAP: dma_channels[dma_selected].selected_track = cpu_registers.IR.valor; break;
+        case OP_SDMAC: dma_channels[dma_selected].selected_cylinder = cpu_registers.IR.valor; break;
+        case OP_SDMAS: dma_channels[dma_selected].selected_sector = cpu_registers.IR.valor; break;
+        case OP_SDMAIO:dma_channels[dma_selected].io_direction = cpu_registers.IR.valor; break;
+        case OP_SDMAM: dma_channels[dma_selected].memory_address = cpu_registers.IR.valor; break;
         case OP_SDMAON: dma_start_transfer(); break; // Arranca el hilo
+        case OP_SDMAD:
+            if (cpu_registers.IR.valor >= DMA_CHANNELS) {
+                log_interrupt(INT_INST_INVALID, "Canal DMA que no existe");
+                generate_interrupt(INT_INST_INVALID);
+            } else {
+                dma_selected = cpu_registers.IR.valor;
+            }
+            break;
+        case OP_SDMAR:
+            if (dma_ring_setup(cpu_registers.IR.valor) < 0) {
+                log_interrupt(INT_INST_INVALID, "Anillo DMA invalido (o con transferencias en camino)");
+                generate_interrupt(INT_INST_INVALID);
+            }
+            break;
+
+        // Varias CPUs
+        case OP_FAA:    exec_faa(); break;
+        case OP_LOADID: cpu_registers.AC = int_to_word(cpu_id); break;
+        case OP_IPI:
+            if (smp_send_ipi(cpu_registers.IR.valor) < 0) {
+                log_interrupt(INT_INST_INVALID, "IPI a una CPU que no existe (o a si misma)");
+                generate_interrupt(INT_INST_INVALID);
+            }
+            break;
+
+        // Tabla de Paginas (al cambiarla, la TLB ya no sirve)
+        case OP_LOADPT: cpu_registers.AC = int_to_word(cpu_registers.PTBR); break;
+        case OP_STRPT:
+            cpu_registers.PTBR = word_to_int(cpu_registers.AC);
+            tlb_flush();
+            paging_update_watch();
+            break;
+        case OP_LOADPL: cpu_registers.AC = int_to_word(cpu_registers.PTLR); break;
+        case OP_STRPL:
+            cpu_registers.PTLR = word_to_int(cpu_registers.AC);
+            tlb_flush();
+            paging_update_watch();
+            break;
             
         default:
             log_interrupt(INT_INST_INVALID, "Opcode que no entiendo (Invalido)");
@@ -507,3 +866,963 @@ void cpu_cycle() {
             break;
     }
 }
+
+/* =========================================================================
+ * MANEJADORES ESPECIALIZADOS
+ * Para cada instruccion con operando generamos (con macros, en tiempo de
+ * compilacion) una version por direccionamiento (Directo/Inmediato/Indexado)
+ * y por privilegio (Usuario/Kernel). La decodificacion elige la version una
+ * sola vez, asi que adentro no queda ningun "if" de modo:
+ *   - En Kernel la direccion se usa tal cual (sin RB ni proteccion).
+ *   - En Usuario pasa por translate_address() (RB/RL o paginado).
+ * Todo lo demas (y los direccionamientos 3-9, que no existen) cae en
+ * cpu_execute_generic(). El comando "selftest" compara ambas versiones.
+ * ========================================================================= */
+
+typedef void (*CpuHandler)(void);
+
+#define PRIV_USER   0
+#define PRIV_KERNEL 1
+
+static CpuHandler cpu_handlers[2][ISA_MAX_OPCODE][10];
+
+// Direccion segun el privilegio
+// (TRUSTED: usuario con la direccion ya verificada dentro de RB/RL)
+#define XLAT_USER(a)    translate_address(a)
+#define XLAT_KERNEL(a)  (a)
+#define XLAT_TRUSTED(a) ((a) + xlat.base)
+
+// Direccion del operando segun el direccionamiento
+#define EA_DIRECT(P)    XLAT_##P(cpu_registers.IR.valor)
+#define EA_INDEXED(P)   XLAT_##P(word_to_int(cpu_registers.AC) + cpu_registers.IR.valor)
+
+// Lo que hacen las aritmeticas con el dato ya conseguido (misma logica
+// que exec_arithmetic, pero con el opcode fijo para que el switch se borre)
+static inline void arith_apply(int opcode, int operand_val) {
+    int ac_val = word_to_int(cpu_registers.AC);
+    long long res = 0;
+
+    switch(opcode) {
+        case OP_SUM:  res = (long long)ac_val + operand_val; break;
+        case OP_RES:  res = (long long)ac_val - operand_val; break;
+        case OP_MULT: res = (long long)ac_val * operand_val; break;
+        case OP_DIVI:
+            if (operand_val == 0) {
+                log_interrupt(INT_INST_INVALID, "Error Matemático: Division por Cero");
+                generate_interrupt(INT_INST_INVALID);
+                return;
+            }
+            res = ac_val / operand_val;
+            break;
+    }
+
+    if (res > 9999999 || res < -9999999) {
+        cpu_registers.PSW.condition_code = CC_OVERFLOW;
+        log_interrupt(INT_OVERFLOW, "Desbordamiento (Numero muy grande)");
+        generate_interrupt(INT_OVERFLOW);
+        res = res % 10000000;
+    }
+
+    cpu_registers.AC = int_to_word((int)res);
+    update_cc();
+}
+
+// Lo mismo para COMP (solo toca el CC)
+static inline void comp_apply(int val) {
+    int ac_val = word_to_int(cpu_registers.AC);
+    if (ac_val == val) cpu_registers.PSW.condition_code = CC_ZERO;
+    else if (ac_val < val) cpu_registers.PSW.condition_code = CC_NEGATIVE;
+    else cpu_registers.PSW.condition_code = CC_POSITIVE;
+}
+
+#define APPLY_SUM(v)   arith_apply(OP_SUM, v)
+#define APPLY_RES(v)   arith_apply(OP_RES, v)
+#define APPLY_MULT(v)  arith_apply(OP_MULT, v)
+#define APPLY_DIVI(v)  arith_apply(OP_DIVI, v)
+#define APPLY_COMP(v)  comp_apply(v)
+
+// Instrucciones con DATO: el inmediato no depende del privilegio
+#define GEN_DATA_MEM(NAME, MODE, P) \
+    static void h_##NAME##_##MODE##_##P(void) { \
+        int addr = EA_##MODE(P); \
+        if (addr < 0) return; \
+        APPLY_##NAME(word_to_int(cpu_mem_read(addr))); \
+    }
+#define GEN_DATA_OP(NAME) \
+    static void h_##NAME##_IMMEDIATE(void) { APPLY_##NAME(cpu_registers.IR.valor); } \
+    GEN_DATA_MEM(NAME, DIRECT, USER)  GEN_DATA_MEM(NAME, DIRECT, KERNEL) \
+    GEN_DATA_MEM(NAME, INDEXED, USER) GEN_DATA_MEM(NAME, INDEXED, KERNEL)
+
+GEN_DATA_OP(SUM)
+GEN_DATA_OP(RES)
+GEN_DATA_OP(MULT)
+GEN_DATA_OP(DIVI)
+GEN_DATA_OP(COMP)
+GEN_DATA_MEM(SUM, DIRECT, TRUSTED)  GEN_DATA_MEM(RES, DIRECT, TRUSTED)
+GEN_DATA_MEM(MULT, DIRECT, TRUSTED) GEN_DATA_MEM(DIVI, DIRECT, TRUSTED)
+GEN_DATA_MEM(COMP, DIRECT, TRUSTED)
+
+// LOAD copia la palabra tal cual (con su signo), STR la guarda
+#define GEN_LOAD(MODE, P) \
+    static void h_LOAD_##MODE##_##P(void) { \
+        int addr = EA_##MODE(P); \
+        if (addr < 0) return; \
+        cpu_registers.AC = cpu_mem_read(addr); \
+    }
+#define GEN_STR(MODE, P) \
+    static void h_STR_##MODE##_##P(void) { \
+        int addr = EA_##MODE(P); \
+        if (addr < 0) return; \
+        cpu_mem_write(addr, cpu_registers.AC); \
+    }
+
+static void h_LOAD_IMMEDIATE(void) { cpu_registers.AC = int_to_word(cpu_registers.IR.valor); }
+GEN_LOAD(DIRECT, USER)  GEN_LOAD(DIRECT, KERNEL)
+GEN_LOAD(INDEXED, USER) GEN_LOAD(INDEXED, KERNEL)
+GEN_STR(DIRECT, USER)   GEN_STR(DIRECT, KERNEL)
+GEN_STR(INDEXED, USER)  GEN_STR(INDEXED, KERNEL)
+GEN_LOAD(DIRECT, TRUSTED) GEN_STR(DIRECT, TRUSTED)
+
+// Saltos: la condicion compara AC con el tope de la pila
+#define COND_J       1
+#define COND_JMPE    (word_to_int(cpu_mem_read(cpu_registers.SP)) == word_to_int(cpu_registers.AC))
+#define COND_JMPNE   (word_to_int(cpu_mem_read(cpu_registers.SP)) != word_to_int(cpu_registers.AC))
+#define COND_JMPLT   (word_to_int(cpu_registers.AC) < word_to_int(cpu_mem_read(cpu_registers.SP)))
+#define COND_JMPLGT  (word_to_int(cpu_registers.AC) > word_to_int(cpu_mem_read(cpu_registers.SP)))
+
+// J a si misma (solo J: el programa ya no puede salir solo) -> cpu_idle
+#define IDLE_J(addr)       ((addr) == cpu_registers.PSW.pc - 1)
+#define IDLE_JMPE(addr)    0
+#define IDLE_JMPNE(addr)   0
+#define IDLE_JMPLT(addr)   0
+#define IDLE_JMPLGT(addr)  0
+
+#define GEN_JUMP_MODE(NAME, MODE, P) \
+    static void h_##NAME##_##MODE##_##P(void) { \
+        int addr = EA_##MODE(P); \
+        if (addr < 0) return; \
+        if (COND_##NAME) { \
+            int self = IDLE_##NAME(addr); \
+            cpu_registers.PSW.pc = addr; \
+            if (self) cpu_idle(); \
+        } \
+    }
+#define GEN_JUMP(NAME) \
+    GEN_JUMP_MODE(NAME, DIRECT, USER)  GEN_JUMP_MODE(NAME, DIRECT, KERNEL) \
+    GEN_JUMP_MODE(NAME, INDEXED, USER) GEN_JUMP_MODE(NAME, INDEXED, KERNEL)
+
+GEN_JUMP(J)
+GEN_JUMP(JMPE)
+GEN_JUMP(JMPNE)
+GEN_JUMP(JMPLT)
+GEN_JUMP(JMPLGT)
+GEN_JUMP_MODE(J, DIRECT, TRUSTED)     GEN_JUMP_MODE(JMPE, DIRECT, TRUSTED)
+GEN_JUMP_MODE(JMPNE, DIRECT, TRUSTED) GEN_JUMP_MODE(JMPLT, DIRECT, TRUSTED)
+GEN_JUMP_MODE(JMPLGT, DIRECT, TRUSTED)
+
+// Los saltos con inmediato no tienen direccion: no hacen nada
+static void h_nop(void) {}
+
+// SVC no usa el direccionamiento: el mismo para todos
+static void h_SVC(void) { exec_svc(); }
+
+// Todo lo que no tiene version especializada
+static void h_generic(void) { cpu_execute_generic(cpu_registers.IR.cod_op); }
+
+#define SET_MEM_VARIANTS(NAME) \
+    cpu_handlers[PRIV_USER][OP_##NAME][ADDR_DIRECT]    = h_##NAME##_DIRECT_USER; \
+    cpu_handlers[PRIV_KERNEL][OP_##NAME][ADDR_DIRECT]  = h_##NAME##_DIRECT_KERNEL; \
+    cpu_handlers[PRIV_USER][OP_##NAME][ADDR_INDEXED]   = h_##NAME##_INDEXED_USER; \
+    cpu_handlers[PRIV_KERNEL][OP_##NAME][ADDR_INDEXED] = h_##NAME##_INDEXED_KERNEL;
+#define SET_IMMEDIATE(NAME, H) \
+    cpu_handlers[PRIV_USER][OP_##NAME][ADDR_IMMEDIATE]   = H; \
+    cpu_handlers[PRIV_KERNEL][OP_##NAME][ADDR_IMMEDIATE] = H;
+
+static void cpu_build_handlers() {
+    for (int p = 0; p < 2; p++)
+        for (int op = 0; op < ISA_MAX_OPCODE; op++)
+            for (int m = 0; m < 10; m++)
+                cpu_handlers[p][op][m] = h_generic;
+
+    SET_MEM_VARIANTS(SUM)  SET_IMMEDIATE(SUM, h_SUM_IMMEDIATE)
+    SET_MEM_VARIANTS(RES)  SET_IMMEDIATE(RES, h_RES_IMMEDIATE)
+    SET_MEM_VARIANTS(MULT) SET_IMMEDIATE(MULT, h_MULT_IMMEDIATE)
+    SET_MEM_VARIANTS(DIVI) SET_IMMEDIATE(DIVI, h_DIVI_IMMEDIATE)
+    SET_MEM_VARIANTS(COMP) SET_IMMEDIATE(COMP, h_COMP_IMMEDIATE)
+    SET_MEM_VARIANTS(LOAD) SET_IMMEDIATE(LOAD, h_LOAD_IMMEDIATE)
+    SET_MEM_VARIANTS(STR)  SET_IMMEDIATE(STR, h_generic) // Solo avisa (raro, no vale la pena)
+    SET_MEM_VARIANTS(J)      SET_IMMEDIATE(J, h_nop)
+    SET_MEM_VARIANTS(JMPE)   SET_IMMEDIATE(JMPE, h_nop)
+    SET_MEM_VARIANTS(JMPNE)  SET_IMMEDIATE(JMPNE, h_nop)
+    SET_MEM_VARIANTS(JMPLT)  SET_IMMEDIATE(JMPLT, h_nop)
+    SET_MEM_VARIANTS(JMPLGT) SET_IMMEDIATE(JMPLGT, h_nop)
+
+    for (int p = 0; p < 2; p++)
+        for (int m = 0; m < 10; m++)
+            cpu_handlers[p][OP_SVC][m] = h_SVC;
+}
+
+/* =========================================================================
+ * MODO CONFIABLE
+ * El verificador (verifier.c) ya reviso al cargar que estas instrucciones
+ * tienen opcode y direccionamiento validos, que sus direcciones directas
+ * caen dentro de RB/RL y que sus saltos directos no se salen del programa.
+ * Entonces, mientras el modo y RB/RL sean los de la verificacion (ver
+ * cpu_refresh_translation) y nadie escriba en ese codigo (MEM_WATCH_CODE),
+ * cpu_cycle se salta la busqueda en memoria (y el bus), el centinela, la
+ * decodificacion y el limite del PC, y las directas no pasan por RB/RL.
+ * Una escritura ahi (el programa o el DMA) lo apaga hasta el siguiente load.
+ * ========================================================================= */
+
+typedef struct TrustedInst {
+    CpuHandler handler;     // NULL = no verificada (va por el camino normal)
+    IR_t ir;
+    int raw;
+} TrustedInst;
+
+void cpu_trust_drop() {
+    trust_active = 0;
+    trust.valid = 0;
+    mem_watch[MEM_WATCH_CODE].len = 0;
+}
+
+// El manejador de la instruccion ya verificada
+static CpuHandler trusted_handler(int op, int mode) {
+    if (mode == ADDR_DIRECT) {
+        switch (op) {
+            case OP_SUM:    return h_SUM_DIRECT_TRUSTED;
+            case OP_RES:    return h_RES_DIRECT_TRUSTED;
+            case OP_MULT:   return h_MULT_DIRECT_TRUSTED;
+            case OP_DIVI:   return h_DIVI_DIRECT_TRUSTED;
+            case OP_COMP:   return h_COMP_DIRECT_TRUSTED;
+            case OP_LOAD:   return h_LOAD_DIRECT_TRUSTED;
+            case OP_STR:    return h_STR_DIRECT_TRUSTED;
+            case OP_J:      return h_J_DIRECT_TRUSTED;
+            case OP_JMPE:   return h_JMPE_DIRECT_TRUSTED;
+            case OP_JMPNE:  return h_JMPNE_DIRECT_TRUSTED;
+            case OP_JMPLT:  return h_JMPLT_DIRECT_TRUSTED;
+            case OP_JMPLGT: return h_JMPLGT_DIRECT_TRUSTED;
+        }
+    }
+    return cpu_handlers[PRIV_USER][op][mode];
+}
+
+int cpu_trust_code(int lo, int len, const unsigned char *ok) {
+    cpu_trust_drop();
+    TrustedInst *code = realloc(trust.code, sizeof(TrustedInst) * (len > 0 ? len : 1));
+    if (!code) return 0;
+    trust.code = code;
+
+    Word *words = malloc(sizeof(Word) * (len > 0 ? len : 1));
+    if (!words) return 0;
+    mem_read_block(lo, words, len);
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+        int raw = words[i].digits;
+        code[i].raw = raw;
+        code[i].ir.valor = raw % 100000;
+        code[i].ir.direccionamiento = (raw / 100000) % 10;
+        code[i].ir.cod_op = raw / 1000000;
+        code[i].handler = ok[i] ? trusted_handler(code[i].ir.cod_op, code[i].ir.direccionamiento) : NULL;
+        if (ok[i]) n++;
+    }
+    free(words);
+
+    trust.lo = lo;
+    trust.len = len;
+    trust.rb = cpu_registers.RB;
+    trust.rl = cpu_registers.RL;
+    trust.executed = 0;
+    trust.drops = 0;
+    trust.drop_addr = -1;
+    trust.valid = n > 0;
+    if (trust.valid) {
+        mem_watch[MEM_WATCH_CODE].lo = lo;
+        mem_watch[MEM_WATCH_CODE].len = len;
+    }
+    cpu_refresh_translation();
+    return n;
+}
+
+void cpu_trust_print_stats(FILE *out) {
+    if (!trust.code) {
+        fprintf(out, " Modo confiable: sin codigo verificado\n");
+        return;
+    }
+    fprintf(out, " Modo confiable: %ld instrucciones sin chequeos, %s\n", trust.executed,
+            trust.valid ? "sigue activo" : "apagado");
+    if (trust.drops) fprintf(out, "  Se apago por una escritura en %d (codigo verificado)\n", trust.drop_addr);
+}
+
+/* =========================================================================
+ * SELFTEST: Especializados vs Generico
+ * Para cada privilegio x opcode x direccionamiento (0-9) y varios valores
+ * de AC / operando / RB-RL / paginado, corre la instruccion con los dos
+ * caminos desde el mismo estado y compara registros y memoria completa.
+ * Retorna cuantos casos no coincidieron (0 = todo bien).
+ * ========================================================================= */
+
+typedef struct {
+    Registers regs;
+    DMA_Controller dma[DMA_CHANNELS];
+    int dma_selected;
+    DMA_Ring ring;
+    int running;
+} CpuState;
+
+static void cpu_state_save(CpuState *st) {
+    st->regs = cpu_registers;
+    memcpy(st->dma, dma_channels, sizeof(st->dma));
+    st->dma_selected = dma_selected;
+    st->ring = dma_ring;
+    st->running = cpu_running;
+}
+
+// Pone el estado sin tocar la TLB (el lockstep guarda y repone la suya)
+static void cpu_state_restore(const CpuState *st) {
+    cpu_registers = st->regs;
+    memcpy(dma_channels, st->dma, sizeof(st->dma));
+    dma_selected = st->dma_selected;
+    dma_ring = st->ring;
+    cpu_running = st->running;
+    cpu_refresh_translation();
+    paging_update_watch();
+}
+
+static void cpu_state_load(const CpuState *st) {
+    cpu_state_restore(st);
+    tlb_flush();
+}
+
+static int cpu_state_equal(const CpuState *a, const CpuState *b) {
+    for (int n = 0; n < DMA_CHANNELS; n++) {
+        if (a->dma[n].selected_track != b->dma[n].selected_track ||
+            a->dma[n].selected_cylinder != b->dma[n].selected_cylinder ||
+            a->dma[n].selected_sector != b->dma[n].selected_sector ||
+            a->dma[n].io_direction != b->dma[n].io_direction ||
+            a->dma[n].memory_address != b->dma[n].memory_address) return 0;
+    }
+    return memcmp(&a->regs, &b->regs, sizeof(Registers)) == 0 &&
+           a->dma_selected == b->dma_selected &&
+           a->ring.base == b->ring.base && a->ring.slots == b->ring.slots &&
+           a->ring.batch == b->ring.batch && a->ring.timeout == b->ring.timeout &&
+           a->running == b->running;
+}
+
+int cpu_selftest() {
+    // AC_FROM_STACK = AC igual al tope de la pila (para los saltos)
+    #define AC_FROM_STACK 12345678
+    static const int ac_values[] = {0, 7, -3, 1500, 9999999, -9999999, AC_FROM_STACK};
+    static const int operands[] = {0, 5, 150, 1699, 1701, 99999};
+    static const int rb_rl[][2] = {{300, 1999}, {500, 600}, {700, 400}};
+    // Todos los opcodes que existen, mas dos que no
+    int ops[ISA_MAX_OPCODE];
+    int n_ops = 0;
+    for (int op = 0; op < ISA_MAX_OPCODE; op++) {
+        if (op == OP_SDMAON) continue; // Lanza un hilo real, no se compara
+        if (isa_mnemonic(op) || op == ISA_MAX_OPCODE - 1 || op == 50) ops[n_ops++] = op;
+    }
+    const int n_ac = sizeof(ac_values) / sizeof(ac_values[0]);
+    const int n_val = sizeof(operands) / sizeof(operands[0]);
+    const int n_cfg = sizeof(rb_rl) / sizeof(rb_rl[0]);
+    const int n_modes = 4; // Directo, Inmediato, Indexado y uno invalido
+
+    int old_paging = paging_enabled;
+    CpuState saved;
+    cpu_state_save(&saved);
+    Word *mem_saved = malloc(sizeof(Word) * MEM_SIZE);
+    Word *mem_test = malloc(sizeof(Word) * MEM_SIZE);
+    Word *mem_generic = malloc(sizeof(Word) * MEM_SIZE);
+    Word *mem_spec = malloc(sizeof(Word) * MEM_SIZE);
+    if (!mem_saved || !mem_test || !mem_generic || !mem_spec) {
+        free(mem_saved); free(mem_test); free(mem_generic); free(mem_spec);
+        printf("selftest: sin memoria\n");
+        return -1;
+    }
+    mem_snapshot(mem_saved);
+
+    // Memoria de prueba: valores variados (con negativos) y una tabla de
+    // paginas en PAGE_TABLE_BASE (con la pagina 1 ausente) para el paginado
+    for (int i = 0; i < MEM_SIZE; i++) {
+        mem_test[i] = int_to_word(((i * 7919) % 20000) - 5000);
+    }
+    int first_frame = (USER_MEM_START + VM_PAGE_SIZE - 1) / VM_PAGE_SIZE;
+    int pages = MEM_SIZE / VM_PAGE_SIZE - first_frame;
+    if (pages < 0 || PAGE_TABLE_BASE + pages > OS_MEM_SIZE) pages = 0;
+    for (int v = 0; v < pages; v++) {
+        mem_test[PAGE_TABLE_BASE + v] = int_to_word(v == 1 ? 0 : PTE_VALID + first_frame + v);
+    }
+
+    logger_mute(1); // Las interrupciones de la prueba no nos interesan
+    // Ni lo que escriba o lea la consola (SVC)
+    console_flush();
+    Console console_saved = console;
+    console.host_out = console.host_in = NULL;
+    long cases = 0;
+    int failures = 0;
+
+    for (int pg = 0; pg < 2; pg++)
+    for (int priv = 0; priv < 2; priv++)
+    for (int o = 0; o < n_ops; o++)
+    for (int m = 0; m < n_modes; m++)
+    for (int c = 0; c < n_cfg; c++)
+    for (int a = 0; a < n_ac; a++)
+    for (int v = 0; v < n_val; v++) {
+        int op = ops[o];
+        CpuState start, res_generic, res_spec;
+        start = saved;
+        start.regs.RB = rb_rl[c][0];
+        start.regs.RL = rb_rl[c][1];
+        start.regs.SP = (v % 2) ? 1500 : MEM_SIZE - 1;
+        start.regs.AC = ac_values[a] == AC_FROM_STACK ? mem_test[start.regs.SP] : int_to_word(ac_values[a]);
+        start.regs.RX = MEM_SIZE - 1;
+        start.regs.PTBR = PAGE_TABLE_BASE;
+        start.regs.PTLR = pages;
+        start.regs.PSW.operation_mode = priv == PRIV_USER ? MODE_USER : MODE_KERNEL;
+        start.regs.PSW.pc = USER_MEM_START + 10;
+        start.regs.IR.cod_op = op;
+        start.regs.IR.direccionamiento = m;
+        start.regs.IR.valor = operands[v];
+        start.running = 1;
+        paging_enabled = pg;
+
+        // 1. Camino generico (referencia)
+        mem_snapshot_restore(mem_test);
+        cpu_state_load(&start);
+        cpu_last_interrupt = -1;
+        log_last_interrupt_reset();
+        cpu_execute_generic(op);
+        cpu_state_save(&res_generic);
+        mem_snapshot(mem_generic);
+        int int_generic = cpu_last_interrupt, logged_generic = log_last_interrupt();
+
+        // 2. Camino especializado
+        mem_snapshot_restore(mem_test);
+        cpu_state_load(&start);
+        cpu_last_interrupt = -1;
+        log_last_interrupt_reset();
+        cpu_handlers[priv][op][m]();
+        cpu_state_save(&res_spec);
+        mem_snapshot(mem_spec);
+
+        cases++;
+        // Tambien la interrupcion que genero y la que solo aviso (log_interrupt)
+        if (!cpu_state_equal(&res_generic, &res_spec) ||
+            memcmp(mem_generic, mem_spec, sizeof(Word) * MEM_SIZE) != 0 ||
+            int_generic != cpu_last_interrupt || logged_generic != log_last_interrupt()) {
+            if (failures < 10) {
+                printf(" DIFERENCIA: op=%d (%s) dir=%d priv=%s pag=%d AC=%d val=%d RB=%d RL=%d\n",
+                       op, isa_mnemonic(op) ? isa_mnemonic(op) : "?", m,
+                       priv == PRIV_USER ? "user" : "kernel", pg, word_to_int(start.regs.AC), operands[v],
+                       rb_rl[c][0], rb_rl[c][1]);
+            }
+            failures++;
+        }
+    }
+    logger_mute(0);
+    console = console_saved;
+
+    // Dejamos la maquina como estaba
+    paging_enabled = old_paging;
+    mem_snapshot_restore(mem_saved);
+    cpu_state_load(&saved);
+    free(mem_saved); free(mem_test); free(mem_generic); free(mem_spec);
+
+    printf("selftest: %ld casos, %d diferencias\n", cases, failures);
+    log_event("Selftest de manejadores: %ld casos, %d diferencias", cases, failures);
+    return failures;
+}
+
+/* =========================================================================
+ * BENCHMARK DE INTERRUPCIONES
+ * Mide cuanto cuesta ir y volver de una interrupcion: generate_interrupt()
+ * (guardar contexto + vector) y RETRN (recuperar contexto), n veces.
+ * Deja registros y memoria como estaban.
+ * ========================================================================= */
+
+void cpu_bench_interrupts(int n) {
+    CpuState saved;
+    cpu_state_save(&saved);
+    Word *mem_saved = malloc(sizeof(Word) * MEM_SIZE);
+    if (!mem_saved) return;
+    mem_snapshot(mem_saved);
+
+    // Pila en el area de usuario, lejos de todo
+    cpu_registers.SP = MEM_SIZE - 1;
+    cpu_registers.PSW.operation_mode = MODE_USER;
+    cpu_registers.PSW.interrupt_enable = INT_ENABLED;
+    cpu_refresh_translation();
+
+    logger_mute(1);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < n; i++) {
+        generate_interrupt(INT_SVC);
+        cpu_execute_generic(OP_RETRN);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    logger_mute(0);
+
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf(" Interrupciones: %d idas y vueltas en %.3f ms (%.1f ns c/u)\n", n, ns / 1e6, n ? ns / n : 0.0);
+    log_event("Benchmark interrupciones: %d en %.3f ms", n, ns / 1e6);
+
+    mem_snapshot_restore(mem_saved);
+    free(mem_saved);
+    cpu_state_load(&saved);
+}
+
+/* =========================================================================
+ * LOCKSTEP: la CPU normal contra la referencia
+ * El selftest prueba cada instruccion suelta desde estados inventados; esto
+ * corre el programa de verdad en dos maquinas a la vez:
+ *   - Candidata: la de siempre con cpu_cycle() (manejadores especializados,
+ *     modo confiable, copia de los vectores, TLB...)
+ *   - Referencia: su propia copia de registros, DMA y memoria, que avanza
+ *     con reference_step() (fetch, decode y cpu_execute_generic, nada mas).
+ *     Traduce siempre por translate_slow() y la tabla de paginas (sin xlat
+ *     ni TLB) y lee los vectores de memoria, sin la copia.
+ * Despues de cada instruccion se comparan los registros, y la memoria cada
+ * 'every' instrucciones (comparar toda la memoria es lo caro). A la primera
+ * diferencia se detiene la CPU y se imprime que no coincide y las ultimas
+ * LOCKSTEP_WINDOW instrucciones.
+ *
+ * Lo que sale de la maquina no se hace dos veces: si la candidata atendio
+ * una interrupcion del DMA o ejecuto SVC, SDMAON o SDMAR (consola, servicios
+ * del host, discos) la referencia no la repite, se vuelve a copiar de la
+ * candidata. Por lo mismo el DMA va sincrono mientras dure.
+ *
+ * Las dos memorias se intercambian con los apuntadores de pagina de
+ * main_memory, asi que la referencia usa el mismo mem_read/mem_write. La
+ * TLB, la copia de los vectores y xlat de la candidata se guardan antes del
+ * paso de la referencia y se reponen despues, asi siguen de una instruccion
+ * a la otra como sin lockstep.
+ * ========================================================================= */
+
+#define LOCKSTEP_WINDOW 16
+
+typedef struct {
+    int pc;
+    int raw;                // -1 = atendio una interrupcion del DMA
+    Word ac;                // Como quedo AC
+} LockstepEntry;
+
+int cpu_lockstep_every = 0;
+static int cpu_took_dma_interrupt = 0;  // Lo prende cpu_cycle()
+
+static struct {
+    Word *pages[MEM_PAGE_COUNT];    // Memoria de la referencia
+    CpuState ref;
+    int old_dma_sync;
+    long steps;
+    long synced;                    // Copiadas de la candidata (E/S)
+    long checked_mem;               // Ultima instruccion con memoria comparada
+    long diverged;                  // Instruccion donde difirio (0 = nunca)
+    LockstepEntry window[LOCKSTEP_WINDOW];
+} lockstep;
+
+// Lo que la candidata tiene cacheado y la referencia podria tocar
+typedef struct {
+    TlbEntry tlb[TLB_ENTRIES];
+    int vectors[INT_MAX_CODE + 1];
+    int vectors_valid;
+    XlatBounds xlat;
+} LockstepCaches;
+
+static void lockstep_caches_save(LockstepCaches *c) {
+    memcpy(c->tlb, tlb, sizeof(tlb));
+    memcpy(c->vectors, vector_cache, sizeof(vector_cache));
+    c->vectors_valid = vector_cache_valid;
+    c->xlat = xlat;
+}
+
+static void lockstep_caches_restore(const LockstepCaches *c) {
+    memcpy(tlb, c->tlb, sizeof(tlb));
+    memcpy(vector_cache, c->vectors, sizeof(vector_cache));
+    vector_cache_valid = c->vectors_valid;
+    xlat = c->xlat;
+}
+
+static int lockstep_page_count() {
+    return (MEM_SIZE + MEM_PAGE_WORDS - 1) >> MEM_PAGE_SHIFT;
+}
+
+static void lockstep_swap_memory() {
+    for (int p = 0, n = lockstep_page_count(); p < n; p++) {
+        Word *t = main_memory[p];
+        main_memory[p] = lockstep.pages[p];
+        lockstep.pages[p] = t;
+    }
+}
+
+// La referencia queda igual a la candidata. -1 si no hay memoria.
+static int lockstep_sync() {
+    for (int p = 0, n = lockstep_page_count(); p < n; p++) {
+        if (!main_memory[p]) {
+            free(lockstep.pages[p]);
+            lockstep.pages[p] = NULL;
+            continue;
+        }
+        if (!lockstep.pages[p]) lockstep.pages[p] = malloc(sizeof(Word) * MEM_PAGE_WORDS);
+        if (!lockstep.pages[p]) return -1;
+        memcpy(lockstep.pages[p], main_memory[p], sizeof(Word) * MEM_PAGE_WORDS);
+    }
+    cpu_state_save(&lockstep.ref);
+    return 0;
+}
+
+// Primera direccion donde no coinciden las dos memorias (-1 = iguales)
+static int lockstep_memory_diff() {
+    static const Word zero = {0, 0};
+    for (int p = 0, n = lockstep_page_count(); p < n; p++) {
+        const Word *a = main_memory[p], *b = lockstep.pages[p];
+        if (a == b) continue; // Las dos sin pedir
+        if (a && b && memcmp(a, b, sizeof(Word) * MEM_PAGE_WORDS) == 0) continue;
+        for (int i = 0; i < MEM_PAGE_WORDS; i++) {
+            Word x = a ? a[i] : zero, y = b ? b[i] : zero;
+            int addr = (p << MEM_PAGE_SHIFT) + i;
+            if ((x.sign != y.sign || x.digits != y.digits) && addr < MEM_SIZE) return addr;
+        }
+    }
+    return -1;
+}
+
+// Una instruccion con la implementacion de referencia (como cpu_cycle, sin
+// interrupciones de hardware: esas siempre se copian de la candidata)
+static void reference_step() {
+    int pc = cpu_registers.PSW.pc;
+    if (pc >= MEM_SIZE) {
+        cpu_running = 0;
+        return;
+    }
+    Word instruction_word = mem_read(pc);
+    if (instruction_word.digits == SENTINEL_VAL) {
+        cpu_running = 0;
+        return;
+    }
+    cpu_registers.PSW.pc++;
+    int raw = instruction_word.digits;
+    cpu_registers.IR.valor = raw % 100000;
+    cpu_registers.IR.direccionamiento = (raw / 100000) % 10;
+    cpu_registers.IR.cod_op = raw / 1000000;
+    cpu_execute_generic(cpu_registers.IR.cod_op);
+}
+
+static void lockstep_print_word_diff(const char *name, Word a, Word b) {
+    if (a.sign != b.sign || a.digits != b.digits) {
+        printf("  %-10s %12d %12d\n", name, word_to_int(a), word_to_int(b));
+    }
+}
+
+static void lockstep_print_int_diff(const char *name, int a, int b) {
+    if (a != b) printf("  %-10s %12d %12d\n", name, a, b);
+}
+
+static void lockstep_report(const CpuState *cand, const CpuState *ref, int addr) {
+    long first = lockstep.checked_mem + 1;
+    if (addr < 0 || first == lockstep.steps) {
+        printf("\n!!! LOCKSTEP: la instruccion %ld no coincide con la referencia !!!\n", lockstep.steps);
+    } else {
+        printf("\n!!! LOCKSTEP: la memoria dejo de coincidir entre las instrucciones %ld y %ld !!!\n",
+               first, lockstep.steps);
+    }
+    printf("  %-10s %12s %12s\n", "", "candidata", "referencia");
+    const Registers *a = &cand->regs, *b = &ref->regs;
+    lockstep_print_word_diff("AC", a->AC, b->AC);
+    lockstep_print_word_diff("MAR", a->MAR, b->MAR);
+    lockstep_print_word_diff("MDR", a->MDR, b->MDR);
+    lockstep_print_int_diff("PC", a->PSW.pc, b->PSW.pc);
+    lockstep_print_int_diff("CC", a->PSW.condition_code, b->PSW.condition_code);
+    lockstep_print_int_diff("Modo", a->PSW.operation_mode, b->PSW.operation_mode);
+    lockstep_print_int_diff("Int", a->PSW.interrupt_enable, b->PSW.interrupt_enable);
+    lockstep_print_int_diff("SP", a->SP, b->SP);
+    lockstep_print_int_diff("RX", a->RX, b->RX);
+    lockstep_print_int_diff("RB", a->RB, b->RB);
+    lockstep_print_int_diff("RL", a->RL, b->RL);
+    lockstep_print_int_diff("PTBR", a->PTBR, b->PTBR);
+    lockstep_print_int_diff("PTLR", a->PTLR, b->PTLR);
+    lockstep_print_int_diff("IR.op", a->IR.cod_op, b->IR.cod_op);
+    lockstep_print_int_diff("IR.dir", a->IR.direccionamiento, b->IR.direccionamiento);
+    lockstep_print_int_diff("IR.valor", a->IR.valor, b->IR.valor);
+    lockstep_print_int_diff("Corriendo", cand->running, ref->running);
+    lockstep_print_int_diff("Canal DMA", cand->dma_selected, ref->dma_selected);
+    if (addr >= 0) {
+        char name[16];
+        Word x = mem_peek(addr);
+        lockstep_swap_memory();
+        Word y = mem_peek(addr);
+        lockstep_swap_memory();
+        snprintf(name, sizeof(name), "Mem[%05d]", addr);
+        lockstep_print_word_diff(name, x, y);
+    }
+
+    printf("  Ultimas instrucciones de la candidata:\n");
+    long from = lockstep.steps >= LOCKSTEP_WINDOW ? lockstep.steps - LOCKSTEP_WINDOW + 1 : 1;
+    for (long k = from; k <= lockstep.steps; k++) {
+        const LockstepEntry *e = &lockstep.window[k % LOCKSTEP_WINDOW];
+        if (e->raw < 0) {
+            printf("   #%-8ld PC %05d  (interrupcion del DMA)      AC=%d\n", k, e->pc, word_to_int(e->ac));
+            continue;
+        }
+        const char *mnem = isa_mnemonic(e->raw / 1000000);
+        printf("   #%-8ld PC %05d  %08d %-6s %d %05d  AC=%d\n", k, e->pc, e->raw, mnem ? mnem : "?",
+               (e->raw / 100000) % 10, e->raw % 100000, word_to_int(e->ac));
+    }
+    log_event("LOCKSTEP: diferencia con la referencia en la instruccion %ld (PC %d)", lockstep.steps,
+              lockstep.window[lockstep.steps % LOCKSTEP_WINDOW].pc);
+}
+
+static void lockstep_diverged(const CpuState *cand, const CpuState *ref, int addr) {
+    lockstep.diverged = lockstep.steps;
+    lockstep_report(cand, ref, addr);
+    cpu_running = 0;
+}
+
+int cpu_lockstep_start() {
+    lockstep.steps = lockstep.synced = lockstep.checked_mem = lockstep.diverged = 0;
+    if (lockstep_sync() < 0) {
+        printf("Error: Sin memoria para la maquina de referencia del lockstep\n");
+        return -1;
+    }
+    lockstep.old_dma_sync = dma_synchronous;
+    dma_synchronous = 1;
+    return 0;
+}
+
+void cpu_lockstep_cycle() {
+    if (!cpu_running) return;
+
+    // Lo que va a hacer la candidata (el DMA es sincrono: nadie mas escribe)
+    int pc = cpu_registers.PSW.pc;
+    int raw = pc >= 0 && pc < MEM_SIZE ? mem_peek(pc).digits : 0;
+    int op = raw / 1000000;
+    cpu_took_dma_interrupt = 0;
+    cpu_cycle();
+    lockstep.steps++;
+    LockstepEntry *e = &lockstep.window[lockstep.steps % LOCKSTEP_WINDOW];
+    e->pc = pc;
+    e->raw = cpu_took_dma_interrupt ? -1 : raw;
+    e->ac = cpu_registers.AC;
+
+    if (cpu_took_dma_interrupt || op == OP_SVC || op == OP_SDMAON || op == OP_SDMAR) {
+        lockstep.synced++;
+        lockstep.checked_mem = lockstep.steps;
+        if (lockstep_sync() < 0) cpu_running = 0;
+        return;
+    }
+
+    // La misma instruccion en la referencia, sin log, cache ni traza
+    CpuState cand;
+    LockstepCaches caches;
+    cpu_state_save(&cand);
+    lockstep_caches_save(&caches);
+    int last_interrupt = cpu_last_interrupt;
+    int cache = cache_enabled;
+    lockstep_swap_memory();
+    cache_enabled = 0;
+    lockstep_in_reference = 1;
+    cpu_state_restore(&lockstep.ref);
+    logger_mute(1);
+    reference_step();
+    logger_mute(0);
+    cpu_state_save(&lockstep.ref);
+    lockstep_in_reference = 0;
+    cache_enabled = cache;
+    lockstep_swap_memory();
+    cpu_state_restore(&cand);
+    lockstep_caches_restore(&caches);
+    cpu_last_interrupt = last_interrupt;
+
+    int addr = -1;
+    if (lockstep.steps - lockstep.checked_mem >= cpu_lockstep_every || !cpu_running) {
+        addr = lockstep_memory_diff();
+        if (addr < 0) lockstep.checked_mem = lockstep.steps;
+    }
+    if (addr >= 0 || !cpu_state_equal(&cand, &lockstep.ref)) lockstep_diverged(&cand, &lockstep.ref, addr);
+}
+
+void cpu_lockstep_stop() {
+    if (!lockstep.diverged && lockstep.checked_mem < lockstep.steps) {
+        int addr = lockstep_memory_diff();
+        if (addr >= 0) {
+            CpuState cand;
+            cpu_state_save(&cand);
+            lockstep_diverged(&cand, &lockstep.ref, addr);
+        }
+    }
+    for (int p = 0; p < MEM_PAGE_COUNT; p++) {
+        free(lockstep.pages[p]);
+        lockstep.pages[p] = NULL;
+    }
+    dma_synchronous = lockstep.old_dma_sync;
+}
+
+int cpu_lockstep_ok() {
+    return lockstep.diverged == 0;
+}
+
+void cpu_lockstep_print_stats(FILE *out) {
+    if (!cpu_lockstep_every) {
+        fprintf(out, " Lockstep: apagado (lockstep <n>)\n");
+        return;
+    }
+    fprintf(out, " Lockstep (memoria cada %d): %ld instrucciones, %ld copiadas de la candidata (E/S), ",
+            cpu_lockstep_every, lockstep.steps, lockstep.synced);
+    if (lockstep.diverged) fprintf(out, "diferencia en la %ld\n", lockstep.diverged);
+    else fprintf(out, "sin diferencias\n");
+}
+
+/* =========================================================================
+ * CICLO PRINCIPAL DE LA CPU
+ * Instruccion por instruccion
+ * ========================================================================= */
+
+// Flag de ejecucion
+__thread int cpu_running = 0;
+__thread int cpu_idle_halt = 0;
+int cpu_idle_detect = 1;
+// La ultima interrupcion que se genero (el fuzzer la usa para su cobertura)
+__thread int cpu_last_interrupt = -1;
+// Ciclos ejecutados (lo lee el servicio SVC_GET_CYCLES)
+__thread long cpu_cycle_count = 0;
+
+/* =========================================================================
+ * CPU OCIOSA
+ * Un "J a si misma" (como el fin de los programas de ejemplo, o esperando
+ * al DMA) no hace nada mas que gastar CPU del host. Solo una interrupcion
+ * puede sacar al programa de ahi, y la unica que llega de fuera es la del
+ * DMA (el timer de TTI no esta implementado). Entonces:
+ *   - Si ya hay una pendiente y estan habilitadas: la atiende el siguiente ciclo
+ *   - Si hay un canal trabajando: dormimos hasta que termine
+ *   - Si no: nunca va a salir, se detiene la CPU (cpu_idle_halt)
+ * ========================================================================= */
+
+// Con varias CPUs la consola es de todas (los servicios la usan con smp_lock)
+static void cpu_console_flush() {
+    if (smp_cpus > 1) smp_lock();
+    console_flush();
+    if (smp_cpus > 1) smp_unlock();
+}
+
+static void cpu_idle() {
+    if (!cpu_idle_detect) return;
+    // Otra CPU nos puede mandar una IPI: se espera mientras alguna siga
+    if (smp_cpus > 1 && cpu_registers.PSW.interrupt_enable && smp_wait_ipi()) return;
+    int pending = __atomic_load_n(&interrupt_pending_dma, __ATOMIC_ACQUIRE);
+    if (pending && cpu_registers.PSW.interrupt_enable) return;
+    if (dma_wait_event(pending)) return; // Paso algo: que el J vuelva a decidir
+
+    log_event("--- CPU DETENIDA: J a si misma en %d sin E/S pendiente ---", cpu_registers.PSW.pc);
+    cpu_idle_halt = 1;
+    cpu_running = 0;
+    cpu_console_flush();
+}
+
+/* =========================================================================
+ * CICLO PRINCIPAL DE LA CPU
+ * Instruccion por instruccion
+ * ========================================================================= */
+
+void cpu_cycle() {
+    // 0. Si la CPU esta apagada, no hacemos nada
+    if (!cpu_running) return;
+    cpu_cycle_count++;
+
+    // 0.1 Chequear INT Harware (como la del DMA)
+    // Si hay una pendiente y estan habilitadas, la atendemos
+    // Con varios canales se atiende uno por vez; el manejador recibe en AC
+    // canal * 10 + status (el AC del programa ya quedo guardado en la pila),
+    // o con anillo cuantos registros hay sin leer
+    int lines = __atomic_load_n(cpu_dma_lines, __ATOMIC_RELAXED);
+    if (lines & DMA_LINE_RING_WAIT) dma_ring_tick(cpu_cycle_count);
+    int ch;
+    if (lines && cpu_registers.PSW.interrupt_enable && (ch = dma_take_completion()) >= 0) {
+        int pc = cpu_registers.PSW.pc;
+        cpu_took_dma_interrupt = 1;
+        generate_interrupt(INT_IO_DONE);
+        cpu_registers.AC = int_to_word(ch == DMA_CHANNELS ? dma_ring_count() : ch * 10 + dma_channels[ch].status);
+        if (pipeline_enabled) pipeline_account(-1, 0, pc, cpu_registers.PSW.pc, 1);
+        return; // Prioridad a la interrupcion
+    }
+    // Una IPI de otra CPU (smp_ipi_sent se prende con la primera que se manda)
+    if (smp_ipi_sent && cpu_registers.PSW.interrupt_enable && (ch = smp_take_ipi()) >= 0) {
+        int pc = cpu_registers.PSW.pc;
+        generate_interrupt(INT_IPI);
+        cpu_registers.AC = int_to_word(ch);
+        if (pipeline_enabled) pipeline_account(-1, 0, pc, cpu_registers.PSW.pc, 1);
+        return;
+    }
+
+    // 1. FETCH (Busqueda)
+    // Buscamos la siguiente instruccion en memoria donde apunte PC
+    int pc = cpu_registers.PSW.pc;
+
+    // Codigo verificado: ya esta decodificado y revisado (ver MODO CONFIABLE)
+    if (trust_active && (unsigned)(pc - trust.lo) < (unsigned)trust.len && trust.code[pc - trust.lo].handler) {
+        const TrustedInst *ti = &trust.code[pc - trust.lo];
+        if (cache_enabled) cache_access(CACHE_INST, pc, 0);
+        log_instruction(pc, "FETCH (Buscando)", ti->raw);
+        cpu_registers.PSW.pc++;
+        cpu_registers.IR = ti->ir;
+        trust.executed++;
+        if (pipeline_enabled) cpu_last_interrupt = -1;
+        ti->handler();
+        if (pipeline_enabled) {
+            pipeline_account(ti->ir.cod_op, ti->ir.direccionamiento, pc, cpu_registers.PSW.pc,
+                             cpu_last_interrupt >= 0);
+        }
+        return;
+    }
+    
+    // Seguridad para no leer mas alla del fin del mundo
+    if (pc >= MEM_SIZE) {
+        log_event("ERROR FATAL: El PC se salio de la memoria (%d)!", pc);
+        cpu_running = 0; // Detener CPU
+        return;
+    }
+
+    if (cache_enabled) cache_access(CACHE_INST, pc, 0);
+    Word instruction_word = mem_read(pc);
+    
+    // CHEQUEO DE CENTINELA (END_PROGRAM)
+    // Si encontramos el valor magico, detenemos todo.
+    if (instruction_word.digits == SENTINEL_VAL) {
+        log_event("--- FIN DE PROGRAMA DETECTADO (Sentinel) ---");
+        cpu_running = 0; // Apagar motor
+        cpu_console_flush(); // Lo que haya escrito el programa sale ya
+        return; 
+    }
+    
+    // Anotamos en la bitacora que hicimos
+    log_instruction(pc, "FETCH (Buscando)", instruction_word.digits);
+
+    // Avanzamos el PC para la proxima
+    cpu_registers.PSW.pc++;
+
+    // 2. DECODE (Decodificacion)
+    // Desarmamos el numero para entender que instruccion es
+    int raw = instruction_word.digits;
+    
+    // Los ultimos 5 son el valor
+    cpu_registers.IR.valor = raw % 100000;
+    // El del medio es el modo de direccionamiento
+    cpu_registers.IR.direccionamiento = (raw / 100000) % 10;
+    // Los primeros 2 son el Codigo de Operacion (Opcode)
+    cpu_registers.IR.cod_op = (raw / 1000000);
+    
+    int op = cpu_registers.IR.cod_op;
+    int mode = cpu_registers.IR.direccionamiento;
+
+    // 3. EXECUTE (Ejecucion)
+    // El manejador ya viene especializado para este opcode, direccionamiento
+    // y privilegio: adentro no se vuelve a preguntar por ninguno de los tres.
+    if (pipeline_enabled) cpu_last_interrupt = -1;
+    if (op < ISA_MAX_OPCODE) {
+        cpu_handlers[cpu_registers.PSW.operation_mode == MODE_USER ? PRIV_USER : PRIV_KERNEL][op][mode]();
+    } else {
+        cpu_execute_generic(op); // Opcode imposible (palabra de mas de 8 digitos)
+    }
+
+    // Modo de tiempos: contarle al pipeline lo que paso
+    if (pipeline_enabled) pipeline_account(op, mode, pc, cpu_registers.PSW.pc, cpu_last_interrupt >= 0);
+}
@@ -1,51 +1,351 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "hardware.h"
 #include "../logger.h"
 
-// Variable Global definida en hardware.h
-HardDisk hdd;
+// Variable Global definida en hardware.h (un disco por canal DMA)
+HardDisk disks[DMA_CHANNELS];
 
 // Nombre del archivo de persistencia
 #define DISK_FILENAME "virtual_disk.bin"
 
 /*
- * Inicialización del Disco
- * Intenta cargar el archivo "virtual_disk.bin". Si no existe, lo crea vacío.
+ * FORMATO DE LA IMAGEN (virtual_disk.bin)
+ * Solo se guardan los sectores que tienen algo, asi un disco de varios MB
+ * vacio ocupa unos bytes:
+ *
+ *   Cabecera: "VDSK" version cilindros pistas sectores tam_sector usados
+ *             (enteros de 32 bits)
+ *   Indice:   'usados' registros de {numero de sector (32 bits), datos},
+ *             ordenados por numero de sector
+ *
+ * El numero de sector es (cilindro * pistas + pista) * sectores + sector.
+ * En RAM se guardan en bloques de DISK_CHUNK_SECTORS (como las paginas de
+ * la memoria), asi encontrar un sector es una division y dos indices.
+ *
+ * Las imagenes viejas (volcado crudo de 90000 bytes) se siguen leyendo.
  */
-void disk_init() {
-    FILE *f = fopen(DISK_FILENAME, "rb");
+
+#define DISK_MAGIC   "VDSK"
+#define DISK_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t cylinders;
+    uint32_t tracks;
+    uint32_t sectors;
+    uint32_t sector_size;
+    uint32_t used;
+} DiskImageHeader;
+
+static void disk_save_one(HardDisk *d);
+
+// Libera todos los bloques (el disco queda sin conectar)
+static void disk_free(HardDisk *d) {
+    for (int i = 0; i < d->chunk_count; i++) free(d->chunks[i]);
+    free(d->chunks);
+    d->chunks = NULL;
+    d->chunk_count = 0;
+    d->total = 0;
+}
+
+static int disk_set_geometry(HardDisk *d, int cylinders, int tracks, int sectors) {
+    long long total = (long long)cylinders * tracks * sectors;
+    if (cylinders <= 0 || tracks <= 0 || sectors <= 0 || total > DISK_MAX_SECTORS) {
+        printf("Error: Geometria de disco invalida (%dx%dx%d, maximo %d sectores)\n",
+               cylinders, tracks, sectors, DISK_MAX_SECTORS);
+        return -1;
+    }
+    disk_free(d);
+    d->cylinders = cylinders;
+    d->tracks = tracks;
+    d->sectors = sectors;
+    d->total = (int)total;
+    d->chunk_count = (d->total + DISK_CHUNK_SECTORS - 1) / DISK_CHUNK_SECTORS;
+    d->chunks = calloc(d->chunk_count, sizeof(Sector *));
+    if (!d->chunks) {
+        printf("Error: Sin memoria para el directorio del disco\n");
+        d->chunk_count = 0;
+        d->total = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Numero de sector, o -1 si esta fuera de la geometria
+int disk_index(HardDisk *d, int cylinder, int track, int sector) {
+    if (cylinder < 0 || cylinder >= d->cylinders || track < 0 || track >= d->tracks ||
+        sector < 0 || sector >= d->sectors) {
+        return -1;
+    }
+    return (cylinder * d->tracks + track) * d->sectors + sector;
+}
+
+// El sector 'index' (creando su bloque si hace falta)
+static Sector *disk_sector_alloc(HardDisk *d, int index) {
+    Sector **chunk = &d->chunks[index >> DISK_CHUNK_SHIFT];
+    if (!*chunk) {
+        *chunk = calloc(DISK_CHUNK_SECTORS, sizeof(Sector));
+        if (!*chunk) {
+            log_event("ERROR FATAL: No hay memoria en el host para el disco");
+            fprintf(stderr, "ERROR FATAL: No hay memoria en el host\n");
+            exit(1);
+        }
+    }
+    return &(*chunk)[index & (DISK_CHUNK_SECTORS - 1)];
+}
+
+static int sector_is_empty(const Sector *s) {
+    for (int i = 0; i < SECTOR_SIZE; i++) {
+        if (s->data[i]) return 0;
+    }
+    return 1;
+}
+
+int disk_read_sector(HardDisk *d, int cylinder, int track, int sector, Sector *out) {
+    int index = disk_index(d, cylinder, track, sector);
+    if (index < 0) return -1;
+    Sector *chunk = d->chunks[index >> DISK_CHUNK_SHIFT];
+    if (chunk) {
+        *out = chunk[index & (DISK_CHUNK_SECTORS - 1)];
+    } else {
+        memset(out, 0, sizeof(Sector)); // Nunca escrito
+    }
+    return 0;
+}
+
+int disk_write_sector(HardDisk *d, int cylinder, int track, int sector, const Sector *in) {
+    int index = disk_index(d, cylinder, track, sector);
+    if (index < 0) return -1;
+    d->writes++;
+    // Escribir ceros donde no hay nada no necesita pedir un bloque
+    if (!d->chunks[index >> DISK_CHUNK_SHIFT] && sector_is_empty(in)) return 0;
+    *disk_sector_alloc(d, index) = *in;
+    return 0;
+}
+
+// Cuantos sectores tienen algo (lo que se guarda en la imagen)
+int disk_sectors_used(HardDisk *d) {
+    int used = 0;
+    for (int c = 0; c < d->chunk_count; c++) {
+        if (!d->chunks[c]) continue;
+        for (int i = 0; i < DISK_CHUNK_SECTORS; i++) {
+            if (!sector_is_empty(&d->chunks[c][i])) used++;
+        }
+    }
+    return used;
+}
+
+// Lee una imagen con cabecera. Retorna 0 si bien, -1 si esta dañada.
+static int disk_load_image(HardDisk *d, FILE *f, const DiskImageHeader *h) {
+    if (h->version != DISK_VERSION || h->sector_size != SECTOR_SIZE) {
+        printf("Error: Imagen de disco version %u / sector de %u bytes no soportada\n",
+               h->version, h->sector_size);
+        return -1;
+    }
+    if (disk_set_geometry(d, h->cylinders, h->tracks, h->sectors) < 0) return -1;
+
+    for (uint32_t i = 0; i < h->used; i++) {
+        uint32_t index;
+        Sector s;
+        if (fread(&index, sizeof(index), 1, f) != 1 || fread(&s, sizeof(s), 1, f) != 1 ||
+            index >= (uint32_t)d->total) {
+            printf("Error: Imagen de disco dañada (registro %u)\n", i);
+            return -1;
+        }
+        *disk_sector_alloc(d, index) = s;
+    }
+    return 0;
+}
+
+// Imagen vieja: volcado crudo de la geometria por defecto
+static int disk_load_legacy(HardDisk *d, FILE *f) {
+    if (disk_set_geometry(d, DISK_CYLINDERS, DISK_TRACKS, DISK_SECTORS) < 0) return -1;
+    rewind(f);
+    Sector s;
+    for (int index = 0; index < d->total && fread(&s, sizeof(s), 1, f) == 1; index++) {
+        if (!sector_is_empty(&s)) *disk_sector_alloc(d, index) = s;
+    }
+    return 0;
+}
+
+/*
+ * Conectar un disco
+ * Si el archivo existe se usa la geometria que trae (la que nos pasen se
+ * ignora); si no, se crea vacio con la geometria pedida (0 = la de siempre).
+ * Con filename NULL el disco es nuevo y solo vive en memoria (no se guarda).
+ */
+int disk_attach(HardDisk *d, const char *filename, int cylinders, int tracks, int sectors) {
+    if (dma_channels[d - disks].is_busy) {
+        printf("Error: El DMA esta usando el disco, espera a que termine\n");
+        return -1;
+    }
+
+    // El disco de antes se guarda, por si el nuevo no sirve y hay que volver
+    char previous[sizeof(d->filename)];
+    snprintf(previous, sizeof(previous), "%s", d->filename);
+    if (d->total) disk_save_one(d);
+    diskcache_drop(d); // Lo del buffer era del disco de antes (ya se guardo)
+
+    FILE *f = filename ? fopen(filename, "rb") : NULL;
     if (f) {
-        // Cargar disco existente
-        fread(&hdd, sizeof(HardDisk), 1, f);
+        DiskImageHeader h;
+        int rc;
+        if (fread(&h, sizeof(h), 1, f) == 1 && memcmp(h.magic, DISK_MAGIC, 4) == 0) {
+            rc = disk_load_image(d, f, &h);
+        } else {
+            fseek(f, 0, SEEK_END);
+            long size = ftell(f);
+            if (size == (long)DISK_CYLINDERS * DISK_TRACKS * DISK_SECTORS * SECTOR_SIZE) {
+                rc = disk_load_legacy(d, f);
+            } else {
+                printf("Error: %s no es una imagen de disco\n", filename);
+                rc = -1;
+            }
+        }
         fclose(f);
-        log_event("Disco cargado desde %s", DISK_FILENAME);
-    } else {
-        // Crear disco nuevo (vacío)
-        memset(&hdd, 0, sizeof(HardDisk));
-        
-        // Guardar para crear el archivo
-        f = fopen(DISK_FILENAME, "wb");
-        if (f) {
-            fwrite(&hdd, sizeof(HardDisk), 1, f);
-            fclose(f);
+        if (rc < 0) {
+            disk_free(d);
+            if (previous[0] && strcmp(previous, filename) != 0) disk_attach(d, previous, 0, 0, 0);
+            return -1;
         }
-        log_event("Disco nuevo inicializado y guardado en %s", DISK_FILENAME);
+        if (cylinders && (cylinders != d->cylinders || tracks != d->tracks || sectors != d->sectors)) {
+            printf("Aviso: %s ya tiene geometria %dx%dx%d, se usa esa\n", filename,
+                   d->cylinders, d->tracks, d->sectors);
+        }
+        snprintf(d->filename, sizeof(d->filename), "%s", filename);
+        log_event("Disco cargado desde %s (%dx%dx%d, %d sectores usados)", filename,
+                  d->cylinders, d->tracks, d->sectors, disk_sectors_used(d));
+        return 0;
+    }
+
+    // Crear disco nuevo (vacío)
+    if (!cylinders) {
+        cylinders = DISK_CYLINDERS;
+        tracks = DISK_TRACKS;
+        sectors = DISK_SECTORS;
+    }
+    if (disk_set_geometry(d, cylinders, tracks, sectors) < 0) return -1;
+    snprintf(d->filename, sizeof(d->filename), "%s", filename ? filename : "");
+
+    // Guardar para crear el archivo
+    disk_save_one(d);
+    log_event("Disco nuevo %dx%dx%d inicializado y guardado en %s", cylinders, tracks, sectors,
+              filename ? filename : "(memoria)");
+    return 0;
+}
+
+/*
+ * Inicialización del Disco
+ * El disco 0 es "virtual_disk.bin" (si no existe, lo crea vacío).
+ * Los demas canales arrancan sin disco hasta que se les conecte uno.
+ */
+void disk_init() {
+    if (disk_attach(&disks[0], DISK_FILENAME, 0, 0, 0) < 0) {
+        // Imagen dañada: seguimos con un disco vacio en memoria (sin pisarla)
+        disk_set_geometry(&disks[0], DISK_CYLINDERS, DISK_TRACKS, DISK_SECTORS);
+        disks[0].filename[0] = 0;
     }
 }
 
 /*
  * Persistir Disco
- * Guarda el estado actual de la estructura HardDisk en el archivo.
- * Esto simula que los datos quedan grabados magnéticamente.
+ * Guarda la cabecera y solo los sectores con datos. Se escribe primero a un
+ * temporal y luego se renombra, para no dejar la imagen a medias.
  */
+static void disk_save_one(HardDisk *d) {
+    diskcache_flush(d); // Lo que siga en el buffer del controlador
+    if (!d->filename[0]) return; // Disco solo en memoria
+
+    char tmp[300];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", d->filename);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        log_event("ERROR: No se pudo guardar el disco en %s", d->filename);
+        return;
+    }
+
+    DiskImageHeader h;
+    memcpy(h.magic, DISK_MAGIC, 4);
+    h.version = DISK_VERSION;
+    h.cylinders = d->cylinders;
+    h.tracks = d->tracks;
+    h.sectors = d->sectors;
+    h.sector_size = SECTOR_SIZE;
+    h.used = disk_sectors_used(d);
+    fwrite(&h, sizeof(h), 1, f);
+
+    for (int c = 0; c < d->chunk_count; c++) {
+        if (!d->chunks[c]) continue;
+        for (int i = 0; i < DISK_CHUNK_SECTORS; i++) {
+            if (sector_is_empty(&d->chunks[c][i])) continue;
+            uint32_t index = (uint32_t)c * DISK_CHUNK_SECTORS + i;
+            fwrite(&index, sizeof(index), 1, f);
+            fwrite(&d->chunks[c][i], sizeof(Sector), 1, f);
+        }
+    }
+
+    if (fclose(f) != 0 || rename(tmp, d->filename) != 0) {
+        log_event("ERROR: No se pudo guardar el disco en %s", d->filename);
+    }
+    // log_event("Estado del disco guardado."); // Demasiado ruido si se llama mucho
+}
+
+// Guarda todos los discos conectados
 void disk_save() {
-    FILE *f = fopen(DISK_FILENAME, "wb");
-    if (f) {
-        fwrite(&hdd, sizeof(HardDisk), 1, f);
-        fclose(f);
-        // log_event("Estado del disco guardado."); // Demasiado ruido si se llama mucho
-    } else {
-        log_event("ERROR: No se pudo guardar el disco en %s", DISK_FILENAME);
+    for (int i = 0; i < DMA_CHANNELS; i++) {
+        if (disks[i].total) disk_save_one(&disks[i]);
+    }
+}
+
+// Desconecta un disco (se guarda antes si tiene archivo)
+void disk_detach(HardDisk *d) {
+    if (d->total) disk_save_one(d);
+    diskcache_drop(d);
+    disk_free(d);
+    d->filename[0] = 0;
+}
+
+/*
+ * Copia en memoria de otro disco (misma geometria y datos, sin archivo).
+ * Lo que tuviera dst se libera, asi que dst no puede compartir bloques con
+ * nadie. Retorna 0, o -1 si el host no tiene memoria.
+ */
+int disk_clone(HardDisk *dst, const HardDisk *src) {
+    disk_free(dst);
+    dst->filename[0] = 0;
+    dst->writes = 0;
+    if (!src->total) return 0;
+    if (disk_set_geometry(dst, src->cylinders, src->tracks, src->sectors) < 0) return -1;
+    for (int c = 0; c < src->chunk_count; c++) {
+        if (!src->chunks[c]) continue;
+        dst->chunks[c] = malloc(DISK_CHUNK_SECTORS * sizeof(Sector));
+        if (!dst->chunks[c]) {
+            disk_free(dst);
+            return -1;
+        }
+        memcpy(dst->chunks[c], src->chunks[c], DISK_CHUNK_SECTORS * sizeof(Sector));
+    }
+    return 0;
+}
+
+void disk_print_info(HardDisk *d) {
+    int used = disk_sectors_used(d);
+    int chunks = 0;
+    for (int c = 0; c < d->chunk_count; c++) {
+        if (d->chunks[c]) chunks++;
+    }
+    if (!d->total) {
+        printf(" Disco %d: (sin disco)\n", (int)(d - disks));
+        return;
     }
+    printf(" Disco %d: %s\n", (int)(d - disks), d->filename[0] ? d->filename : "(solo en memoria)");
+    printf(" Geometria: %d cilindros x %d pistas x %d sectores = %d sectores (%lld bytes)\n",
+           d->cylinders, d->tracks, d->sectors, d->total, (long long)d->total * SECTOR_SIZE);
+    printf(" Usados: %d sectores, %d bloques en el host (%zu bytes), imagen de %zu bytes\n",
+           used, chunks, (size_t)chunks * DISK_CHUNK_SECTORS * sizeof(Sector),
+           sizeof(DiskImageHeader) + (size_t)used * (sizeof(uint32_t) + sizeof(Sector)));
 }
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hardware.h"
+#include "../logger.h"
+
+/*
+ * BUFFER DE SECTORES DEL CONTROLADOR
+ * Sin esto cada SDMAON paga la busqueda completa (dma_seek_us), aunque sea
+ * el mismo sector de hace rato o el siguiente de la pista. Con "diskcache
+ * <n>" (o --diskcache n) cada canal guarda hasta n sectores de su disco:
+ *
+ *   - Lectura que esta en el buffer: DISKCACHE_HIT_DIV veces mas rapida
+ *   - Lectura que no: busqueda completa y de paso se trae el resto de la
+ *     pista (read-ahead), asi leer en orden solo busca una vez por pista
+ *   - Escritura: se queda en el buffer (sucia) y termina rapido; baja al
+ *     disco cuando su lugar se necesita (LRU) o al guardar/cambiar el disco
+ *     (write-back)
+ *
+ * El disco de verdad (disks[n]) queda atrasado mientras haya sucios, por
+ * eso disk.c llama diskcache_flush antes de guardar la imagen.
+ * Cada buffer lo usa solo el hilo de su canal mientras esta ocupado; lo
+ * demas (flush, estadisticas) lo hace la consola con el canal quieto.
+ * Apagado (lo normal) el DMA va directo al disco como siempre.
+ */
+
+typedef struct {
+    int index;              // Numero de sector (ver disk_index), -1 = vacio
+    Sector data;
+    unsigned char dirty;
+    unsigned char ahead;    // Lo trajo el read-ahead y nadie lo ha pedido
+    unsigned long stamp;    // Ultimo uso (para LRU)
+} DiskCacheSlot;
+
+typedef struct {
+    DiskCacheSlot *slots;
+    unsigned long clock;
+
+    long reads, read_hits;
+    long writes, write_hits;
+    long ahead;             // Sectores traidos por read-ahead
+    long ahead_used;        // ... que luego si se pidieron
+    long writebacks;        // Sucios que bajaron al disco
+    long latency_us;        // Busqueda simulada que si se pago
+    long seek_us;           // La que se hubiera pagado sin buffer
+} DiskCache;
+
+int diskcache_sectors = 0;
+static DiskCache caches[DMA_CHANNELS];
+
+static DiskCacheSlot *cache_find(DiskCache *c, int index) {
+    for (int i = 0; i < diskcache_sectors; i++) {
+        if (c->slots[i].index == index) return &c->slots[i];
+    }
+    return NULL;
+}
+
+// Un lugar para 'index': uno vacio o el que lleva mas sin usarse (si esta
+// sucio, primero baja al disco)
+static DiskCacheSlot *cache_victim(DiskCache *c, HardDisk *d) {
+    DiskCacheSlot *victim = &c->slots[0];
+    for (int i = 0; i < diskcache_sectors; i++) {
+        DiskCacheSlot *s = &c->slots[i];
+        if (s->index < 0) return s;
+        if (s->stamp < victim->stamp) victim = s;
+    }
+    if (victim->dirty) {
+        int per_cyl = d->tracks * d->sectors;
+        disk_write_sector(d, victim->index / per_cyl, victim->index / d->sectors % d->tracks,
+                          victim->index % d->sectors, &victim->data);
+        c->writebacks++;
+    }
+    victim->index = -1;
+    victim->dirty = 0;
+    victim->ahead = 0;
+    return victim;
+}
+
+static int hit_us() {
+    return dma_seek_us / DISKCACHE_HIT_DIV;
+}
+
+/*
+ * Cuanto va a tardar la siguiente transferencia del canal (sin tocar nada).
+ * El hilo del DMA duerme esto en lugar de la busqueda completa.
+ */
+int diskcache_latency_us(const DMA_Controller *ch) {
+    if (!diskcache_sectors) return dma_seek_us;
+    if (ch->io_direction == 1) return hit_us(); // Escribir siempre va al buffer
+    HardDisk *d = &disks[ch - dma_channels];
+    int index = disk_index(d, ch->selected_cylinder, ch->selected_track, ch->selected_sector);
+    if (index < 0) return dma_seek_us;
+    return cache_find(&caches[ch - dma_channels], index) ? hit_us() : dma_seek_us;
+}
+
+int diskcache_read(HardDisk *d, int cylinder, int track, int sector, Sector *out) {
+    if (!diskcache_sectors) return disk_read_sector(d, cylinder, track, sector, out);
+    int index = disk_index(d, cylinder, track, sector);
+    if (index < 0) return -1;
+    DiskCache *c = &caches[d - disks];
+    c->reads++;
+    c->seek_us += dma_seek_us;
+
+    DiskCacheSlot *s = cache_find(c, index);
+    if (s) {
+        c->read_hits++;
+        c->latency_us += hit_us();
+        if (s->ahead) c->ahead_used++;
+        s->ahead = 0;
+    } else {
+        // Fallo: se busca y se lee hasta el final de la pista (sin sacar al
+        // que se pidio, que siempre cabe)
+        c->latency_us += dma_seek_us;
+        s = cache_victim(c, d);
+        disk_read_sector(d, cylinder, track, sector, &s->data);
+        s->index = index;
+        s->stamp = ++c->clock;
+        int room = diskcache_sectors - 1;
+        for (int next = sector + 1; next < d->sectors && room > 0; next++, room--) {
+            if (cache_find(c, index + next - sector)) continue; // Ya estaba (tal vez sucio)
+            DiskCacheSlot *a = cache_victim(c, d);
+            if (a == s) break; // Solo cabe el pedido
+            disk_read_sector(d, cylinder, track, next, &a->data);
+            a->index = index + next - sector;
+            a->ahead = 1;
+            a->stamp = ++c->clock;
+            c->ahead++;
+        }
+    }
+    s->stamp = ++c->clock;
+    *out = s->data;
+    return 0;
+}
+
+int diskcache_write(HardDisk *d, int cylinder, int track, int sector, const Sector *in) {
+    if (!diskcache_sectors) return disk_write_sector(d, cylinder, track, sector, in);
+    int index = disk_index(d, cylinder, track, sector);
+    if (index < 0) return -1;
+    DiskCache *c = &caches[d - disks];
+    c->writes++;
+    c->seek_us += dma_seek_us;
+    c->latency_us += hit_us();
+
+    DiskCacheSlot *s = cache_find(c, index);
+    if (s) {
+        c->write_hits++;
+    } else {
+        s = cache_victim(c, d);
+        s->index = index;
+    }
+    s->data = *in;
+    s->dirty = 1;
+    s->ahead = 0;
+    s->stamp = ++c->clock;
+    return 0;
+}
+
+// Baja al disco lo sucio del canal (el buffer se queda como esta)
+void diskcache_flush(HardDisk *d) {
+    if (!diskcache_sectors) return;
+    DiskCache *c = &caches[d - disks];
+    int per_cyl = d->tracks * d->sectors;
+    for (int i = 0; i < diskcache_sectors; i++) {
+        DiskCacheSlot *s = &c->slots[i];
+        if (s->index < 0 || !s->dirty) continue;
+        disk_write_sector(d, s->index / per_cyl, s->index / d->sectors % d->tracks, s->index % d->sectors,
+                          &s->data);
+        s->dirty = 0;
+        c->writebacks++;
+    }
+}
+
+// Olvida todo lo del canal SIN bajarlo (el disco cambio o se descarta)
+void diskcache_drop(HardDisk *d) {
+    if (!diskcache_sectors) return;
+    DiskCache *c = &caches[d - disks];
+    for (int i = 0; i < diskcache_sectors; i++) {
+        c->slots[i].index = -1;
+        c->slots[i].dirty = 0;
+        c->slots[i].ahead = 0;
+    }
+}
+
+/*
+ * Cambia el tamaño del buffer (sectores por canal, 0 = apagado). Lo sucio
+ * baja antes al disco. Retorna 0, o -1 si un canal esta ocupado o no hay
+ * memoria.
+ */
+int diskcache_configure(int sectors) {
+    if (sectors < 0 || sectors > DISKCACHE_MAX_SECTORS) {
+        printf("Error: El buffer es de 0 a %d sectores por canal\n", DISKCACHE_MAX_SECTORS);
+        return -1;
+    }
+    for (int n = 0; n < DMA_CHANNELS; n++) {
+        if (__atomic_load_n(&dma_channels[n].is_busy, __ATOMIC_ACQUIRE)) {
+            printf("Error: El DMA esta usando el disco, espera a que termine\n");
+            return -1;
+        }
+    }
+    for (int n = 0; n < DMA_CHANNELS; n++) {
+        diskcache_flush(&disks[n]);
+        free(caches[n].slots);
+        memset(&caches[n], 0, sizeof(DiskCache));
+    }
+    diskcache_sectors = 0;
+    if (!sectors) {
+        log_event("Buffer de sectores apagado");
+        return 0;
+    }
+
+    for (int n = 0; n < DMA_CHANNELS; n++) {
+        caches[n].slots = malloc(sectors * sizeof(DiskCacheSlot));
+        if (!caches[n].slots) {
+            printf("Error: Sin memoria para el buffer de sectores\n");
+            for (int k = 0; k <= n; k++) {
+                free(caches[k].slots);
+                caches[k].slots = NULL;
+            }
+            return -1;
+        }
+        for (int i = 0; i < sectors; i++) {
+            caches[n].slots[i].index = -1;
+            caches[n].slots[i].dirty = 0;
+            caches[n].slots[i].ahead = 0;
+            caches[n].slots[i].stamp = 0;
+        }
+    }
+    diskcache_sectors = sectors;
+    log_event("Buffer de sectores: %d por canal", sectors);
+    return 0;
+}
+
+void diskcache_print_stats(FILE *out) {
+    if (!diskcache_sectors) {
+        fprintf(out, " Buffer de sectores: apagado (diskcache <sectores>)\n");
+        return;
+    }
+    fprintf(out, " Buffer de sectores: %d por canal, acierto %d veces mas rapido que la busqueda\n",
+            diskcache_sectors, DISKCACHE_HIT_DIV);
+    fprintf(out, " Canal Lecturas Aciertos Escrituras Aciertos ReadAhead (usados) WriteBacks Sucios Busqueda(ms) SinBuffer(ms)\n");
+    for (int n = 0; n < DMA_CHANNELS; n++) {
+        DiskCache *c = &caches[n];
+        if (!c->reads && !c->writes) continue;
+        int dirty = 0;
+        for (int i = 0; i < diskcache_sectors; i++) dirty += c->slots[i].index >= 0 && c->slots[i].dirty;
+        fprintf(out, " %5d %8ld %8ld %10ld %8ld %9ld %8ld %10ld %6d %12.1f %13.1f\n", n, c->reads, c->read_hits,
+                c->writes, c->write_hits, c->ahead, c->ahead_used, c->writebacks, dirty, c->latency_us / 1e3,
+                c->seek_us / 1e3);
+    }
+}
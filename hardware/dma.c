@@ -1,99 +1,496 @@
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h> // Para sleep y usleep
 #include "hardware.h"
 #include "../logger.h"
 
 // Variables para el DMA
-// Aqui guardamos el estado del controlador DMA
-DMA_Controller dma;
-// Esta bandera le dice a la CPU si el DMA termino su trabajo
-int interrupt_pending_dma = 0; 
+// Aqui guardamos el estado de los controladores DMA (uno por disco)
+DMA_Controller dma_channels[DMA_CHANNELS];
+// El canal al que van las instrucciones SDMA* (lo cambia SDMAD)
+__thread int dma_selected = 0;
+// Estas banderas le dicen a la CPU que DMA termino su trabajo (bit n = canal n).
+// Las prenden los hilos y las baja la CPU, por eso se tocan con atomicos.
+int interrupt_pending_dma = 0;
+// 1 = la transferencia se hace ahi mismo, sin hilo ni espera (fuzzer)
+int dma_synchronous = 0;
+// Tiempo de busqueda del disco. 1 segundo para que se note paso a paso.
+int dma_seek_us = 1000000;
+// Veces que la CPU quiso el bus y lo tenia un DMA (ver bus_acquire)
+long bus_cpu_waits = 0;
+
+// Para que la CPU ociosa duerma hasta que un canal termine (dma_wait_event)
+static pthread_mutex_t dma_event_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dma_event_cond = PTHREAD_COND_INITIALIZER;
+long dma_idle_waits = 0;
+long dma_idle_wait_ns = 0;
+
+// Anillo de terminaciones (ver hardware.h). Lo tocan los hilos del DMA al
+// terminar y la CPU al arrancar, configurar y contar la espera.
+DMA_Ring dma_ring;
+static pthread_mutex_t dma_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+// Un sector vacio (todo en cero) se lee como la palabra 0
+static Word sector_to_word(const Sector *s) {
+    Word w = {0, 0};
+    if (s->data[0]) w.sign = s->data[0] - '0';
+    for (int i = 1; i < SECTOR_SIZE; i++) {
+        if (s->data[i]) w.digits = w.digits * 10 + (s->data[i] - '0');
+    }
+    return w;
+}
+
+static void word_to_sector(Word w, Sector *s) {
+    char text[SECTOR_SIZE + 1];
+    snprintf(text, sizeof(text), "%d%08d", w.sign, w.digits);
+    memcpy(s->data, text, SECTOR_SIZE);
+}
+
+// El canal pide el bus. Si esta ocupado (CPU u otro canal) se anota la espera.
+static void dma_bus_acquire(DMA_Controller *ch) {
+    if (sem_trywait(&system_bus_lock) == 0) return;
+    long t0 = now_ns();
+    sem_wait(&system_bus_lock);
+    ch->bus_waits++;
+    ch->bus_wait_ns += now_ns() - t0;
+}
+
+/* =========================================================================
+ * ANILLO DE TERMINACIONES
+ * ========================================================================= */
+
+// Sube la linea del anillo: se acabo el lote (o la espera). Con dma_ring_lock.
+static void dma_ring_raise() {
+    __atomic_fetch_and(&interrupt_pending_dma, ~DMA_LINE_RING_WAIT, __ATOMIC_ACQ_REL);
+    __atomic_or_fetch(&interrupt_pending_dma, DMA_LINE_RING, __ATOMIC_RELEASE);
+    dma_ring.unreported = 0;
+    dma_ring.deadline = 0;
+    dma_ring.interrupts++;
+}
 
 /*
- * Función del Hilo DMA
- * Esta funcion corre en paralelo con la CPU para simular que el disco es lento.
- * El profe dijo que usaramos hilos, asi que aqui esta.
+ * Aparta un lugar en el anillo para una transferencia que va a arrancar.
+ * Lo que ya esta escrito sin leer mas lo que va en camino no puede llenar
+ * el anillo: asi cuando termine siempre tiene donde escribir.
+ * Retorna 0, o -1 si no hay lugar.
  */
-void *dma_thread_func(void *arg) {
-    (void)arg; // No usamos esto, pero hay que ponerlo para que compile sin warnings
-    
-    log_event("[DMA] Iniciando transferencia de datos...");
-    dma.is_busy = 1; // Marcamos que estamos ocupados para que no nos manden otra cosa
-
-    // Simulamos que el disco tarda en buscar el dato (Seek Time)
-    // Le ponemos 1 segundo para que se note en la ejecucion paso a paso
-    sleep(1); 
-    
-    // Ahora si, vamos a copiar los datos.
-    // Primero necesitamos pedir permiso para usar la memoria (el Bus).
-    // Usamos un semaforo para que la CPU no toque la memoria mientras nosotros escribimos.
-    sem_wait(&system_bus_lock);
-    
+static int dma_ring_reserve(DMA_Controller *ch) {
+    pthread_mutex_lock(&dma_ring_lock);
+    int tail = word_to_int(mem_read(dma_ring.base + 1));
+    int used = (dma_ring.head - tail + dma_ring.slots) % dma_ring.slots;
+    if (tail < 0 || tail >= dma_ring.slots || used + dma_ring.in_flight >= dma_ring.slots - 1) {
+        dma_ring.refused++;
+        pthread_mutex_unlock(&dma_ring_lock);
+        return -1;
+    }
+    dma_ring.in_flight++;
+    dma_ring.next_id = dma_ring.next_id % 9999999 + 1;
+    ch->ring_id = dma_ring.next_id;
+    ch->ring_gen = dma_ring.generation;
+    pthread_mutex_unlock(&dma_ring_lock);
+    return 0;
+}
+
+/*
+ * Escribe el registro de la transferencia que termino y decide si ya toca
+ * interrumpir. Retorna 0 si el anillo ya no es el de esta transferencia
+ * (otro SDMAR o programa nuevo): entonces avisa con la linea del canal.
+ */
+static int dma_ring_complete(DMA_Controller *ch) {
+    int unit = ch - dma_channels;
+    pthread_mutex_lock(&dma_ring_lock);
+    if (!dma_ring.base || ch->ring_gen != dma_ring.generation) {
+        pthread_mutex_unlock(&dma_ring_lock);
+        ch->ring_id = 0;
+        return 0;
+    }
+
+    int at = dma_ring.base + DMA_RING_HEADER + dma_ring.head * DMA_RING_RECORD;
+    dma_ring.head = (dma_ring.head + 1) % dma_ring.slots;
+    dma_bus_acquire(ch);
+    mem_poke(at, int_to_word(ch->ring_id));
+    mem_poke(at + 1, int_to_word(unit * 10 + ch->status));
+    mem_poke(at + 2, int_to_word(ch->status ? 0 : 1)); // Cada sector es una palabra
+    mem_poke(dma_ring.base, int_to_word(dma_ring.head)); // El head al final: el registro ya esta
+    sem_post(&system_bus_lock);
+    ch->ring_id = 0;
+    dma_ring.in_flight--;
+    dma_ring.records++;
+
+    if (++dma_ring.unreported >= dma_ring.batch) {
+        dma_ring_raise();
+    } else {
+        __atomic_or_fetch(&interrupt_pending_dma, DMA_LINE_RING_WAIT, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&dma_ring_lock);
+    log_event("[DMA %d] Registro en el anillo (head %d)", unit, dma_ring.head);
+    return 1;
+}
+
+/*
+ * SDMAR: el programa ya puso en base+2..base+4 el tamaño, el lote y la
+ * espera; aqui se revisan y se ponen head y tail en 0. Con base 0 se
+ * quita el anillo. No se puede cambiar con transferencias del anillo en
+ * camino (su registro no tendria a donde ir).
+ */
+int dma_ring_setup(int base) {
+    pthread_mutex_lock(&dma_ring_lock);
+    if (dma_ring.in_flight) {
+        pthread_mutex_unlock(&dma_ring_lock);
+        return -1;
+    }
+    if (base == 0) {
+        dma_ring.base = 0;
+        dma_ring.generation++;
+        __atomic_fetch_and(&interrupt_pending_dma, ~(DMA_LINE_RING | DMA_LINE_RING_WAIT), __ATOMIC_ACQ_REL);
+        pthread_mutex_unlock(&dma_ring_lock);
+        return 0;
+    }
+
+    int slots = 0, batch = 0, timeout = 0;
+    if (base > 0 && base + DMA_RING_HEADER <= MEM_SIZE) {
+        slots = word_to_int(mem_read(base + 2));
+        batch = word_to_int(mem_read(base + 3));
+        timeout = word_to_int(mem_read(base + 4));
+    }
+    if (slots < 2 || slots > DMA_RING_MAX_SLOTS || base + DMA_RING_HEADER + slots * DMA_RING_RECORD > MEM_SIZE) {
+        pthread_mutex_unlock(&dma_ring_lock);
+        return -1;
+    }
+    if (batch < 1) batch = 1;
+    if (batch > slots - 1) batch = slots - 1; // Mas no cabe sin leer
+    if (timeout <= 0) timeout = DMA_RING_TIMEOUT;
+
+    int generation = dma_ring.generation + 1;
+    memset(&dma_ring, 0, sizeof(dma_ring));
+    dma_ring.base = base;
+    dma_ring.slots = slots;
+    dma_ring.batch = batch;
+    dma_ring.timeout = timeout;
+    dma_ring.generation = generation;
+    mem_write(base, int_to_word(0));
+    mem_write(base + 1, int_to_word(0));
+    __atomic_fetch_and(&interrupt_pending_dma, ~(DMA_LINE_RING | DMA_LINE_RING_WAIT), __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&dma_ring_lock);
+    log_event("[DMA] Anillo en %d: %d registros, lote de %d, espera de %d ciclos", base, slots, batch, timeout);
+    return 0;
+}
+
+void dma_ring_reset() {
+    pthread_mutex_lock(&dma_ring_lock);
+    int generation = dma_ring.generation + 1;
+    memset(&dma_ring, 0, sizeof(dma_ring));
+    dma_ring.generation = generation;
+    __atomic_fetch_and(&interrupt_pending_dma, ~(DMA_LINE_RING | DMA_LINE_RING_WAIT), __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&dma_ring_lock);
+}
+
+// La CPU lo llama mientras haya un lote incompleto: la espera se cuenta en
+// ciclos desde la primera vez que lo ve
+void dma_ring_tick(long cycle) {
+    pthread_mutex_lock(&dma_ring_lock);
+    if (__atomic_load_n(&interrupt_pending_dma, __ATOMIC_ACQUIRE) & DMA_LINE_RING_WAIT) {
+        if (!dma_ring.deadline) dma_ring.deadline = cycle + dma_ring.timeout;
+        else if (cycle >= dma_ring.deadline) dma_ring_raise();
+    }
+    pthread_mutex_unlock(&dma_ring_lock);
+}
+
+int dma_ring_count() {
+    if (!dma_ring.base) return 0;
+    int tail = word_to_int(mem_read(dma_ring.base + 1));
+    return (dma_ring.head - tail + dma_ring.slots) % dma_ring.slots;
+}
+
+/*
+ * La transferencia en si (copiar el dato y avisar a la CPU)
+ * El disco es de este canal nada mas, asi que solo se pide el bus para
+ * tocar la RAM: los demas canales y la CPU siguen mientras tanto.
+ */
+static void dma_transfer(DMA_Controller *ch) {
+    int unit = ch - dma_channels;
+    HardDisk *disk = &disks[unit];
+    ch->status = 0; // Todo bien (0 = exito) hasta que algo falle
+
     // La direccion de memoria donde vamos a leer o escribir es:
-    int ram_addr = dma.memory_address;
+    int ram_addr = ch->memory_address;
 
     // Dependiendo de si es lectura o escritura:
-    // dma.io_direction: 0 = Leer disco a RAM, 1 = Escribir RAM a disco
-    if (dma.io_direction == 0) {
+    // io_direction: 0 = Leer disco a RAM, 1 = Escribir RAM a disco
+    // Cada sector guarda una palabra: el signo y los 8 digitos en texto
+    Sector sector;
+    if (ch->io_direction == 0) {
         // LEER DEL DISCO -> ESCRIBIR EN RAM
-        // Simulación: Como no tenemos disco real con pistas/sectores formateados,
-        // vamos a generar un dato "quemandolo" o simulado. 
-        // En un caso real leeriamos de un archivo binario usando track/cylinder/sector.
-        // Aqui guardaremos un valor dummy que representa el dato leido.
-        Word dato_leido;
-        dato_leido.sign = 0;
-        // Inventamos un dato basado en el sector para saber que es distinto
-        dato_leido.digits = dma.selected_sector * 1111; 
-        
-        // Escribimos en RAM
-        if (ram_addr >= 0 && ram_addr < MEM_SIZE) {
-             main_memory[ram_addr] = dato_leido;
-             log_event("[DMA] Dato %d escrito en Memoria[%d]", dato_leido.digits, ram_addr);
+        if (diskcache_read(disk, ch->selected_cylinder, ch->selected_track, ch->selected_sector, &sector) < 0) {
+             log_event("[DMA %d] Error: Sector invalido C%d P%d S%d", unit, ch->selected_cylinder,
+                       ch->selected_track, ch->selected_sector);
+             ch->status = 1; // Error
+        } else if (ram_addr >= 0 && ram_addr < MEM_SIZE) {
+             Word dato_leido = sector_to_word(&sector);
+             // Pedimos permiso para usar la memoria (el Bus) solo para escribir
+             dma_bus_acquire(ch);
+             mem_poke(ram_addr, dato_leido);
+             sem_post(&system_bus_lock);
+             log_event("[DMA %d] Dato %d escrito en Memoria[%d]", unit, dato_leido.digits, ram_addr);
         } else {
-             log_event("[DMA] Error: Direccion de memoria invalida %d", ram_addr);
-             dma.status = 1; // Error
+             log_event("[DMA %d] Error: Direccion de memoria invalida %d", unit, ram_addr);
+             ch->status = 1; // Error
         }
-        
+
     } else {
         // ESCRIBIR EN DISCO <- LEER DE RAM
         if (ram_addr >= 0 && ram_addr < MEM_SIZE) {
-            Word dato_a_guardar = main_memory[ram_addr];
-            // Aqui "guardariamos" en el archivo de disco.
-            // Solo lo logueamos por ahora.
-            log_event("[DMA] Dato %d leido de Memoria[%d] y guardado en disco (simulado)", dato_a_guardar.digits, ram_addr);
+            dma_bus_acquire(ch);
+            Word dato_a_guardar = mem_peek(ram_addr);
+            sem_post(&system_bus_lock);
+
+            word_to_sector(dato_a_guardar, &sector);
+            if (diskcache_write(disk, ch->selected_cylinder, ch->selected_track, ch->selected_sector, &sector) < 0) {
+                log_event("[DMA %d] Error: Sector invalido C%d P%d S%d", unit, ch->selected_cylinder,
+                          ch->selected_track, ch->selected_sector);
+                ch->status = 1; // Error
+            } else {
+                log_event("[DMA %d] Dato %d leido de Memoria[%d] y guardado en disco", unit, dato_a_guardar.digits, ram_addr);
+            }
         } else {
-             log_event("[DMA] Error: Direccion de memoria invalida %d", ram_addr);
-             dma.status = 1; // Error
+             log_event("[DMA %d] Error: Direccion de memoria invalida %d", unit, ram_addr);
+             ch->status = 1; // Error
         }
     }
-    
-    // Ya terminamos con la memoria, soltamos el bus
-    sem_post(&system_bus_lock);
-    
-    // Finalizar
-    dma.is_busy = 0; // Ya no estamos ocupados
-    dma.status = 0; // Todo salio bien (0 = exito)
-    
-    // Avisarle al procesador que terminamos
-    interrupt_pending_dma = 1;
-    log_event("[DMA] Transferencia terminada. Avisando a CPU con interrupcion.");
 
+    // Finalizar (status ya dice si hubo error)
+    ch->transfers++;
+    if (ch->status) ch->errors++;
+
+    // Avisarle al procesador que terminamos (solo nuestra linea, o un registro
+    // en el anillo). Primero el aviso y luego is_busy: asi la CPU nunca ve
+    // "nadie ocupado y nada pendiente" mientras todavia falta el aviso.
+    int by_ring = ch->ring_id && dma_ring_complete(ch);
+    if (!by_ring) __atomic_or_fetch(&interrupt_pending_dma, 1 << unit, __ATOMIC_RELEASE);
+    __atomic_store_n(&ch->is_busy, 0, __ATOMIC_RELEASE); // Ya no estamos ocupados
+
+    // Despertar a la CPU si estaba dormida esperando
+    pthread_mutex_lock(&dma_event_lock);
+    pthread_cond_broadcast(&dma_event_cond);
+    pthread_mutex_unlock(&dma_event_lock);
+    log_event("[DMA %d] Transferencia terminada. Avisando a CPU %s.", unit, by_ring ? "por el anillo" : "con interrupcion");
+}
+
+static int dma_any_busy() {
+    for (int n = 0; n < DMA_CHANNELS; n++) {
+        if (__atomic_load_n(&dma_channels[n].is_busy, __ATOMIC_ACQUIRE)) return 1;
+    }
+    return 0;
+}
+
+/*
+ * La CPU no tiene nada que hacer hasta que pase algo (ver cpu_idle).
+ * Duerme (sin gastar CPU del host) hasta que cambien las lineas de
+ * interrupcion o ya no quede ningun canal trabajando.
+ * 'seen' son las lineas que la CPU ya conoce.
+ * Retorna 1 si paso algo, 0 si no habia nada en camino (nunca va a pasar).
+ */
+int dma_wait_event(int seen) {
+    if (!dma_any_busy() && __atomic_load_n(&interrupt_pending_dma, __ATOMIC_ACQUIRE) == seen) return 0;
+
+    long t0 = now_ns();
+    pthread_mutex_lock(&dma_event_lock);
+    while (dma_any_busy() && __atomic_load_n(&interrupt_pending_dma, __ATOMIC_ACQUIRE) == seen) {
+        pthread_cond_wait(&dma_event_cond, &dma_event_lock);
+    }
+    pthread_mutex_unlock(&dma_event_lock);
+    dma_idle_waits++;
+    dma_idle_wait_ns += now_ns() - t0;
+    return 1;
+}
+
+/*
+ * Función del Hilo DMA
+ * Esta funcion corre en paralelo con la CPU para simular que el disco es lento.
+ * El profe dijo que usaramos hilos, asi que aqui esta. Cada canal tiene el suyo.
+ */
+void *dma_thread_func(void *arg) {
+    DMA_Controller *ch = arg;
+    long t0 = now_ns();
+
+    log_event("[DMA %d] Iniciando transferencia de datos...", (int)(ch - dma_channels));
+
+    // Simulamos que el disco tarda en buscar el dato (Seek Time), o menos si
+    // el sector ya esta en el buffer del controlador (ver diskcache.c)
+    usleep(diskcache_latency_us(ch));
+
+    dma_transfer(ch);
+    ch->busy_ns += now_ns() - t0;
     return NULL;
 }
 
-// Funcion para arrancar el DMA
+// Arranca una transferencia en el canal n (con lo que tenga programado)
+int dma_start_channel(int n) {
+    DMA_Controller *ch = &dma_channels[n];
+
+    // Primero checamos si no esta haciendo algo ya, y lo marcamos ocupado
+    // en el mismo paso: con varias CPUs dos SDMAON al mismo canal podrian
+    // pasar las dos el chequeo y arrancar dos hilos sobre el mismo canal
+    int idle = 0;
+    if (!__atomic_compare_exchange_n(&ch->is_busy, &idle, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        log_event("[DMA %d] Oye, espera! El DMA esta ocupado todavía.", n);
+        return -1;
+    }
+    // Con anillo, primero un lugar para su registro
+    ch->ring_id = 0;
+    if (dma_ring.base && dma_ring_reserve(ch) < 0) {
+        log_event("[DMA %d] El anillo de terminaciones esta lleno, no arranco.", n);
+        __atomic_store_n(&ch->is_busy, 0, __ATOMIC_RELEASE);
+        return -1;
+    }
+
+    // Sin hilo: se hace ya (el resultado no depende de tiempos)
+    if (dma_synchronous) {
+        dma_transfer(ch);
+        return 0;
+    }
+
+    // Creamos el hilo del DMA (suelto: nadie le hace join)
+    // pthread_create(puntero_thread, atributos, funcion, argumentos)
+    if (pthread_create(&ch->thread_id, NULL, dma_thread_func, ch) != 0) {
+        log_event("[DMA %d] No se pudo crear el hilo. Algo fallo en el sistema.", n);
+        ch->status = 1; // Error
+        __atomic_store_n(&ch->is_busy, 0, __ATOMIC_RELEASE);
+        if (ch->ring_id) {
+            pthread_mutex_lock(&dma_ring_lock);
+            dma_ring.in_flight--;
+            pthread_mutex_unlock(&dma_ring_lock);
+            ch->ring_id = 0;
+        }
+        return -1;
+    }
+    pthread_detach(ch->thread_id);
+    return 0;
+}
+
+// Funcion para arrancar el DMA (SDMAON)
 // El profe pide que esto lance el hilo
 void dma_start_transfer() {
-    // Primero checamos si no esta haciendo algo ya
-    if (dma.is_busy) {
-        log_event("[DMA] Oye, espera! El DMA esta ocupado todavía.");
-        return;
+    dma_start_channel(dma_selected);
+}
+
+// La CPU atiende de a un canal por interrupcion (el de numero mas bajo).
+// La linea del anillo es la DMA_CHANNELS; la de espera no interrumpe.
+int dma_take_completion() {
+    int pending = __atomic_load_n(&interrupt_pending_dma, __ATOMIC_ACQUIRE) & ~DMA_LINE_RING_WAIT;
+    if (!pending) return -1;
+    int n = __builtin_ctz(pending);
+    __atomic_fetch_and(&interrupt_pending_dma, ~(1 << n), __ATOMIC_ACQ_REL);
+    return n;
+}
+
+void dma_print_stats() {
+    printf(" Canal Disco                   Transf Errores Ocupado(ms) Transf/s EsperasBus Espera(us)\n");
+    for (int n = 0; n < DMA_CHANNELS; n++) {
+        DMA_Controller *ch = &dma_channels[n];
+        const char *name = !disks[n].total ? "(sin disco)" : disks[n].filename[0] ? disks[n].filename : "(solo en memoria)";
+        double busy_s = ch->busy_ns / 1e9;
+        printf(" %c%-4d %-22.22s %7ld %7ld %11.1f %8.0f %10ld %10.1f\n", n == dma_selected ? '*' : ' ', n,
+               name, ch->transfers, ch->errors, ch->busy_ns / 1e6,
+               busy_s > 0 ? ch->transfers / busy_s : 0.0, ch->bus_waits, ch->bus_wait_ns / 1e3);
     }
-    
-    // Creamos el hilo del DMA
-    // pthread_create(puntero_thread, atributos, funcion, argumentos)
-    if (pthread_create(&dma.thread_id, NULL, dma_thread_func, NULL) != 0) {
-        log_event("[DMA] No se pudo crear el hilo. Algo fallo en el sistema.");
-        dma.status = 1; // Error
+    printf(" CPU: encontro el bus ocupado %ld veces. (* = canal seleccionado)\n", bus_cpu_waits);
+    printf(" CPU: durmio %ld veces esperando E/S (%.1f ms)\n", dma_idle_waits, dma_idle_wait_ns / 1e6);
+    if (dma_ring.base) {
+        printf(" Anillo en %d: %d registros, lote de %d, espera de %d ciclos, head %d, %d sin leer\n",
+               dma_ring.base, dma_ring.slots, dma_ring.batch, dma_ring.timeout, dma_ring.head, dma_ring_count());
+        printf("  %ld terminaciones en %ld interrupciones (%.1f por interrupcion), %ld SDMAON rechazados por lleno\n",
+               dma_ring.records, dma_ring.interrupts,
+               dma_ring.interrupts ? (double)dma_ring.records / dma_ring.interrupts : 0.0, dma_ring.refused);
+    }
+}
+
+/*
+ * BENCHMARK DE E/S
+ * Con 1, 2, ... DMA_CHANNELS canales a la vez, cada canal hace 'transfers'
+ * escrituras seguidas mientras este hilo (haciendo de CPU) lee memoria sin
+ * parar. Asi se ve si la E/S escala con los canales y cuanto estorba al CPU.
+ * Se hace sobre discos temporales en memoria: los de verdad no se tocan.
+ */
+void dma_bench(int transfers, int seek_us) {
+    for (int n = 0; n < DMA_CHANNELS; n++) {
+        if (dma_channels[n].is_busy) {
+            printf("bench dma: el canal %d esta ocupado, intenta luego\n", n);
+            return;
+        }
     }
+
+    DMA_Controller saved[DMA_CHANNELS];
+    HardDisk saved_disks[DMA_CHANNELS];
+    int saved_seek = dma_seek_us;
+    int saved_pending = __atomic_load_n(&interrupt_pending_dma, __ATOMIC_ACQUIRE);
+    int saved_ring = dma_ring.base;
+    int saved_cache = diskcache_sectors;
+    dma_ring.base = 0; // Los avisos del bench no van al anillo del programa
+    diskcache_configure(0); // Se mide la busqueda de cada canal, sin buffer
+    memcpy(saved, dma_channels, sizeof(saved));
+    memcpy(saved_disks, disks, sizeof(saved_disks));
+    memset(disks, 0, sizeof(disks));
+    dma_seek_us = seek_us;
+    for (int n = 0; n < DMA_CHANNELS; n++) disk_attach(&disks[n], NULL, 0, 0, 0);
+
+    printf("bench dma: %d transferencias por canal, busqueda de %d us\n", transfers, seek_us);
+    printf(" Canales  Tiempo(ms)  Transf/s  Lecturas CPU/s  Esperas CPU  Esperas DMA  Espera DMA(us)\n");
+    for (int k = 1; k <= DMA_CHANNELS; k++) {
+        int started[DMA_CHANNELS] = {0};
+        long cpu_reads = 0;
+        long cpu_waits0 = bus_cpu_waits;
+        for (int n = 0; n < k; n++) {
+            DMA_Controller *ch = &dma_channels[n];
+            ch->transfers = ch->errors = ch->busy_ns = ch->bus_waits = ch->bus_wait_ns = 0;
+            ch->selected_cylinder = 0;
+            ch->selected_track = 0;
+            ch->selected_sector = n;
+            ch->io_direction = 1;
+            ch->memory_address = USER_MEM_START + n;
+        }
+
+        long t0 = now_ns();
+        int pending;
+        do {
+            pending = 0;
+            for (int n = 0; n < k; n++) {
+                if (__atomic_load_n(&dma_channels[n].is_busy, __ATOMIC_ACQUIRE)) {
+                    pending = 1;
+                } else if (started[n] < transfers) {
+                    dma_start_channel(n);
+                    started[n]++;
+                    pending = 1;
+                }
+            }
+            mem_read(USER_MEM_START); // La "CPU" sigue usando el bus
+            cpu_reads++;
+        } while (pending);
+        double secs = (now_ns() - t0) / 1e9;
+
+        long dma_waits = 0, dma_wait_ns = 0;
+        for (int n = 0; n < k; n++) {
+            dma_waits += dma_channels[n].bus_waits;
+            dma_wait_ns += dma_channels[n].bus_wait_ns;
+        }
+        printf(" %7d  %10.1f  %8.0f  %14.0f  %11ld  %11ld  %14.1f\n", k, secs * 1000,
+               (double)k * transfers / secs, cpu_reads / secs, bus_cpu_waits - cpu_waits0, dma_waits,
+               dma_waits ? dma_wait_ns / 1e3 / dma_waits : 0.0);
+    }
+
+    // Dejamos todo como estaba (las interrupciones del bench no le tocan a la CPU)
+    for (int n = 0; n < DMA_CHANNELS; n++) disk_detach(&disks[n]);
+    memcpy(disks, saved_disks, sizeof(saved_disks));
+    memcpy(dma_channels, saved, sizeof(saved));
+    __atomic_store_n(&interrupt_pending_dma, saved_pending, __ATOMIC_RELEASE);
+    dma_ring.base = saved_ring;
+    dma_seek_us = saved_seek;
+    diskcache_configure(saved_cache);
 }
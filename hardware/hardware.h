@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <pthread.h>
+#include <stdio.h>
 
 /* =========================================================================
  * 1. CONSTANTES DE ARQUITECTURA
@@ -42,13 +43,32 @@ typedef struct {
     int RL;       // Registro Límite (Gestión Memoria)
     int RX;       // Registro Base de la Pila (Indexado también usa esto)
     int SP;       // Puntero Tope de Pila
+    int PTBR;     // Base de la Tabla de Paginas (solo en modo paginado)
+    int PTLR;     // Largo de la Tabla de Paginas (cuantas paginas virtuales)
     PSW_t PSW;    // Palabra de Estado del Sistema
 } Registers;
 
 // Especificaciones de Memoria (RAM)
-#define MEM_SIZE        2000    // Capacidad: 2000 palabras
-#define OS_MEM_SIZE     300     // 0000 - 0299: Sistema Operativo
-#define USER_MEM_START  300     // 0300 - 1999: Espacio de Usuario
+// El tamaño se decide al arrancar (memory_configure, opciones --mem/--os).
+// Por defecto es lo del enunciado: 2000 palabras, las primeras 300 del SO.
+#define MEM_SIZE_DEFAULT    2000
+#define OS_MEM_SIZE_DEFAULT 300
+#define MEM_SIZE_MAX        100000  // IR.valor tiene 5 digitos (00000-99999)
+
+extern int mem_size;
+extern int os_mem_size;
+
+#define MEM_SIZE        mem_size      // Capacidad en palabras
+#define OS_MEM_SIZE     os_mem_size   // 0000 - (OS_MEM_SIZE-1): Sistema Operativo
+#define USER_MEM_START  os_mem_size   // OS_MEM_SIZE - (MEM_SIZE-1): Espacio de Usuario
+
+// La RAM es "dispersa": se guarda en paginas que se piden al host la
+// primera vez que alguien escribe en ellas. Leer una pagina que nunca se
+// escribio devuelve ceros sin gastar memoria.
+#define MEM_PAGE_SHIFT  8
+#define MEM_PAGE_WORDS  (1 << MEM_PAGE_SHIFT)   // 256 palabras por pagina
+#define MEM_PAGE_MASK   (MEM_PAGE_WORDS - 1)
+#define MEM_PAGE_COUNT  ((MEM_SIZE_MAX + MEM_PAGE_WORDS - 1) / MEM_PAGE_WORDS)
 
 // Modos de Ejecución
 #define MODE_USER       0
@@ -72,57 +92,84 @@ typedef struct {
 /* =========================================================================
  * 2. CÓDIGOS DE OPERACIÓN (Instruction Set)
  * ========================================================================= */
-// Aritméticas
-#define OP_SUM      0
-#define OP_RES      1
-#define OP_MULT     2
-#define OP_DIVI     3
-
-// Transferencia de Datos
-#define OP_LOAD     4
-#define OP_STR      5
-
-// Transferencia de Registros Especiales
-#define OP_LOADRX   6
-#define OP_STRRX    7
-
-// Comparación y Saltos
-#define OP_COMP     8
-#define OP_JMPE     9   // Jump if Equal
-#define OP_JMPNE    10  // Jump if Not Equal
-#define OP_JMPLT    11  // Jump if Less Than
-#define OP_JMPLGT   12  // Jump if Greater Than
-
-// Control y Sistema
-#define OP_SVC      13  // Llamada al sistema (System Call)
-#define OP_RETRN    14  
-#define OP_HAB      15  // Habilita interrupciones
-#define OP_DHAB     16  // Deshabilita interrupciones
-#define OP_TTI      17  // Timer
-#define OP_CHMOD    18  // Cambia modo (Usuario <-> Kernel)
-
-// Gestión de Registros Base/Límite/Pila
-#define OP_LOADRB   19
-#define OP_STRRB    20
-#define OP_LOADRL   21
-#define OP_STRRL    22
-#define OP_LOADSP   23
-#define OP_STRSP    24
-
-// Pila
-#define OP_PSH      25
-#define OP_POP      26
-
-// Salto Incondicional
-#define OP_J        27
-
-// Operaciones de E/S (DMA)
-#define OP_SDMAP    28  // Set Track (Pista)
-#define OP_SDMAC    29  // Set Cylinder (Cilindro)
-#define OP_SDMAS    30  // Set Sector
-#define OP_SDMAIO   31  // Set I/O Mode (0=Read, 1=Write)
-#define OP_SDMAM    32  // Set Memory Address
-#define OP_SDMAON   33  // Start DMA
+// La tabla de instrucciones se define UNA sola vez aqui (X-Macro).
+// La CPU (cpu.c) y el ensamblador (assembler.c) la expanden cada uno a su
+// manera, asi nunca se desincronizan los codigos con los mnemonicos.
+//
+// X(NOMBRE, codigo, "mnemonico", tipo de operando)
+//   ISA_ARG_NONE  : no usa operando (ej: retrn, psh)
+//   ISA_ARG_DATA  : dato con cualquier direccionamiento (Dir/Inm/Idx)
+//   ISA_ARG_ADDR  : direccion de memoria (Dir/Idx, nunca Inmediato)
+//   ISA_ARG_VALUE : valor crudo de 5 digitos (registros del DMA, timer)
+#define ISA_ARG_NONE   0
+#define ISA_ARG_DATA   1
+#define ISA_ARG_ADDR   2
+#define ISA_ARG_VALUE  3
+
+#define ISA_OPCODES(X) \
+    /* Aritméticas */ \
+    X(SUM,    0,  "sum",    ISA_ARG_DATA)  \
+    X(RES,    1,  "res",    ISA_ARG_DATA)  \
+    X(MULT,   2,  "mult",   ISA_ARG_DATA)  \
+    X(DIVI,   3,  "divi",   ISA_ARG_DATA)  \
+    /* Transferencia de Datos */ \
+    X(LOAD,   4,  "load",   ISA_ARG_DATA)  \
+    X(STR,    5,  "str",    ISA_ARG_ADDR)  \
+    /* Transferencia de Registros Especiales */ \
+    X(LOADRX, 6,  "loadrx", ISA_ARG_NONE)  \
+    X(STRRX,  7,  "strrx",  ISA_ARG_NONE)  \
+    /* Comparación y Saltos */ \
+    X(COMP,   8,  "comp",   ISA_ARG_DATA)  \
+    X(JMPE,   9,  "jmpe",   ISA_ARG_ADDR)  /* Jump if Equal */ \
+    X(JMPNE,  10, "jmpne",  ISA_ARG_ADDR)  /* Jump if Not Equal */ \
+    X(JMPLT,  11, "jmplt",  ISA_ARG_ADDR)  /* Jump if Less Than */ \
+    X(JMPLGT, 12, "jmplgt", ISA_ARG_ADDR)  /* Jump if Greater Than */ \
+    /* Control y Sistema */ \
+    X(SVC,    13, "svc",    ISA_ARG_NONE)  /* Llamada al sistema */ \
+    X(RETRN,  14, "retrn",  ISA_ARG_NONE)  \
+    X(HAB,    15, "hab",    ISA_ARG_NONE)  /* Habilita interrupciones */ \
+    X(DHAB,   16, "dhab",   ISA_ARG_NONE)  /* Deshabilita interrupciones */ \
+    X(TTI,    17, "tti",    ISA_ARG_VALUE) /* Timer */ \
+    X(CHMOD,  18, "chmod",  ISA_ARG_NONE)  /* Cambia modo (Usuario <-> Kernel) */ \
+    /* Gestión de Registros Base/Límite/Pila */ \
+    X(LOADRB, 19, "loadrb", ISA_ARG_NONE)  \
+    X(STRRB,  20, "strrb",  ISA_ARG_NONE)  \
+    X(LOADRL, 21, "loadrl", ISA_ARG_NONE)  \
+    X(STRRL,  22, "strrl",  ISA_ARG_NONE)  \
+    X(LOADSP, 23, "loadsp", ISA_ARG_NONE)  \
+    X(STRSP,  24, "strsp",  ISA_ARG_NONE)  \
+    /* Pila */ \
+    X(PSH,    25, "psh",    ISA_ARG_NONE)  \
+    X(POP,    26, "pop",    ISA_ARG_NONE)  \
+    /* Salto Incondicional */ \
+    X(J,      27, "j",      ISA_ARG_ADDR)  \
+    /* Operaciones de E/S (DMA) */ \
+    X(SDMAP,  28, "sdmap",  ISA_ARG_VALUE) /* Set Track (Pista) */ \
+    X(SDMAC,  29, "sdmac",  ISA_ARG_VALUE) /* Set Cylinder (Cilindro) */ \
+    X(SDMAS,  30, "sdmas",  ISA_ARG_VALUE) /* Set Sector */ \
+    X(SDMAIO, 31, "sdmaio", ISA_ARG_VALUE) /* Set I/O Mode (0=Read, 1=Write) */ \
+    X(SDMAM,  32, "sdmam",  ISA_ARG_VALUE) /* Set Memory Address */ \
+    X(SDMAON, 33, "sdmaon", ISA_ARG_NONE)  /* Start DMA */ \
+    /* Memoria Paginada (Tabla de Paginas) */ \
+    X(LOADPT, 34, "loadpt", ISA_ARG_NONE)  /* AC = PTBR */ \
+    X(STRPT,  35, "strpt",  ISA_ARG_NONE)  /* PTBR = AC */ \
+    X(LOADPL, 36, "loadpl", ISA_ARG_NONE)  /* AC = PTLR */ \
+    X(STRPL,  37, "strpl",  ISA_ARG_NONE)  /* PTLR = AC */ \
+    /* Varios discos: cada uno con su canal DMA */ \
+    X(SDMAD,  38, "sdmad",  ISA_ARG_VALUE) /* Selecciona el canal que programan las SDMA* */ \
+    X(SDMAR,  39, "sdmar",  ISA_ARG_VALUE) /* Anillo de terminaciones en esa direccion (0 = sin anillo) */ \
+    /* Varias CPUs (ver smp.c) */ \
+    X(FAA,    40, "faa",    ISA_ARG_ADDR)  /* Atomico: AC = M[dir], M[dir] = M[dir] + AC */ \
+    X(LOADID, 41, "loadid", ISA_ARG_NONE)  /* AC = numero de esta CPU */ \
+    X(IPI,    42, "ipi",    ISA_ARG_VALUE) /* Interrupcion (INT_IPI) a esa CPU */
+
+// Generamos las constantes OP_SUM, OP_RES, ... a partir de la tabla
+#define ISA_ENUM_ENTRY(name, code, mnem, arg) OP_##name = code,
+enum { ISA_OPCODES(ISA_ENUM_ENTRY) };
+#undef ISA_ENUM_ENTRY
+
+// Un opcode mas alla del ultimo valido (para dimensionar tablas)
+#define ISA_MAX_OPCODE 100
 
 /* =========================================================================
  * 3. VECTOR DE INTERRUPCIONES (Códigos 0-8)
@@ -136,14 +183,73 @@ typedef struct {
 #define INT_ADDR_INVALID 6
 #define INT_UNDERFLOW    7
 #define INT_OVERFLOW     8
+#define INT_PAGE_FAULT   9   // Fallo de pagina (solo en modo paginado)
+#define INT_IPI          10  // Otra CPU nos aviso (IPI); AC = la que aviso
+#define INT_MAX_CODE     10  // Ultimo codigo valido del vector
+
+// Sin SO, cpu_reset apunta todos los vectores aqui (un RETRN solito)
+#define DEFAULT_HANDLER  200
+
+/* =========================================================================
+ * 3.1 MEMORIA VIRTUAL PAGINADA (Opcional)
+ * En modo paginado, las direcciones de usuario ya no se relocalizan con
+ * RB/RL sino con una tabla de paginas que vive en el area del SO:
+ *   Memoria[PTBR + pagina_virtual] = PTE
+ * Cada PTE es una palabra: PTE_VALID + marco (ej: 1000003 = marco 3).
+ * Un PTE sin PTE_VALID (o una pagina >= PTLR) genera INT_PAGE_FAULT y la
+ * direccion virtual que fallo queda en MAR para el manejador.
+ * La CPU guarda las traducciones recientes en una TLB por software.
+ * ========================================================================= */
+#define VM_PAGE_SIZE     100     // Palabras por pagina virtual (decimal!)
+#define PTE_VALID        1000000 // Bit (digito) de "pagina presente"
+#define PAGE_TABLE_BASE  210     // Donde el loader arma la tabla (despues del manejador en 200)
+#define TLB_ENTRIES      16      // TLB de mapeo directo
+
+extern int paging_enabled;       // 0 = RB/RL de siempre, 1 = paginado
+
+/* =========================================================================
+ * SIMULADOR DE CACHE (opcional, ver cache.c)
+ * Solo mide: los datos siguen en main_memory. L1 de instrucciones, L1 de
+ * datos y una L2 unificada, cada una con su geometria y politica.
+ * ========================================================================= */
+#define CACHE_INST        0       // Niveles / tipos de acceso
+#define CACHE_DATA        1
+#define CACHE_L2          2
+#define CACHE_HIT_CYCLES  1       // Costos estimados
+#define CACHE_L2_CYCLES   6
+#define CACHE_MEM_CYCLES  30
+#define CACHE_TOP_PCS     8       // Instrucciones mas caras en el reporte
+
+extern int cache_enabled;        // 0 = la CPU ni llama al simulador
+extern long cache_stall_cycles;  // Ciclos de mas sobre un acierto (para el pipeline)
+
+/* =========================================================================
+ * MODO DE TIEMPOS (opcional, ver pipeline.c)
+ * Estima los ciclos de reloj de un pipeline F-D-E-M-W sobre las
+ * instrucciones que ejecuta el modelo funcional.
+ * ========================================================================= */
+#define PIPE_STAGES           5
+#define PIPE_J_PENALTY        1   // J se resuelve en D
+#define PIPE_BRANCH_PENALTY   2   // Condicionales y RETRN se resuelven en E
+#define PIPE_BUS_STALL_CYCLES 2   // Por cada vez que el DMA tenia el bus
+
+extern int pipeline_enabled;
 
 /* =========================================================================
  * 4. ESTRUCTURAS DE DATOS DE E/S
  * ========================================================================= */
+// Geometria por defecto (la del enunciado). Se puede cambiar al conectar
+// otro disco (disk_attach), el archivo trae la suya en la cabecera.
 #define DISK_CYLINDERS 10
 #define DISK_TRACKS    10
 #define DISK_SECTORS   100
 #define SECTOR_SIZE    9
+#define DISK_MAX_SECTORS (1 << 24)   // ~150 MB de datos como maximo
+
+// Los sectores se piden al host en bloques (igual que la RAM). Un bloque en
+// NULL nunca se escribio y se lee como ceros.
+#define DISK_CHUNK_SHIFT   8
+#define DISK_CHUNK_SECTORS (1 << DISK_CHUNK_SHIFT)
 
 // Estructura del Disco Duro
 typedef struct {
@@ -151,8 +257,14 @@ typedef struct {
 } Sector;
 
 typedef struct {
-    // Arreglo 3D [Cilindro][Pista][Sector]
-    Sector sectors[DISK_CYLINDERS][DISK_TRACKS][DISK_SECTORS];
+    int cylinders;              // Geometria
+    int tracks;
+    int sectors;                // Sectores por pista
+    int total;                  // cylinders * tracks * sectors
+    Sector **chunks;            // Directorio: total / DISK_CHUNK_SECTORS bloques
+    int chunk_count;
+    char filename[256];         // Imagen de donde se cargo (y donde se guarda)
+    long writes;                // Sectores escritos desde que se conecto
 } HardDisk;
 
 // Controlador DMA
@@ -170,29 +282,124 @@ typedef struct {
     
     // Hilo para operación asíncrona
     pthread_t thread_id;
+
+    // Estadisticas (comando "dma")
+    long transfers;         // Transferencias terminadas
+    long errors;
+    long busy_ns;           // Tiempo ocupado (busqueda + copia)
+    long bus_waits;         // Veces que encontro el bus ocupado
+    long bus_wait_ns;       // Tiempo esperando el bus
+
+    // Anillo: id de la transferencia en camino (0 = avisa con su linea)
+    int ring_id;
+    int ring_gen;           // Con que anillo se arranco (dma_ring.generation)
 } DMA_Controller;
 
+// Cantidad de canales DMA (cada uno con su disco y su hilo)
+// Al atender INT_IO_DONE la CPU deja en AC: canal * 10 + status
+#define DMA_CHANNELS 4
+
+/*
+ * Anillo de terminaciones (SDMAR <dir>, direccion fisica como las del DMA)
+ * En vez de una linea por canal, cada transferencia deja un registro en
+ * memoria y la CPU se entera por lotes:
+ *
+ *   dir+0 head     : siguiente registro que escribe el DMA
+ *   dir+1 tail     : siguiente que va a leer el programa (lo mueve el)
+ *   dir+2 registros: tamaño del anillo (lo pone el programa antes de SDMAR)
+ *   dir+3 lote     : una INT_IO_DONE cada tantos registros (0 = cada uno)
+ *   dir+4 espera   : o cuando pasen estos ciclos con un lote incompleto
+ *                    (0 = DMA_RING_TIMEOUT)
+ *   dir+5...       : registros de 3 palabras: id, canal * 10 + status y
+ *                    palabras movidas
+ *
+ * El id es el numero de SDMAON aceptado desde el SDMAR (1, 2, ...). Cabe
+ * registros - 1 (uno siempre vacio para distinguir lleno de vacio); si no
+ * hay lugar el SDMAON se rechaza como con el canal ocupado, asi que nunca
+ * se pierde una terminacion. Con anillo, al atender INT_IO_DONE la CPU deja
+ * en AC cuantos registros hay sin leer.
+ */
+#define DMA_RING_HEADER    5
+#define DMA_RING_RECORD    3
+#define DMA_RING_MAX_SLOTS 64
+#define DMA_RING_TIMEOUT   1000
+#define DMA_LINE_RING      (1 << DMA_CHANNELS)        // Hay un lote listo (INT 4)
+#define DMA_LINE_RING_WAIT (1 << (DMA_CHANNELS + 1))  // Lote incompleto, corre la espera
+
+typedef struct {
+    int base;               // 0 = sin anillo (cada canal avisa con su linea)
+    int slots;
+    int batch;
+    int timeout;
+    int head;
+    int next_id;
+    int in_flight;          // Transferencias arrancadas que no han escrito registro
+    int unreported;         // Registros escritos desde la ultima INT_IO_DONE
+    long deadline;          // Ciclo de CPU en que vence la espera (0 = sin contar)
+    int generation;         // Cambia con cada SDMAR (las viejas no escriben aqui)
+
+    // Estadisticas (comando "dma")
+    long records;
+    long interrupts;
+    long refused;           // SDMAON rechazados por anillo lleno
+} DMA_Ring;
+
+// Servicios del sistema que atiende el host (ver svc.c), mientras el
+// vector de SVC siga en DEFAULT_HANDLER. El codigo va en AC y los datos en
+// la pila: M[SP] es el ultimo que se apilo.
+#define SVC_PUT_NUMBER 1   // Escribe M[SP] como numero
+#define SVC_PUT_CHAR   2   // Escribe M[SP] como caracter (codigo ASCII)
+#define SVC_GET_NUMBER 3   // AC = numero leido (al final de la entrada: 0 y CC = 3)
+#define SVC_GET_CHAR   4   // AC = caracter leido (-1 al final de la entrada)
+#define SVC_MEM_COPY   5   // M[SP] = destino, M[SP+1] = origen, M[SP+2] = cantidad
+#define SVC_MEM_FILL   6   // M[SP] = destino, M[SP+1] = valor, M[SP+2] = cantidad
+#define SVC_GET_CYCLES 7   // AC = ciclos ejecutados (modulo 10^7)
+#define SVC_MAX_CODE   7
+
+#define CONSOLE_BUF_SIZE 4096
+
+typedef struct {
+    char out[CONSOLE_BUF_SIZE]; // Lo que escribio el programa y aun no sale
+    int out_len;
+    FILE *host_out;         // A donde sale (NULL = se tira, para el fuzzer)
+    FILE *host_in;          // De donde se lee (NULL = sin entrada)
+    int line_mode;          // 1 = se vacia en cada '\n' (si es una terminal)
+
+    // Estadisticas (comando "console")
+    long chars_out;
+    long flushes;           // Escrituras reales al host
+    long chars_in;
+} Console;
+
 /* =========================================================================
  * 5. VARIABLES GLOBALES (Componentes de Hardware)
  * ========================================================================= */
 
-// Memoria RAM: Arreglo de 2000 Palabras
-extern Word main_memory[MEM_SIZE];
+// Memoria RAM: Directorio de paginas (NULL = pagina nunca escrita)
+extern Word *main_memory[MEM_PAGE_COUNT];
 
 // CPU Registers
-extern Registers cpu_registers;
+extern __thread Registers cpu_registers;  // Uno por CPU (ver smp.c)
 
 // Flag Global de Interrupciones Pendientes
 // Sencillo: 1 = Interrupción Pendiente, 0 = Nada
 // En un hardware real esto serían líneas físicas hacia la CPU.
-extern int interrupt_pending_dma; // Línea de interrupción del DMA (INT 4)
+extern int interrupt_pending_dma; // Líneas del DMA (INT 4): bit n = canal n termino (y DMA_LINE_RING*)
+extern int dma_synchronous;       // 1 = DMA sin hilo ni espera (fuzzer)
 
 
 // Disco Duro
-extern HardDisk hdd;
+extern HardDisk disks[DMA_CHANNELS];  // disks[n] cuelga del canal n
 
 // DMA
-extern DMA_Controller dma;
+extern DMA_Controller dma_channels[DMA_CHANNELS];
+extern __thread int dma_selected; // Canal que programan las SDMA* (lo cambia SDMAD)
+extern int dma_seek_us;           // Tiempo de busqueda simulado (1 s por defecto)
+extern DMA_Ring dma_ring;         // Anillo de terminaciones (SDMAR)
+extern long bus_cpu_waits;        // Veces que la CPU encontro el bus ocupado
+
+// Consola
+extern Console console;
 
 // Bus del Sistema (Mutex)
 #include <semaphore.h>
@@ -203,6 +410,15 @@ extern DMA_Controller dma;
 // Usamos un semáforo binario (valor 1) para controlar quién usa el bus.
 extern sem_t system_bus_lock;
 
+// Pedir el bus del lado de la CPU. Si lo tiene un DMA (u otra CPU) se cuenta
+// la espera (para ver la contencion con el comando "dma").
+static inline void bus_acquire() {
+    if (sem_trywait(&system_bus_lock) != 0) {
+        __atomic_add_fetch(&bus_cpu_waits, 1, __ATOMIC_RELAXED);
+        sem_wait(&system_bus_lock);
+    }
+}
+
 // VALOR CENTINELA: FF FF FF FF (-1)
 // Se usa para marcar el fin del programa y detener la CPU.
 #define WORD_SENTINEL_SIGN   1
@@ -219,7 +435,13 @@ extern sem_t system_bus_lock;
  * ========================================================================= */
 
 // Flag para saber si la CPU sigue corriendo
-extern int cpu_running;
+// (los __thread son de cada CPU: cada una corre en su hilo, ver smp.c)
+extern __thread int cpu_running;
+extern __thread int cpu_idle_halt;       // 1 = se detuvo en un ciclo sin salida (ver cpu_idle)
+extern int cpu_idle_detect;       // 0 = los ciclos sin salida corren como siempre (--noidle)
+extern __thread int cpu_last_interrupt;  // Codigo de la ultima interrupcion generada
+extern __thread long cpu_cycle_count;    // Ciclos desde el ultimo cpu_reset
+extern __thread int cpu_id;              // 0 = la que arranca (la del hilo principal)
 
 // Inicialización
 void hardware_init();
@@ -229,17 +451,216 @@ void disk_init();
 void disk_save();
 
 // Memoria
+int memory_configure(int size, int os_size); // Antes de memory_init. 0 = ok
 void mem_write(int address, Word data);
 Word mem_read(int address);
+void mem_write_block(int address, const Word *data, int n); // n palabras, un solo uso del bus
+void mem_read_block(int address, Word *data, int n);
+Word mem_fetch_add(int address, int delta);             // FAA: suma y retorna lo de antes, un solo uso del bus
+Word *mem_page_alloc(int page);               // Pide la pagina al host
+int mem_pages_touched();                      // Paginas realmente asignadas
+void mem_snapshot(Word *buf);                 // Copia MEM_SIZE palabras a buf
+void mem_snapshot_restore(const Word *buf);   // Y de vuelta a la memoria
+void mem_set_backing(Word *backing, int pages); // Paginas seguidas en 'backing' (NULL = del host, ver monitor.c)
+// Rangos grandes, una sola toma del bus (el rango ya validado, ver memory.c)
+void mem_range_read(int from, int n, Word *out);
+void mem_range_fill(int from, int n, Word value);
+int mem_range_find(int from, int n, const Word *pattern, int len, int *hits, int max_hits); // Cuantas veces
+int mem_range_diff(int from, int n, const Word *image, int *diffs, int max_diffs);         // Palabras distintas
+
+// Acceso directo SIN bus: solo para quien ya tiene system_bus_lock
+// (DMA, loader). La direccion ya debe estar validada (0 <= addr < MEM_SIZE).
+static inline Word mem_peek(int address) {
+    Word *page = main_memory[address >> MEM_PAGE_SHIFT];
+    if (!page) {
+        Word zero = {0, 0};
+        return zero;
+    }
+    return page[address & MEM_PAGE_MASK];
+}
+
+// Rangos de memoria "vigilados": si alguien escribe ahi, la CPU tiene que
+// olvidar lo que tenia en cache:
+//   MEM_WATCH_VECTORS    : Tabla de vectores (0-INT_MAX_CODE)
+//   MEM_WATCH_PAGE_TABLE : Tabla de paginas [PTBR, PTBR+PTLR) -> TLB
+//   MEM_WATCH_CODE       : Codigo verificado (modo confiable, ver verifier.c)
+#define MEM_WATCH_VECTORS    0
+#define MEM_WATCH_PAGE_TABLE 1
+#define MEM_WATCH_CODE       2
+#define MEM_WATCH_COUNT      3
+
+typedef struct {
+    int lo;     // Primera direccion vigilada
+    int len;    // Cuantas (0 = nada)
+} MemWatch;
+
+extern MemWatch mem_watch[MEM_WATCH_COUNT];
+void mem_watch_hit(int which, int address);
+
+static inline void mem_poke(int address, Word data) {
+    if ((unsigned)(address - mem_watch[0].lo) < (unsigned)mem_watch[0].len) mem_watch_hit(0, address);
+    if ((unsigned)(address - mem_watch[1].lo) < (unsigned)mem_watch[1].len) mem_watch_hit(1, address);
+    if ((unsigned)(address - mem_watch[2].lo) < (unsigned)mem_watch[2].len) mem_watch_hit(2, address);
+    Word *page = main_memory[address >> MEM_PAGE_SHIFT];
+    if (!page) page = mem_page_alloc(address >> MEM_PAGE_SHIFT);
+    page[address & MEM_PAGE_MASK] = data;
+}
 
 // CPU
 void cpu_cycle();       // Ejecuta fetch-decode-execute
 void cpu_reset();       // Reinicia registros
+void cpu_refresh_translation(); // Llamar si se cambia RB, RL o el modo desde fuera de la CPU
+int cpu_translate(int address); // Direccion del programa -> fisica (< 0 = invalida, ya interrumpio)
+// Modo confiable: ok[i] != 0 = la instruccion en lo + i ya se verifico (ver
+// verifier.c) con los RB/RL de ahora y corre sin los chequeos de cada ciclo
+// mientras nadie escriba en [lo, lo + len). Retorna cuantas quedaron.
+int cpu_trust_code(int lo, int len, const unsigned char *ok);
+void cpu_trust_drop();            // Todo de vuelta a modo revisado
+void cpu_trust_print_stats(FILE *out);
+void cpu_execute_generic(int op); // Ejecuta IR con la implementacion de referencia
+int cpu_selftest();     // Compara manejadores especializados vs genericos (0 = ok)
+// Lockstep: cada instruccion tambien en una copia de la maquina con la
+// implementacion de referencia (ver cpu.c). run_cycles usa cpu_lockstep_cycle
+// en vez de cpu_cycle mientras cpu_lockstep_every != 0 (cada cuantas
+// instrucciones se compara la memoria; los registros siempre).
+extern int cpu_lockstep_every;
+int cpu_lockstep_start();          // -1 si no hay memoria para la copia
+void cpu_lockstep_cycle();         // A la primera diferencia la reporta y detiene la CPU
+void cpu_lockstep_stop();
+int cpu_lockstep_ok();             // 0 si hubo diferencia en la ultima corrida
+void cpu_lockstep_print_stats(FILE *out);
+void cpu_bench_interrupts(int n); // Mide n idas y vueltas de interrupcion
+void cpu_trace_reset();            // Olvida la secuencia de interrupciones
+void cpu_trace_print(FILE *out);   // "INTERRUPCIONES 6x1 8x500 ..." (para pruebas)
 int word_to_int(Word w);
 Word int_to_word(int val);
 
-// Disco / DMA
-void dma_start_transfer(); 
-int dma_check_interrupt(); 
+// Memoria paginada
+void paging_set(int enabled);
+void tlb_flush();
+void paging_print_stats();
+
+// Simulador de cache
+int cache_access(int kind, int addr, int write); // Ciclos estimados del acceso
+int cache_configure(int level, int words, int line_words, int ways, int write_back); // 0 = ok
+void cache_disable();
+void cache_reset();                       // Caches vacias y estadisticas en cero
+void cache_print_stats(FILE *out);
+
+// Modo de tiempos
+void pipeline_reset();
+void pipeline_account(int op, int mode, int pc, int next_pc, int interrupted);
+long pipeline_cycles();
+void pipeline_print_stats(FILE *out);
+
+// Consola
+void console_init(FILE *out);             // out = NULL: la salida se tira
+int console_open_input(const char *filename); // NULL = sin entrada. 0 = ok
+void console_write(const char *text, int len);
+int console_read_number(int *value);      // -1 al final de la entrada
+int console_read_char();                  // -1 al final de la entrada
+void console_flush();                     // Manda al host lo pendiente
+void console_print_stats();
+
+// Servicios del sistema en el host (SVC_*)
+extern int svc_native;                    // 0 = todo SVC va al manejador del programa
+int svc_call(int code);                   // 1 si lo atendio el host
+void svc_print_stats();
+
+// Tabla de instrucciones (ver ISA_OPCODES)
+const char *isa_mnemonic(int opcode);   // NULL si el opcode no existe
+int isa_operand_kind(int opcode);       // ISA_ARG_* o -1 si no existe
+int isa_lookup(const char *mnemonic);   // Opcode o -1 si no existe
+
+// Disco (ver disk.c para el formato de la imagen)
+int disk_attach(HardDisk *d, const char *filename, int cylinders, int tracks, int sectors);
+void disk_detach(HardDisk *d);      // Guarda y deja el canal sin disco
+int disk_clone(HardDisk *dst, const HardDisk *src); // Copia solo en memoria
+int disk_read_sector(HardDisk *d, int cylinder, int track, int sector, Sector *out);
+int disk_write_sector(HardDisk *d, int cylinder, int track, int sector, const Sector *in);
+int disk_sectors_used(HardDisk *d);
+int disk_index(HardDisk *d, int cylinder, int track, int sector); // Numero de sector, -1 = fuera
+void disk_print_info(HardDisk *d);
+
+// Buffer de sectores del controlador (ver diskcache.c). Apagado, read y
+// write van directo al disco.
+#define DISKCACHE_HIT_DIV     100     // Un acierto tarda dma_seek_us / esto
+#define DISKCACHE_MAX_SECTORS 4096
+extern int diskcache_sectors;         // Por canal (0 = apagado)
+int diskcache_configure(int sectors); // 0 = ok
+int diskcache_latency_us(const DMA_Controller *ch); // Lo que va a tardar la siguiente
+int diskcache_read(HardDisk *d, int cylinder, int track, int sector, Sector *out);
+int diskcache_write(HardDisk *d, int cylinder, int track, int sector, const Sector *in);
+void diskcache_flush(HardDisk *d);    // Lo sucio baja al disco
+void diskcache_drop(HardDisk *d);     // Se olvida todo sin bajarlo
+void diskcache_print_stats(FILE *out);
+
+// DMA
+void dma_start_transfer();        // Arranca el canal seleccionado
+int dma_start_channel(int n);     // -1 si esta ocupado
+int dma_take_completion();        // Canal que termino (y baja su linea), -1 = ninguno
+int dma_wait_event(int seen);     // Duerme hasta que un canal termine. 0 = no hay ninguno en camino
+int dma_ring_setup(int base);     // SDMAR. -1 si el anillo no sirve o hay transferencias en camino
+void dma_ring_reset();            // Sin anillo (programa nuevo)
+void dma_ring_tick(long cycle);   // La CPU cuenta la espera de un lote incompleto
+int dma_ring_count();             // Registros sin leer (head - tail)
+void dma_print_stats();
+void dma_bench(int transfers, int seek_us);
+
+// Varias CPUs (ver smp.c)
+#define SMP_MAX_CPUS    16
+#define SMP_STACK_WORDS 100       // La pila de la CPU n empieza n * esto mas abajo
+extern int smp_cpus;              // 1 = una sola CPU (lo normal)
+extern volatile int smp_ipi_sent; // Ya se mando alguna IPI (antes ni se revisa)
+int smp_configure(int cpus);      // -1 si no se puede (ver smp_conflict en smp.c)
+long smp_run(long max_cycles);    // Corre todas; retorna los ciclos de la CPU 0
+int smp_send_ipi(int target);     // -1 si esa CPU no existe (o es uno mismo)
+int smp_take_ipi();               // CPU que nos aviso (y baja la linea), -1 = ninguna
+int smp_wait_ipi();               // CPU ociosa: 1 si llego algo y hay que seguir
+void smp_lock();                  // Consola y servicios del host: una CPU a la vez
+void smp_unlock();
+void smp_print_stats(FILE *out);
+void cpu_start_secondary(int id, const Registers *boot);
+
+// Vista en memoria compartida para monitores externos (ver monitor.c).
+// Esto es el formato del segmento: si cambia, sube MONITOR_VERSION.
+#define MONITOR_MAGIC          0x4D4F4E49  // "MONI"
+#define MONITOR_VERSION        1
+#define MONITOR_PUBLISH_CYCLES 4096        // Cada cuantos ciclos publica la CPU 0
+
+typedef struct {
+    // Fijo desde que se crea el segmento
+    unsigned int magic;
+    unsigned int version;
+    unsigned int header_size;    // sizeof(MonitorHeader): aqui empieza la memoria
+    unsigned int word_size;      // sizeof(Word)
+    unsigned int registers_size; // sizeof(Registers)
+    int mem_size;                // Palabras de la maquina (MEM_SIZE)
+    int os_mem_size;
+    int page_words;
+    // Seqlock: impar = la CPU esta escribiendo lo que sigue
+    unsigned long seq;
+    Registers regs;
+    long cycles;                 // cpu_cycle_count de la CPU 0
+    long published_ns;           // CLOCK_MONOTONIC de la publicacion
+    long publishes;
+    long bus_cpu_waits;
+    long cache_stall_cycles;
+    long pipeline_cycles;        // 0 si el pipeline esta apagado
+    int running;
+    int idle_halt;
+    int last_interrupt;
+    int cpus;
+} MonitorHeader;
+
+// La memoria (Word[mem_size], paginas seguidas) va justo despues de la cabecera
+#define MONITOR_MEMORY(h) ((Word *)((char *)(h) + (h)->header_size))
+
+extern int monitor_active;        // 0 = run_cycles ni publica
+int monitor_open(const char *name); // Crea el segmento y mueve la memoria ahi. 0 = ok
+void monitor_close();             // La memoria regresa al host y se borra el segmento
+void monitor_publish();           // Registros y contadores, bajo el seqlock
+int monitor_watch(const char *name, const int dumps[][2], int dump_count); // --watch
+void monitor_print_stats(FILE *out);
 
 #endif // HARDWARE_H
\ No newline at end of file
@@ -1,26 +1,96 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include "hardware.h"
-#include "../logger.h" 
+#include "../logger.h"
 
-// Aqui esta la memoria principal de la maquina
-Word main_memory[MEM_SIZE];
+// Tamaño de la memoria (se puede cambiar con memory_configure)
+int mem_size = MEM_SIZE_DEFAULT;
+int os_mem_size = OS_MEM_SIZE_DEFAULT;
+
+// Aqui esta la memoria principal de la maquina, partida en paginas.
+// Una pagina en NULL nunca se escribio y se lee como ceros.
+Word *main_memory[MEM_PAGE_COUNT];
+// Con el monitor prendido las paginas son seguidas dentro de su segmento
+// (ver mem_set_backing): ya no se piden ni se sueltan, solo se borran.
+static Word *mem_backing;
+static int mem_backing_pages;
+// Rangos vigilados (ver mem_poke). La tabla de vectores siempre.
+MemWatch mem_watch[MEM_WATCH_COUNT] = {
+    {0, INT_MAX_CODE + 1},  // MEM_WATCH_VECTORS
+    {0, 0},                 // MEM_WATCH_PAGE_TABLE (la arma la CPU)
+    {0, 0},                 // MEM_WATCH_CODE (la arma la CPU con el verificador)
+};
 // Este semaforo es el candado para que nadie mas use el Bus
 sem_t system_bus_lock;
 
+/*
+ * Configuración de la Memoria
+ * Se llama ANTES de memory_init (al arrancar, con --mem y --os).
+ * Retorna 0 si los tamaños son validos, -1 si no.
+ */
+int memory_configure(int size, int os_size) {
+    if (size <= 0 || size > MEM_SIZE_MAX || os_size <= 0 || os_size >= size) {
+        printf("Error: Memoria invalida (%d palabras, %d de SO). Maximo %d.\n", size, os_size, MEM_SIZE_MAX);
+        return -1;
+    }
+    mem_size = size;
+    os_mem_size = os_size;
+    return 0;
+}
+
+/*
+ * Pide una pagina nueva al host (en ceros)
+ * Se llama con el bus tomado (desde mem_write o mem_poke)
+ */
+Word *mem_page_alloc(int page) {
+    Word *p = calloc(MEM_PAGE_WORDS, sizeof(Word));
+    if (!p) {
+        // Sin memoria en el host no hay mucho que hacer
+        log_event("ERROR FATAL: No hay memoria en el host para la pagina %d", page);
+        fprintf(stderr, "ERROR FATAL: No hay memoria en el host\n");
+        exit(1);
+    }
+    main_memory[page] = p;
+    return p;
+}
+
+// Cuantas paginas se han pedido de verdad (para ver el ahorro)
+int mem_pages_touched() {
+    int n = 0;
+    for (int i = 0; i < MEM_PAGE_COUNT; i++) {
+        if (main_memory[i]) n++;
+    }
+    return n;
+}
+
 /*
  * Inicialización de la Memoria
  * Borramos todo y creamos el candado (semáforo)
  */
 void memory_init() {
-    // Poner ceros en toda la memoria (memset es mas rapido que un for)
-    memset(main_memory, 0, sizeof(main_memory));
-    
+    // Soltamos las paginas que hubiera (todo vuelve a leerse como cero)
+    if (mem_backing) {
+        memset(mem_backing, 0, (size_t)mem_backing_pages * MEM_PAGE_WORDS * sizeof(Word));
+    } else {
+        for (int i = 0; i < MEM_PAGE_COUNT; i++) {
+            free(main_memory[i]);
+            main_memory[i] = NULL;
+        }
+    }
+
+    // Lo que la CPU tenga en cache de la memoria vieja ya no sirve
+    mem_watch_hit(MEM_WATCH_VECTORS, 0);
+    mem_watch_hit(MEM_WATCH_PAGE_TABLE, 0);
+    cpu_trust_drop();
+
     // Iniciamos el semaforo.
     // El '1' al final significa que empieza libre (verde).
     sem_init(&system_bus_lock, 0, 1);
-    
-    log_event("Memoria lista y limpia (%d espacios)", MEM_SIZE);
+
+    log_event("Memoria lista y limpia (%d espacios, %d de SO, paginas de %d)",
+              MEM_SIZE, OS_MEM_SIZE, MEM_PAGE_WORDS);
 }
 
 /*
@@ -31,15 +101,15 @@ void mem_write(int address, Word data) {
     // Seguridad primero: checar que la direccion exista
     if (address < 0 || address >= MEM_SIZE) {
         log_event("ERROR: Quieres escribir fuera de la memoria! (%d)", address);
-        return; 
+        return;
     }
 
     // Pedimos el bus (Wait = esperar hasta que este libre)
-    sem_wait(&system_bus_lock);
-    
-    // Escribimos
-    main_memory[address] = data;
-    
+    bus_acquire();
+
+    // Escribimos (si la pagina no existe, se crea aqui)
+    mem_poke(address, data);
+
     // Soltamos el bus (Post = avisar que ya terminamos)
     sem_post(&system_bus_lock);
 }
@@ -57,13 +127,232 @@ Word mem_read(int address) {
     }
 
     // Pedimos el bus
-    sem_wait(&system_bus_lock);
-    
-    // Leemos
-    data = main_memory[address];
-    
+    bus_acquire();
+
+    // Leemos (una pagina sin escribir da ceros)
+    data = mem_peek(address);
+
     // Soltamos el bus
     sem_post(&system_bus_lock);
-    
+
     return data;
 }
+
+/*
+ * Escribir/Leer un bloque de palabras seguidas
+ * Igual que n llamadas a mem_write/mem_read (mismos chequeos y mensajes
+ * por cada direccion invalida), pero pidiendo el bus UNA sola vez.
+ * Se usa para guardar/recuperar el contexto en las interrupciones.
+ */
+void mem_write_block(int address, const Word *data, int n) {
+    bus_acquire();
+    for (int i = 0; i < n; i++) {
+        int a = address + i;
+        if (a < 0 || a >= MEM_SIZE) {
+            log_event("ERROR: Quieres escribir fuera de la memoria! (%d)", a);
+            continue;
+        }
+        mem_poke(a, data[i]);
+    }
+    sem_post(&system_bus_lock);
+}
+
+void mem_read_block(int address, Word *data, int n) {
+    bus_acquire();
+    for (int i = 0; i < n; i++) {
+        int a = address + i;
+        if (a < 0 || a >= MEM_SIZE) {
+            log_event("ERROR: Quieres leer fuera de la memoria! (%d)", a);
+            data[i].sign = 0;
+            data[i].digits = 0;
+            continue;
+        }
+        data[i] = mem_peek(a);
+    }
+    sem_post(&system_bus_lock);
+}
+
+/*
+ * Suma atomica (FAA): M[address] += delta y retorna lo que habia, con una
+ * sola toma del bus para que nadie (otra CPU o el DMA) se meta en medio.
+ * Si se pasa de 7 digitos se queda con los de abajo, como un contador.
+ */
+Word mem_fetch_add(int address, int delta) {
+    Word old = {0, 0};
+    if (address < 0 || address >= MEM_SIZE) {
+        log_event("ERROR: Quieres sumar fuera de la memoria! (%d)", address);
+        return old;
+    }
+    bus_acquire();
+    old = mem_peek(address);
+    mem_poke(address, int_to_word((word_to_int(old) + delta) % 10000000));
+    sem_post(&system_bus_lock);
+    return old;
+}
+
+/*
+ * Fotos de la memoria completa (para pruebas y comparaciones)
+ * Toman el bus una sola vez para toda la copia.
+ */
+void mem_snapshot(Word *buf) {
+    bus_acquire();
+    for (int i = 0; i < MEM_SIZE; i++) buf[i] = mem_peek(i);
+    sem_post(&system_bus_lock);
+}
+
+void mem_snapshot_restore(const Word *buf) {
+    bus_acquire();
+    for (int i = 0; i < MEM_SIZE; i++) mem_poke(i, buf[i]);
+    sem_post(&system_bus_lock);
+}
+
+/* =========================================================================
+ * RANGOS GRANDES (memdump, memfill, memfind, memdiff)
+ * Todo con UNA toma del bus y pagina por pagina: cada pedazo es un arreglo
+ * seguido, asi que los ciclos de adentro son memcpy/memcmp o comparaciones
+ * sin saltos que el compilador puede hacer con SIMD. Una pagina que nunca
+ * se escribio se lee como mem_zero_page (no se pide al host).
+ * El rango ya viene validado: 0 <= from y from + n <= MEM_SIZE.
+ * ========================================================================= */
+
+static const Word mem_zero_page[MEM_PAGE_WORDS];
+
+// Una palabra como un solo entero de 64 bits (comparar dos es un ==)
+_Static_assert(sizeof(Word) == sizeof(uint64_t), "Word debe medir 8 bytes");
+static inline uint64_t word_bits(const Word *w) {
+    uint64_t v;
+    memcpy(&v, w, sizeof(v));
+    return v;
+}
+
+// Palabras que quedan de 'address' al final de su pagina (sin pasar de n)
+static inline int page_chunk(int address, int n) {
+    int left = MEM_PAGE_WORDS - (address & MEM_PAGE_MASK);
+    return n < left ? n : left;
+}
+
+static inline const Word *page_words(int address) {
+    const Word *page = main_memory[address >> MEM_PAGE_SHIFT];
+    return (page ? page : mem_zero_page) + (address & MEM_PAGE_MASK);
+}
+
+void mem_range_read(int from, int n, Word *out) {
+    bus_acquire();
+    for (int done = 0; done < n;) {
+        int len = page_chunk(from + done, n - done);
+        memcpy(out + done, page_words(from + done), len * sizeof(Word));
+        done += len;
+    }
+    sem_post(&system_bus_lock);
+}
+
+void mem_range_fill(int from, int n, Word value) {
+    bus_acquire();
+    // Lo que la CPU tenga en cache de ese rango ya no sirve (como en mem_poke)
+    for (int w = 0; w < MEM_WATCH_COUNT; w++) {
+        int lo = mem_watch[w].lo, hi = mem_watch[w].lo + mem_watch[w].len;
+        if (mem_watch[w].len && lo < from + n && from < hi) mem_watch_hit(w, lo > from ? lo : from);
+    }
+    int zero = word_bits(&value) == 0;
+    for (int done = 0; done < n;) {
+        int a = from + done;
+        int len = page_chunk(a, n - done);
+        Word *page = main_memory[a >> MEM_PAGE_SHIFT];
+        done += len;
+        if (!page && zero) continue; // Ya se lee como ceros
+        if (!page) page = mem_page_alloc(a >> MEM_PAGE_SHIFT);
+        Word *dst = page + (a & MEM_PAGE_MASK);
+        for (int i = 0; i < len; i++) dst[i] = value;
+    }
+    sem_post(&system_bus_lock);
+}
+
+/*
+ * Donde aparece 'pattern' (len palabras seguidas) dentro del rango. Guarda
+ * las primeras max_hits direcciones en hits y retorna cuantas hubo en total.
+ * Primero se marcan en un arreglo las que tienen la primera palabra (eso se
+ * vectoriza) y memchr salta a las marcadas; solo ahi se revisa el resto.
+ */
+int mem_range_find(int from, int n, const Word *pattern, int len, int *hits, int max_hits) {
+    uint64_t first = word_bits(&pattern[0]);
+    unsigned char match[MEM_PAGE_WORDS];
+    int count = 0;
+    int last = from + n - len; // Ultima direccion donde cabe el patron
+    bus_acquire();
+    for (int a = from; a <= last;) {
+        int chunk = page_chunk(a, last - a + 1);
+        const Word *src = page_words(a);
+        for (int i = 0; i < chunk; i++) match[i] = word_bits(&src[i]) == first;
+
+        const unsigned char *m = match;
+        while ((m = memchr(m, 1, chunk - (m - match))) != NULL) {
+            int at = a + (int)(m - match);
+            int k = 1;
+            while (k < len && word_bits(page_words(at + k)) == word_bits(&pattern[k])) k++;
+            if (k == len) {
+                if (count < max_hits) hits[count] = at;
+                count++;
+            }
+            m++;
+        }
+        a += chunk;
+    }
+    sem_post(&system_bus_lock);
+    return count;
+}
+
+/*
+ * Compara el rango contra image (n palabras, image[0] es la de 'from').
+ * Guarda las primeras max_diffs direcciones distintas y retorna cuantas
+ * hubo. Una pagina igual se descarta con un solo memcmp.
+ */
+int mem_range_diff(int from, int n, const Word *image, int *diffs, int max_diffs) {
+    int count = 0;
+    bus_acquire();
+    for (int done = 0; done < n;) {
+        int a = from + done;
+        int len = page_chunk(a, n - done);
+        const Word *now = page_words(a), *old = image + done;
+        done += len;
+        if (memcmp(now, old, len * sizeof(Word)) == 0) continue;
+        for (int i = 0; i < len; i++) {
+            if (word_bits(&now[i]) == word_bits(&old[i])) continue;
+            if (count < max_diffs) diffs[count] = a + i;
+            count++;
+        }
+    }
+    sem_post(&system_bus_lock);
+    return count;
+}
+
+/*
+ * Mueve la memoria a 'backing' (pages paginas seguidas, en ceros) o, con
+ * NULL, de regreso a paginas del host. Lo que ya estaba escrito se copia.
+ * Las paginas quedan todas pedidas: nunca hay NULL mientras dure, asi que
+ * mem_poke no llama a mem_page_alloc.
+ */
+void mem_set_backing(Word *backing, int pages) {
+    bus_acquire();
+    if (backing) {
+        for (int p = 0; p < pages; p++) {
+            Word *dst = backing + (size_t)p * MEM_PAGE_WORDS;
+            if (main_memory[p]) memcpy(dst, main_memory[p], sizeof(Word) * MEM_PAGE_WORDS);
+            if (!mem_backing) free(main_memory[p]);
+            main_memory[p] = dst;
+        }
+    } else if (mem_backing) {
+        // De regreso solo se piden las paginas que tienen algo
+        for (int p = 0; p < mem_backing_pages; p++) {
+            const Word *src = main_memory[p];
+            main_memory[p] = NULL;
+            for (int i = 0; i < MEM_PAGE_WORDS; i++) {
+                if (!src[i].sign && !src[i].digits) continue;
+                memcpy(mem_page_alloc(p), src, sizeof(Word) * MEM_PAGE_WORDS);
+                break;
+            }
+        }
+    }
+    mem_backing = backing;
+    mem_backing_pages = backing ? pages : 0;
+    sem_post(&system_bus_lock);
+}
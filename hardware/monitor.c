@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "hardware.h"
+#include "../logger.h"
+
+/*
+ * VISTA COMPARTIDA PARA MONITORES
+ * Para ver la maquina mientras corre hay que pararla y pedir "registers" o
+ * "memory <dir>" de una en una. Con esto la memoria, los registros y los
+ * contadores viven en un segmento de memoria compartida POSIX (shm_open)
+ * que otro proceso puede mapear y leer cuando quiera, sin pedirle nada a
+ * la CPU:
+ *
+ *   +--------------------+  0
+ *   | MonitorHeader      |  magic, version y tamaños (fijos)
+ *   |  seq (seqlock)     |  impar = la CPU esta publicando
+ *   |  registros, ciclos |  lo que publica la CPU cada MONITOR_PUBLISH_CYCLES
+ *   +--------------------+  header_size
+ *   | Word[paginas*256]  |  main_memory: las paginas apuntan AQUI
+ *   +--------------------+
+ *
+ * La memoria no se copia: memory.c pone cada pagina de main_memory dentro
+ * del segmento (mem_set_backing), asi que el monitor ve cada palabra en
+ * cuanto se escribe. Los registros son __thread de la CPU y cambian en
+ * cada instruccion, por eso esos si se copian, pero solo cada tantos ciclos
+ * y con un seqlock: quien lee reintenta si le toco a media publicacion, y
+ * la CPU nunca espera a nadie.
+ *
+ * La memoria NO va dentro del seqlock: una palabra se puede leer a medias
+ * (signo nuevo con digitos viejos) y no corresponde exactamente a los
+ * registros publicados. Para ver algo exacto, que la maquina este parada.
+ *
+ * Un monitor externo incluye hardware.h, mapea el segmento de solo lectura
+ * y revisa magic, version y los tamaños antes de confiar en el resto (ver
+ * monitor_watch, que hace justo eso para --watch).
+ */
+
+int monitor_active = 0;
+
+static MonitorHeader *monitor;     // NULL = apagado
+static size_t monitor_bytes;
+static char monitor_name[64];
+
+static size_t monitor_size(int pages) {
+    return sizeof(MonitorHeader) + (size_t)pages * MEM_PAGE_WORDS * sizeof(Word);
+}
+
+// Los nombres POSIX empiezan con '/' (se lo ponemos si no lo trae)
+static int monitor_set_name(char *out, size_t size, const char *name) {
+    int n = snprintf(out, size, "%s%s", name[0] == '/' ? "" : "/", name);
+    if (n <= 1 || (size_t)n >= size || strchr(out + 1, '/')) {
+        printf("Error: Nombre de monitor invalido: %s\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+static long monitor_now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000L + t.tv_nsec;
+}
+
+/* =========================================================================
+ * LADO DE LA MAQUINA (un solo escritor: la CPU 0)
+ * ========================================================================= */
+
+void monitor_publish() {
+    MonitorHeader *h = monitor;
+    if (!h) return;
+    unsigned long seq = h->seq;
+    __atomic_store_n(&h->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    h->regs = cpu_registers;
+    h->cycles = cpu_cycle_count;
+    h->published_ns = monitor_now_ns();
+    h->publishes++;
+    h->bus_cpu_waits = bus_cpu_waits;
+    h->cache_stall_cycles = cache_stall_cycles;
+    h->pipeline_cycles = pipeline_enabled ? pipeline_cycles() : 0;
+    h->running = cpu_running;
+    h->idle_halt = cpu_idle_halt;
+    h->last_interrupt = cpu_last_interrupt;
+    h->cpus = smp_cpus;
+
+    __atomic_store_n(&h->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Crea el segmento y pasa la memoria a el. Uno que haya quedado con el
+ * mismo nombre (de una corrida que no termino bien) se borra primero.
+ * Retorna 0, o -1 si no se pudo.
+ */
+int monitor_open(const char *name) {
+    char path[sizeof(monitor_name)];
+    if (monitor_set_name(path, sizeof(path), name) < 0) return -1;
+    if (monitor) monitor_close();
+
+    int pages = (MEM_SIZE + MEM_PAGE_WORDS - 1) >> MEM_PAGE_SHIFT;
+    size_t bytes = monitor_size(pages);
+    shm_unlink(path);
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 || ftruncate(fd, bytes) < 0) {
+        printf("Error: No se pudo crear el monitor %s (%s)\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            shm_unlink(path);
+        }
+        return -1;
+    }
+    MonitorHeader *h = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // El mapeo se queda aunque se cierre
+    if (h == MAP_FAILED) {
+        printf("Error: No se pudo mapear el monitor %s (%s)\n", path, strerror(errno));
+        shm_unlink(path);
+        return -1;
+    }
+
+    // ftruncate lo deja en ceros; lo fijo se llena una vez
+    h->magic = MONITOR_MAGIC;
+    h->version = MONITOR_VERSION;
+    h->header_size = sizeof(MonitorHeader);
+    h->word_size = sizeof(Word);
+    h->registers_size = sizeof(Registers);
+    h->mem_size = MEM_SIZE;
+    h->os_mem_size = OS_MEM_SIZE;
+    h->page_words = MEM_PAGE_WORDS;
+
+    monitor = h;
+    monitor_bytes = bytes;
+    strcpy(monitor_name, path);
+    mem_set_backing(MONITOR_MEMORY(h), pages);
+    monitor_active = 1;
+    monitor_publish();
+    log_event("Monitor: %s con %d palabras (%zu bytes)", path, MEM_SIZE, bytes);
+    return 0;
+}
+
+// La memoria regresa al host y el segmento se borra
+void monitor_close() {
+    if (!monitor) return;
+    monitor_active = 0;
+    mem_set_backing(NULL, 0);
+    munmap(monitor, monitor_bytes);
+    shm_unlink(monitor_name);
+    log_event("Monitor: %s cerrado", monitor_name);
+    monitor = NULL;
+    monitor_name[0] = 0;
+}
+
+/* =========================================================================
+ * LADO DEL MONITOR (otro proceso, o el mismo para revisarse)
+ * ========================================================================= */
+
+// Mapea un segmento ajeno de solo lectura y revisa que sea de esta version
+static const MonitorHeader *monitor_attach(const char *name, size_t *bytes) {
+    char path[sizeof(monitor_name)];
+    if (monitor_set_name(path, sizeof(path), name) < 0) return NULL;
+    int fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        printf("Error: No hay monitor %s (%s)\n", path, strerror(errno));
+        return NULL;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    const MonitorHeader *h = MAP_FAILED;
+    if (size >= (off_t)sizeof(MonitorHeader)) h = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        printf("Error: El monitor %s no se pudo mapear\n", path);
+        return NULL;
+    }
+    if (h->magic != MONITOR_MAGIC || h->version != MONITOR_VERSION || h->header_size != sizeof(MonitorHeader) ||
+        h->word_size != sizeof(Word) || h->registers_size != sizeof(Registers) ||
+        monitor_size((h->mem_size + MEM_PAGE_WORDS - 1) >> MEM_PAGE_SHIFT) > (size_t)size) {
+        printf("Error: %s no es un monitor de esta version (v%u)\n", path, h->magic == MONITOR_MAGIC ? h->version : 0);
+        munmap((void *)h, size);
+        return NULL;
+    }
+    *bytes = size;
+    return h;
+}
+
+// Una copia consistente de lo publicado (reintenta si la CPU estaba a la mitad)
+static void monitor_read(const MonitorHeader *h, MonitorHeader *out) {
+    for (;;) {
+        unsigned long seq = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(out, h, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&h->seq, __ATOMIC_RELAXED) == seq) return;
+    }
+}
+
+/*
+ * --watch: imprime lo ultimo que publico la maquina y los rangos pedidos
+ * (con el formato del resumen de --batch). Retorna 0, o -1 si no hay monitor.
+ */
+int monitor_watch(const char *name, const int dumps[][2], int dump_count) {
+    size_t bytes;
+    const MonitorHeader *h = monitor_attach(name, &bytes);
+    if (!h) return -1;
+
+    MonitorHeader s;
+    monitor_read(h, &s);
+    const Registers *r = &s.regs;
+    printf("== MONITOR %s (v%u, %d palabras, %d CPU%s) ==\n", name, s.version, s.mem_size, s.cpus,
+           s.cpus == 1 ? "" : "s");
+    printf("PUBLICACION %ld hace %.3f s\n", s.publishes, (monitor_now_ns() - s.published_ns) / 1e9);
+    printf("CICLOS %ld (%s)\n", s.cycles, s.running ? "corriendo" : s.idle_halt ? "detenida" : "fin");
+    printf("AC [%d] %07d\n", r->AC.sign, r->AC.digits);
+    printf("PC %05d SP %05d RX %05d RB %05d RL %05d\n", r->PSW.pc, r->SP, r->RX, r->RB, r->RL);
+    printf("PSW CC=%d Modo=%d Int=%d\n", r->PSW.condition_code, r->PSW.operation_mode, r->PSW.interrupt_enable);
+    printf("IR Op=%02d Dir=%d Val=%05d\n", r->IR.cod_op, r->IR.direccionamiento, r->IR.valor);
+    printf("ULTIMA INT %d, BUS ocupado %ld veces, CACHE %ld ciclos de mas, PIPELINE %ld ciclos\n",
+           s.last_interrupt, s.bus_cpu_waits, s.cache_stall_cycles, s.pipeline_cycles);
+
+    const Word *mem = MONITOR_MEMORY(h);
+    for (int d = 0; d < dump_count; d++) {
+        for (int a = dumps[d][0]; a <= dumps[d][1]; a++) {
+            if (a < 0 || a >= s.mem_size) continue;
+            Word w = mem[a];
+            printf("MEM %05d [%d] %08d\n", a, w.sign, w.digits);
+        }
+    }
+    munmap((void *)h, bytes);
+    return 0;
+}
+
+/*
+ * "monitor" en la consola: publica lo de ahorita y lo vuelve a leer por
+ * otro mapeo, como lo haria un monitor externo, para ver que coincida.
+ */
+void monitor_print_stats(FILE *out) {
+    if (!monitor) {
+        fprintf(out, " Monitor: apagado (monitor <nombre>)\n");
+        return;
+    }
+    fprintf(out, " Monitor: %s, version %d, %d palabras (%zu bytes compartidos)\n", monitor_name,
+            MONITOR_VERSION, monitor->mem_size, monitor_bytes);
+    monitor_publish();
+    fprintf(out, "  Publicaciones: %ld (cada %d ciclos y al parar)\n", monitor->publishes, MONITOR_PUBLISH_CYCLES);
+
+    size_t bytes;
+    const MonitorHeader *h = monitor_attach(monitor_name, &bytes);
+    if (!h) return;
+    MonitorHeader s;
+    monitor_read(h, &s);
+    int regs_ok = memcmp(&s.regs, &cpu_registers, sizeof(Registers)) == 0 && s.cycles == cpu_cycle_count;
+    int mem_ok = 1;
+    const Word *mem = MONITOR_MEMORY(h);
+    bus_acquire();
+    for (int a = 0; a < MEM_SIZE && mem_ok; a++) {
+        Word w = mem_peek(a);
+        mem_ok = w.sign == mem[a].sign && w.digits == mem[a].digits;
+    }
+    sem_post(&system_bus_lock);
+    munmap((void *)h, bytes);
+    fprintf(out, "  Leido desde otro mapeo: registros %s, memoria %s\n", regs_ok ? "iguales" : "DISTINTOS",
+            mem_ok ? "igual" : "DISTINTA");
+}
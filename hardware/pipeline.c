@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#include "hardware.h"
+#include "../logger.h"
+
+/*
+ * MODO DE TIEMPOS (PIPELINE)
+ * cpu_cycle() hace una instruccion completa por llamada, asi que los
+ * "ciclos" de run/batch son instrucciones. Con esto prendido se estima
+ * cuantos ciclos de reloj tardaria una CPU con el pipeline clasico
+ *
+ *   F (fetch)  D (decode)  E (execute)  M (memoria)  W (writeback)
+ *
+ * con adelantamiento (forwarding). El modelo funcional no cambia: despues
+ * de cada instruccion se le cuenta al pipeline que paso y el suma:
+ *   - 1 ciclo por instruccion (+ PIPE_STAGES-1 para llenarlo al inicio)
+ *   - Riesgo de datos: si la anterior trae AC de memoria (LOAD, POP,
+ *     aritmetica con operando en memoria, que queda listo hasta M) y esta
+ *     usa AC en E, una burbuja
+ *   - Saltos tomados: J se resuelve en D (PIPE_J_PENALTY), los
+ *     condicionales y RETRN en E (PIPE_BRANCH_PENALTY); se predice "no salta"
+ *   - Interrupcion: se tira todo lo que venia atras (PIPE_STAGES-1)
+ *   - Memoria: si el simulador de cache esta prendido, lo que un acceso
+ *     tarde de mas sobre un acierto detiene el pipeline
+ *   - Bus: cada vez que la CPU encontro el bus tomado por el DMA
+ *
+ * Apagado (lo normal) cpu_cycle solo checa pipeline_enabled.
+ */
+
+int pipeline_enabled = 0;
+
+static struct {
+    long instructions;
+    long cycles;
+    long fill;
+    long data;              // Burbujas por AC que viene de memoria
+    long jumps;             // J tomados
+    long branches;          // Condicionales y RETRN tomados
+    long interrupts;
+    long memory;            // Ciclos de mas de la cache
+    long bus;               // Bus ocupado por el DMA
+} pipe;
+
+static int prev_ac_late;    // La instruccion anterior deja AC hasta M
+static long last_bus_waits;
+static long last_cache_stalls;
+
+// Usa AC en E (la ALU, la comparacion, el indexado o pasarlo a un registro)
+static int reads_ac(int op, int mode) {
+    int kind = isa_operand_kind(op);
+    if (mode == ADDR_INDEXED && (kind == ISA_ARG_DATA || kind == ISA_ARG_ADDR)) return 1;
+    switch (op) {
+        case OP_SUM: case OP_RES: case OP_MULT: case OP_DIVI: case OP_COMP:
+        case OP_JMPE: case OP_JMPNE: case OP_JMPLT: case OP_JMPLGT:
+        case OP_STRRX: case OP_STRRB: case OP_STRRL: case OP_STRSP:
+        case OP_STRPT: case OP_STRPL: case OP_SVC:
+            return 1;
+    }
+    return 0;
+}
+
+// Deja en AC algo que sale de memoria (listo hasta el final de M)
+static int writes_ac_late(int op, int mode) {
+    switch (op) {
+        case OP_LOAD: case OP_SUM: case OP_RES: case OP_MULT: case OP_DIVI:
+            return mode != ADDR_IMMEDIATE;
+        case OP_POP:
+            return 1;
+    }
+    return 0;
+}
+
+void pipeline_reset() {
+    memset(&pipe, 0, sizeof(pipe));
+    prev_ac_late = 0;
+    last_bus_waits = bus_cpu_waits;
+    last_cache_stalls = cache_stall_cycles;
+}
+
+/*
+ * Lo llama cpu_cycle despues de cada instruccion: op/mode/pc de la que se
+ * ejecuto, next_pc a donde quedo el PC y si genero una interrupcion.
+ * Con op < 0 es una interrupcion de hardware (no hubo instruccion).
+ */
+void pipeline_account(int op, int mode, int pc, int next_pc, int interrupted) {
+    long stall = 0;
+
+    if (op >= 0) {
+        if (pipe.instructions++ == 0) {
+            pipe.fill = PIPE_STAGES - 1;
+            stall += pipe.fill;
+        }
+        stall += 1;
+        if (prev_ac_late && reads_ac(op, mode)) {
+            pipe.data++;
+            stall++;
+        }
+        prev_ac_late = writes_ac_late(op, mode);
+    }
+
+    if (interrupted) {
+        pipe.interrupts += PIPE_STAGES - 1;
+        stall += PIPE_STAGES - 1;
+        prev_ac_late = 0;
+    } else if (next_pc != pc + 1) {
+        if (op == OP_J) {
+            pipe.jumps += PIPE_J_PENALTY;
+            stall += PIPE_J_PENALTY;
+        } else if (op == OP_JMPE || op == OP_JMPNE || op == OP_JMPLT || op == OP_JMPLGT || op == OP_RETRN) {
+            pipe.branches += PIPE_BRANCH_PENALTY;
+            stall += PIPE_BRANCH_PENALTY;
+        }
+    }
+
+    long waits = bus_cpu_waits - last_bus_waits;
+    long mem = cache_stall_cycles - last_cache_stalls;
+    last_bus_waits = bus_cpu_waits;
+    last_cache_stalls = cache_stall_cycles;
+    pipe.bus += waits * PIPE_BUS_STALL_CYCLES;
+    pipe.memory += mem;
+    pipe.cycles += stall + waits * PIPE_BUS_STALL_CYCLES + mem;
+}
+
+long pipeline_cycles() {
+    return pipe.cycles;
+}
+
+void pipeline_print_stats(FILE *out) {
+    if (!pipeline_enabled) {
+        fprintf(out, " Pipeline: apagado (pipeline on)\n");
+        return;
+    }
+    long stalls = pipe.data + pipe.jumps + pipe.branches + pipe.interrupts + pipe.memory + pipe.bus;
+    fprintf(out, " Pipeline F-D-E-M-W: %ld instrucciones en %ld ciclos, CPI %.3f\n", pipe.instructions,
+            pipe.cycles, pipe.instructions ? (double)pipe.cycles / pipe.instructions : 0.0);
+    fprintf(out, "  Llenado inicial      : %ld\n", pipe.fill);
+    fprintf(out, "  Detenido %ld ciclos:\n", stalls);
+    fprintf(out, "   AC desde memoria    : %ld\n", pipe.data);
+    fprintf(out, "   J tomados           : %ld\n", pipe.jumps);
+    fprintf(out, "   Condicionales/RETRN : %ld\n", pipe.branches);
+    fprintf(out, "   Interrupciones      : %ld\n", pipe.interrupts);
+    fprintf(out, "   Memoria (cache)     : %ld%s\n", pipe.memory, cache_enabled ? "" : " (cache apagada)");
+    fprintf(out, "   Bus tomado por DMA  : %ld\n", pipe.bus);
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include "hardware.h"
+#include "../logger.h"
+
+/*
+ * VARIAS CPUs (SMP)
+ * Con "smp <n>" (o --smp n) el run arranca n CPUs que comparten la memoria,
+ * los discos y el DMA. Cada una tiene sus registros y corre en su propio
+ * hilo del host: todo lo que es "de la CPU" (cpu_registers, cpu_running, la
+ * traduccion RB/RL, dma_selected...) es __thread, asi que cpu_cycle() es el
+ * mismo de siempre. La CPU 0 es el hilo principal (la que ve la consola).
+ *
+ * Todas arrancan con los registros que dejo el loader (mismo PC, RB y RL);
+ * la pila de la CPU n empieza SMP_STACK_WORDS * n palabras mas abajo. El
+ * programa sabe en cual va con LOADID.
+ *
+ * Modelo de memoria: cada acceso de cada CPU (el fetch tambien) toma el bus
+ * (system_bus_lock) y el semaforo es una barrera completa. Entonces todos
+ * los accesos quedan en un solo orden global que respeta el orden de cada
+ * programa (consistencia secuencial): si la CPU 0 escribe A y luego B, la
+ * que vea el B nuevo tambien ve el A nuevo. FAA lee y escribe con una sola
+ * toma del bus, nadie se mete en medio.
+ *
+ * Interrupciones:
+ *   - Las del DMA (INT 4) solo le llegan a la CPU 0
+ *   - "ipi n" le manda INT_IPI a la CPU n (AC = la que aviso) en cuanto
+ *     tenga las interrupciones habilitadas. Varias antes de que la atienda
+ *     cuentan como una.
+ *   - Un J a si misma con interrupciones habilitadas duerme hasta una IPI
+ *     mientras quede otra CPU corriendo. Si todas las que siguen estan
+ *     dormidas ya nadie va a avisar: se detienen todas (como una sola CPU)
+ *
+ * Si hay mas CPUs que nucleos en el host, cada SMP_YIELD_CYCLES
+ * instrucciones la CPU le cede el nucleo a otra (sched_yield): si no, una
+ * que espera a otra dando vueltas se come todo su turno del planificador
+ * (unos ms, decenas de miles de instrucciones) sin que la otra avance.
+ *
+ * No se puede junto con lo que guarda estado de UNA sola CPU: paginado
+ * (TLB), cache, pipeline, lockstep y el modo confiable del verificador.
+ */
+
+#define SMP_YIELD_CYCLES 1000
+
+typedef struct {
+    long cycles;
+    Registers regs;         // Como quedo al terminar
+    int halted;             // 0 = llego al limite de ciclos
+    int idle_halt;
+    long ipis_sent;
+    long ipis_received;
+} SmpCpu;
+
+int smp_cpus = 1;
+volatile int smp_ipi_sent = 0;
+
+static SmpCpu cpus[SMP_MAX_CPUS];
+static int ipi_lines[SMP_MAX_CPUS];     // Quien le aviso a cada CPU + 1 (0 = nadie)
+static Registers boot;                  // La CPU 0 al arrancar
+static long smp_max_cycles;
+static long yield_every;                // 0 = cada CPU tiene su nucleo
+static int running;                     // CPUs que siguen en su ciclo
+static int sleeping;                    // De esas, cuantas duermen en smp_wait_ipi
+static double last_secs;
+static int last_cpus;
+
+static pthread_mutex_t smp_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t smp_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t host_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void smp_lock() {
+    pthread_mutex_lock(&host_lock);
+}
+
+void smp_unlock() {
+    pthread_mutex_unlock(&host_lock);
+}
+
+// Lo que no se puede con varias CPUs (NULL = nada)
+static const char *smp_conflict() {
+    if (paging_enabled) return "paginado";
+    if (cache_enabled) return "cache";
+    if (pipeline_enabled) return "pipeline";
+    if (cpu_lockstep_every) return "lockstep";
+    return NULL;
+}
+
+int smp_configure(int n) {
+    if (n < 1 || n > SMP_MAX_CPUS) {
+        printf("Error: De 1 a %d CPUs\n", SMP_MAX_CPUS);
+        return -1;
+    }
+    const char *why = n > 1 ? smp_conflict() : NULL;
+    if (why) {
+        printf("Error: Con varias CPUs no se puede usar %s\n", why);
+        return -1;
+    }
+    smp_cpus = n;
+    log_event("SMP: %d CPUs", n);
+    return 0;
+}
+
+/* =========================================================================
+ * IPIs
+ * ========================================================================= */
+
+int smp_send_ipi(int target) {
+    if (target < 0 || target >= smp_cpus || target == cpu_id) return -1;
+    pthread_mutex_lock(&smp_mutex);
+    __atomic_store_n(&ipi_lines[target], cpu_id + 1, __ATOMIC_RELEASE);
+    smp_ipi_sent = 1;
+    cpus[cpu_id].ipis_sent++;
+    pthread_cond_broadcast(&smp_cond);
+    pthread_mutex_unlock(&smp_mutex);
+    return 0;
+}
+
+int smp_take_ipi() {
+    if (!__atomic_load_n(&ipi_lines[cpu_id], __ATOMIC_ACQUIRE)) return -1;
+    int from = __atomic_exchange_n(&ipi_lines[cpu_id], 0, __ATOMIC_ACQ_REL);
+    if (!from) return -1;
+    cpus[cpu_id].ipis_received++;
+    return from - 1;
+}
+
+int smp_wait_ipi() {
+    int woken = 1;
+    pthread_mutex_lock(&smp_mutex);
+    sleeping++;
+    for (;;) {
+        if (__atomic_load_n(&ipi_lines[cpu_id], __ATOMIC_ACQUIRE)) break;
+        // A la CPU 0 tambien la despierta el DMA (que no avisa por aqui)
+        if (cpu_id == 0 && __atomic_load_n(&interrupt_pending_dma, __ATOMIC_ACQUIRE)) break;
+        // Todas las que quedan duermen aqui: ya nadie nos va a avisar. Esta
+        // se detiene (running baja en smp_loop) y eso despierta a la
+        // siguiente, que ve lo mismo, hasta que no quede ninguna
+        if (sleeping >= running) {
+            pthread_cond_broadcast(&smp_cond);
+            woken = 0;
+            break;
+        }
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 1000000; // 1 ms
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&smp_cond, &smp_mutex, &until);
+    }
+    sleeping--;
+    pthread_mutex_unlock(&smp_mutex);
+    return woken;
+}
+
+/* =========================================================================
+ * CORRER
+ * ========================================================================= */
+
+static long smp_loop(int id) {
+    long cycles = 0;
+    while (cycles < smp_max_cycles && cpu_running) {
+        cpu_cycle();
+        cycles++;
+        if (yield_every && cycles % yield_every == 0) sched_yield();
+        if (monitor_active && id == 0 && cycles % MONITOR_PUBLISH_CYCLES == 0) monitor_publish();
+    }
+    SmpCpu *c = &cpus[id];
+    c->cycles = cycles;
+    c->regs = cpu_registers;
+    c->halted = !cpu_running;
+    c->idle_halt = cpu_idle_halt;
+
+    pthread_mutex_lock(&smp_mutex);
+    running--;
+    pthread_cond_broadcast(&smp_cond);
+    pthread_mutex_unlock(&smp_mutex);
+    return cycles;
+}
+
+static void *smp_thread(void *arg) {
+    int id = (int)((SmpCpu *)arg - cpus);
+    cpu_start_secondary(id, &boot);
+    smp_loop(id);
+    return NULL;
+}
+
+long smp_run(long max_cycles) {
+    const char *why = smp_conflict();
+    if (why) {
+        printf("Error: Con varias CPUs no se puede usar %s\n", why);
+        return 0;
+    }
+    cpu_trust_drop(); // El modo confiable es de una CPU
+
+    memset(cpus, 0, sizeof(cpus));
+    memset(ipi_lines, 0, sizeof(ipi_lines));
+    smp_ipi_sent = 0;
+    smp_max_cycles = max_cycles;
+    boot = cpu_registers;
+    running = smp_cpus;
+    sleeping = 0;
+    yield_every = smp_cpus > sysconf(_SC_NPROCESSORS_ONLN) ? SMP_YIELD_CYCLES : 0;
+    log_event("SMP: arrancando %d CPUs en PC %d", smp_cpus, boot.PSW.pc);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_t threads[SMP_MAX_CPUS];
+    int started = 1;
+    for (; started < smp_cpus; started++) {
+        int rc = pthread_create(&threads[started], NULL, smp_thread, &cpus[started]);
+        if (rc != 0) {
+            printf("Error: No se pudo arrancar la CPU %d (%s)\n", started, strerror(rc));
+            pthread_mutex_lock(&smp_mutex);
+            running -= smp_cpus - started;
+            pthread_mutex_unlock(&smp_mutex);
+            break;
+        }
+    }
+
+    long cycles = smp_loop(0); // La CPU 0 en este hilo
+    for (int n = 1; n < started; n++) pthread_join(threads[n], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    last_secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    last_cpus = started;
+    return cycles;
+}
+
+void smp_print_stats(FILE *out) {
+    if (!last_cpus) {
+        fprintf(out, " SMP: %d CPU%s (smp <n> para cambiar)\n", smp_cpus, smp_cpus == 1 ? "" : "s");
+        return;
+    }
+    long total = 0;
+    for (int n = 0; n < last_cpus; n++) total += cpus[n].cycles;
+    fprintf(out, " SMP: %d CPUs, %ld instrucciones en %.6f s (%.0f instr/s)\n", last_cpus, total, last_secs,
+            last_secs > 0 ? total / last_secs : 0.0);
+    for (int n = 0; n < last_cpus; n++) {
+        const SmpCpu *c = &cpus[n];
+        fprintf(out, "  CPU %-2d %10ld instrucciones  PC %05d AC %8d  %-8s IPIs %ld enviadas, %ld recibidas\n", n,
+                c->cycles, c->regs.PSW.pc, word_to_int(c->regs.AC),
+                !c->halted ? "limite" : c->idle_halt ? "detenida" : "fin", c->ipis_sent, c->ipis_received);
+    }
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include "hardware.h"
+#include "../logger.h"
+
+/*
+ * SERVICIOS DEL SISTEMA EN EL HOST
+ * Sin SO, un SVC era: guardar 4 palabras de contexto, buscar el vector,
+ * saltar al manejador por defecto (200) que solo hace RETRN y recuperar el
+ * contexto. Y no hacia nada.
+ *
+ * Mientras el vector de SVC siga apuntando a DEFAULT_HANDLER, los servicios
+ * de esta tabla se hacen aqui mismo en C, sin interrupcion. Si un SO pone
+ * su propio manejador en el vector, todos los SVC le llegan a el como
+ * siempre (asi puede reemplazar cualquier servicio). Un codigo que no esta
+ * en la tabla tambien va por la interrupcion.
+ *
+ * Los datos se leen de la pila: M[SP] es lo ultimo que se apilo.
+ */
+
+typedef void (*SvcService)(const Word *args);
+
+typedef struct {
+    const char *name;
+    int args;           // Cuantas palabras se leen de la pila
+    SvcService run;
+} SvcEntry;
+
+int svc_native = 1;
+static long svc_calls[SVC_MAX_CODE + 1];
+
+static void svc_put_number(const Word *args) {
+    char text[16];
+    console_write(text, snprintf(text, sizeof(text), "%d", word_to_int(args[0])));
+}
+
+static void svc_put_char(const Word *args) {
+    char c = (char)word_to_int(args[0]);
+    console_write(&c, 1);
+}
+
+static void svc_get_number(const Word *args) {
+    (void)args;
+    int value;
+    if (console_read_number(&value) < 0) {
+        cpu_registers.AC = int_to_word(0);
+        cpu_registers.PSW.condition_code = CC_OVERFLOW; // Ya no hay mas
+    } else {
+        cpu_registers.AC = int_to_word(value);
+    }
+}
+
+static void svc_get_char(const Word *args) {
+    (void)args;
+    cpu_registers.AC = int_to_word(console_read_char());
+}
+
+// Direcciones fisicas de [addr, addr + n) del programa. Si alguna no vale
+// (la traduccion ya genero la interrupcion) retorna -1.
+#define SVC_BLOCK 64
+static int svc_translate_block(int addr, int n, int *phys) {
+    for (int i = 0; i < n; i++) {
+        phys[i] = cpu_translate(addr + i);
+        if (phys[i] < 0 || phys[i] >= MEM_SIZE) return -1;
+    }
+    return 0;
+}
+
+/*
+ * Copiar y llenar: por bloques de SVC_BLOCK palabras, primero se traducen
+ * todas las direcciones (puede haber interrupcion) y luego se copia con una
+ * sola toma del bus. AC = 0 si todo bien, -1 si alguna direccion no valia
+ * (lo de antes de esa direccion ya quedo hecho). El -1 se pone antes de
+ * traducir para que sea el AC que guarda la interrupcion.
+ * La copia funciona aunque los rangos se encimen (como memmove).
+ */
+static void svc_mem_copy(const Word *args) {
+    int dst = word_to_int(args[0]);
+    int src = word_to_int(args[1]);
+    int count = word_to_int(args[2]);
+    int backwards = dst > src && dst < src + count;
+    int src_phys[SVC_BLOCK], dst_phys[SVC_BLOCK];
+    Word tmp[SVC_BLOCK];
+
+    cpu_registers.AC = int_to_word(-1);
+    for (int done = 0; done < count; done += SVC_BLOCK) {
+        int n = count - done < SVC_BLOCK ? count - done : SVC_BLOCK;
+        int off = backwards ? count - done - n : done;
+        if (svc_translate_block(src + off, n, src_phys) < 0 ||
+            svc_translate_block(dst + off, n, dst_phys) < 0) return;
+        bus_acquire();
+        for (int i = 0; i < n; i++) tmp[i] = mem_peek(src_phys[i]);
+        for (int i = 0; i < n; i++) mem_poke(dst_phys[i], tmp[i]);
+        sem_post(&system_bus_lock);
+    }
+    cpu_registers.AC = int_to_word(0);
+}
+
+static void svc_mem_fill(const Word *args) {
+    int dst = word_to_int(args[0]);
+    int count = word_to_int(args[2]);
+    int dst_phys[SVC_BLOCK];
+
+    cpu_registers.AC = int_to_word(-1);
+    for (int done = 0; done < count; done += SVC_BLOCK) {
+        int n = count - done < SVC_BLOCK ? count - done : SVC_BLOCK;
+        if (svc_translate_block(dst + done, n, dst_phys) < 0) return;
+        bus_acquire();
+        for (int i = 0; i < n; i++) mem_poke(dst_phys[i], args[1]);
+        sem_post(&system_bus_lock);
+    }
+    cpu_registers.AC = int_to_word(0);
+}
+
+static void svc_get_cycles(const Word *args) {
+    (void)args;
+    cpu_registers.AC = int_to_word((int)(cpu_cycle_count % 10000000));
+}
+
+static const SvcEntry svc_table[SVC_MAX_CODE + 1] = {
+    [SVC_PUT_NUMBER] = {"escribir numero",   1, svc_put_number},
+    [SVC_PUT_CHAR]   = {"escribir caracter", 1, svc_put_char},
+    [SVC_GET_NUMBER] = {"leer numero",       0, svc_get_number},
+    [SVC_GET_CHAR]   = {"leer caracter",     0, svc_get_char},
+    [SVC_MEM_COPY]   = {"copiar memoria",    3, svc_mem_copy},
+    [SVC_MEM_FILL]   = {"llenar memoria",    3, svc_mem_fill},
+    [SVC_GET_CYCLES] = {"leer ciclos",       0, svc_get_cycles},
+};
+
+// Lo llama la CPU en OP_SVC cuando el vector es el de por defecto
+int svc_call(int code) {
+    if (!svc_native || code <= 0 || code > SVC_MAX_CODE || !svc_table[code].run) return 0;
+
+    Word args[3];
+    if (svc_table[code].args) mem_read_block(cpu_registers.SP, args, svc_table[code].args);
+    svc_calls[code]++;
+    if (smp_cpus > 1) smp_lock(); // Consola y discos del host: una CPU a la vez
+    svc_table[code].run(args);
+    if (smp_cpus > 1) smp_unlock();
+    return 1;
+}
+
+void svc_print_stats() {
+    printf(" Servicios en el host: %s (si el SO no cambia el vector de SVC)\n",
+           svc_native ? "activos" : "apagados, todo va al manejador");
+    for (int code = 1; code <= SVC_MAX_CODE; code++) {
+        printf("  %d %-18s %ld llamadas\n", code, svc_table[code].name, svc_calls[code]);
+    }
+}
@@ -1,54 +1,157 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include "hardware.h"
 #include "loader.h"
 #include "logger.h"
+#include "verifier.h"
 
-int load_program(const char *filename) {
-    FILE *f = fopen(filename, "r");
-    if (!f) {
-        printf("Error: No se pudo abrir el archivo %s\n", filename);
+/*
+ * LOADER
+ * El programa se lee completo a un buffer de "staging" y solo si todo salio
+ * bien se copia a la memoria de un solo golpe (una sola toma del bus).
+ * Asi nunca queda un programa cargado a medias.
+ */
+
+// Capacidad inicial del buffer si no nos dicen .NumeroPalabras
+#define STAGING_INITIAL 256
+
+typedef struct {
+    Word *words;
+    int count;
+    int capacity;
+} StagingBuffer;
+
+static int staging_reserve(StagingBuffer *sb, int capacity) {
+    if (capacity <= sb->capacity) return 0;
+    Word *w = realloc(sb->words, sizeof(Word) * capacity);
+    if (!w) return -1;
+    sb->words = w;
+    sb->capacity = capacity;
+    return 0;
+}
+
+static double elapsed_ms(struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1000.0 + (t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/*
+ * Copia el buffer a memoria (+ Sentinel) con una sola toma del bus
+ */
+static void commit_program(StagingBuffer *sb, int start_address) {
+    cpu_trust_drop(); // Lo verificado era del programa anterior
+    bus_acquire();
+    for (int i = 0; i < sb->count; i++) {
+        mem_poke(start_address + i, sb->words[i]);
+    }
+
+    // INYECCION DE CENTINELA (END_PROGRAM)
+    // Escribimos el valor magico justo despues de la ultima instruccion
+    // para que la CPU se detenga sola.
+    int end = start_address + sb->count;
+    if (end < MEM_SIZE) {
+        Word sentinel;
+        sentinel.sign = 0;
+        sentinel.digits = SENTINEL_VAL;
+        mem_poke(end, sentinel);
+    }
+    sem_post(&system_bus_lock);
+
+    if (end < MEM_SIZE) log_event("Sentinel END_PROGRAM inyectado en %d", end);
+}
+
+/*
+ * Tabla de Paginas (solo en modo paginado)
+ * Mapeamos todo el espacio de usuario en orden: la pagina virtual v va al
+ * marco (primer marco de usuario + v). Queda igual que con RB/RL, pero el
+ * SO puede despues cambiar cualquier entrada para repartir marcos.
+ */
+static int build_page_table() {
+    int first_frame = (USER_MEM_START + VM_PAGE_SIZE - 1) / VM_PAGE_SIZE;
+    int pages = MEM_SIZE / VM_PAGE_SIZE - first_frame;
+    if (pages <= 0 || PAGE_TABLE_BASE + pages > OS_MEM_SIZE) {
+        printf("Error: La tabla de paginas (%d entradas) no cabe en el area del SO\n", pages);
+        log_event("Error carga: tabla de paginas de %d entradas no cabe", pages);
         return -1;
     }
 
-    char line[256];
-    int start_address = 0;
-    int instructions_loaded = 0;
-    
-    log_event("Iniciando carga de programa: %s", filename);
+    bus_acquire();
+    for (int v = 0; v < pages; v++) {
+        mem_poke(PAGE_TABLE_BASE + v, int_to_word(PTE_VALID + first_frame + v));
+    }
+    sem_post(&system_bus_lock);
 
-    while (fgets(line, sizeof(line), f)) {
+    cpu_registers.PTBR = PAGE_TABLE_BASE;
+    cpu_registers.PTLR = pages;
+    paging_set(1); // Recalcula lo vigilado y limpia la TLB
+    log_event("Tabla de paginas en %d: %d paginas desde el marco %d", PAGE_TABLE_BASE, pages, first_frame);
+    return 0;
+}
+
+int load_program_stream(FILE *f, const char *name) {
+    StagingBuffer sb = {NULL, 0, 0};
+    char *line = NULL;      // getline la hace crecer, no hay limite de largo
+    size_t line_cap = 0;
+    ssize_t len;
+    long bytes_read = 0;
+    int start_address = USER_MEM_START;
+    int declared_words = -1;
+    int rc = 0;
+
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    log_event("Iniciando carga de programa: %s", name);
+
+    while ((len = getline(&line, &line_cap, f)) != -1) {
+        bytes_read += len;
         // Remover salto de linea
-        line[strcspn(line, "\n")] = 0;
-        
+        line[strcspn(line, "\r\n")] = 0;
+
         // Ignorar lineas vacias
-        if (strlen(line) == 0) continue;
+        if (line[0] == 0) continue;
+
+        // Un "." solo marca el fin del programa (formato del enunciado).
+        // Asi se puede mandar por stdin y seguir usando la consola despues.
+        if (strcmp(line, ".") == 0) break;
 
         // Metadatos
         if (strncmp(line, "_start", 6) == 0) {
             sscanf(line, "_start %d", &start_address);
             // Validar que start_address esté en memoria USUARIO
-            if (start_address < USER_MEM_START) {
+            if (start_address < USER_MEM_START || start_address >= MEM_SIZE) {
                 printf("Error: Direccion de inicio invalida (Area de SO reservada)\n");
                 log_event("Error carga: _start %d invalido", start_address);
-                fclose(f);
-                return -1;
+                rc = -1;
+                break;
             }
-            cpu_registers.PSW.pc = start_address;
             log_event("Punto de entrada definido: %d", start_address);
         }
         else if (strncmp(line, ".NumeroPalabras", 15) == 0) {
-            // Informativo o para validación
-            int count;
-            sscanf(line, ".NumeroPalabras %d", &count);
-            log_event("Metadata: Palabras esperadas = %d", count);
+            // Validamos ANTES de tocar memoria que el programa quepa
+            sscanf(line, ".NumeroPalabras %d", &declared_words);
+            log_event("Metadata: Palabras esperadas = %d", declared_words);
+            if (declared_words < 0 || declared_words > MEM_SIZE - start_address) {
+                printf("Error: El programa (%d palabras desde %d) no cabe en memoria (%d)\n",
+                       declared_words, start_address, MEM_SIZE);
+                log_event("Error carga: %d palabras no caben desde %d", declared_words, start_address);
+                rc = -1;
+                break;
+            }
+            if (staging_reserve(&sb, declared_words) < 0) {
+                printf("Error: Sin memoria para el buffer de carga\n");
+                rc = -1;
+                break;
+            }
         }
         else if (strncmp(line, ".NombreProg", 11) == 0) {
             log_event("Metadata: Nombre Programa = %s", line + 12);
         }
         else if (line[0] == '.') {
-            // Fin de bloque o archivo
+            // Otro metadato que no conocemos
             continue;
         }
         else if (line[0] == '/') {
@@ -62,50 +165,91 @@ int load_program(const char *filename) {
             int instruction_val;
             // Asegurarnos que es numérico
             if (sscanf(line, "%d", &instruction_val) == 1) {
-                if (start_address + instructions_loaded >= MEM_SIZE) {
+                if (start_address + sb.count >= MEM_SIZE) {
                     printf("Error: Programa excede memoria disponible\n");
+                    log_event("Error carga: el programa excede la memoria en %d", start_address + sb.count);
+                    rc = -1;
                     break;
                 }
-                
-                // Convertir int a Word y guardar en memoria
-                Word w = int_to_word(instruction_val);
-                mem_write(start_address + instructions_loaded, w);
-                
-                // Log debug (verborrágico)
-                // log_event("Cargado [%d]: %08d", start_address + instructions_loaded, instruction_val);
-                
-                instructions_loaded++;
+                if (sb.count == sb.capacity &&
+                    staging_reserve(&sb, sb.capacity ? sb.capacity * 2 : STAGING_INITIAL) < 0) {
+                    printf("Error: Sin memoria para el buffer de carga\n");
+                    rc = -1;
+                    break;
+                }
+
+                // Convertir int a Word y guardar en el buffer
+                sb.words[sb.count++] = int_to_word(instruction_val);
             }
         }
     }
 
-    fclose(f);
-    
-    // INYECCION DE CENTINELA (END_PROGRAM)
-    // Escribimos el valor magico justo despues de la ultima instruccion
-    // para que la CPU se detenga sola.
-    if (start_address + instructions_loaded < MEM_SIZE) {
-        Word sentinel;
-        sentinel.sign = 0;
-        sentinel.digits = SENTINEL_VAL;
-        mem_write(start_address + instructions_loaded, sentinel);
-        // instructions_loaded++; // No contamos el sentinel como instruccion de usuario
-        log_event("Sentinel END_PROGRAM inyectado en %d", start_address + instructions_loaded);
+    // Si abortamos a mitad, descartamos el resto del programa hasta el "."
+    // para que (en stdin) no se confunda con comandos de la consola
+    if (rc != 0) {
+        while (getline(&line, &line_cap, f) != -1) {
+            line[strcspn(line, "\r\n")] = 0;
+            if (strcmp(line, ".") == 0) break;
+        }
     }
-    
-    printf("Programa cargado exitosamente. %d instrucciones (+ Sentinel).\n", instructions_loaded);
-    log_event("Carga finalizada. %d instrucciones en memoria.", instructions_loaded);
-    
-    // Configurar Registros Base y Limite para el proceso cargado
-    // Simplificación: Asignamos todo el espacio de usuario restante
-    cpu_registers.RB = USER_MEM_START;
-    cpu_registers.RL = MEM_SIZE - 1; // Hasta el final
-    // Pila al final de la memoria asignada
-    cpu_registers.SP = cpu_registers.RL;
-    cpu_registers.RX = cpu_registers.RL; // Base de pila (aprox)
-    
-    // Cambiar a MODO USUARIO para ejecutar (según spec, arrancamos en consola, luego user mode al correr)
-    // Pero el reset pone Kernel. El comando RUN cambiará a User.
-    
-    return 0;
+    free(line);
+
+    double parse_ms = elapsed_ms(&t0);
+
+    if (rc == 0 && paging_enabled) rc = build_page_table();
+
+    if (rc == 0) {
+        if (declared_words >= 0 && declared_words != sb.count) {
+            log_event("Aviso: .NumeroPalabras dice %d pero se leyeron %d", declared_words, sb.count);
+        }
+
+        commit_program(&sb, start_address);
+        cpu_registers.PSW.pc = start_address;
+
+        double secs = parse_ms / 1000.0;
+        printf("Programa cargado exitosamente. %d instrucciones (+ Sentinel).\n", sb.count);
+        printf("Parseo: %ld bytes en %.3f ms (%.0f palabras/s)\n", bytes_read, parse_ms,
+               secs > 0 ? sb.count / secs : 0.0);
+        log_event("Carga finalizada. %d instrucciones en memoria (%ld bytes, %.3f ms).",
+                  sb.count, bytes_read, parse_ms);
+
+        // Configurar Registros Base y Limite para el proceso cargado
+        // Simplificación: Asignamos todo el espacio de usuario restante
+        cpu_registers.RB = USER_MEM_START;
+        cpu_registers.RL = MEM_SIZE - 1; // Hasta el final
+        // Pila al final de la memoria asignada
+        cpu_registers.SP = cpu_registers.RL;
+        cpu_registers.RX = cpu_registers.RL; // Base de pila (aprox)
+        cpu_refresh_translation();
+
+        // Con RB/RL ya puestos: lo que se pueda correr sin chequeos
+        if (verify_enabled) {
+            int trusted = verify_program(start_address, sb.count, start_address);
+            printf("Verificador: %d instrucciones sin chequeos.\n", trusted);
+        }
+
+        // Cambiar a MODO USUARIO para ejecutar (según spec, arrancamos en consola, luego user mode al correr)
+        // Pero el reset pone Kernel. El comando RUN cambiará a User.
+    } else {
+        log_event("Carga abortada, la memoria no se modifico.");
+    }
+
+    free(sb.words);
+    return rc;
+}
+
+int load_program(const char *filename) {
+    // "-" = leer de la entrada estandar (pipes)
+    if (strcmp(filename, "-") == 0) {
+        return load_program_stream(stdin, "<stdin>");
+    }
+
+    FILE *f = fopen(filename, "r");
+    if (!f) {
+        printf("Error: No se pudo abrir el archivo %s\n", filename);
+        return -1;
+    }
+    int rc = load_program_stream(f, filename);
+    fclose(f);
+    return rc;
 }
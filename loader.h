@@ -1,8 +1,14 @@
 #ifndef LOADER_H
 #define LOADER_H
 
+#include <stdio.h>
+
 // Carga un programa desde un archivo de texto a la memoria
-// Retorna 0 si éxito, -1 si error.
+// Si filename es "-" se lee de la entrada estandar (hasta EOF o una linea ".")
+// Retorna 0 si éxito, -1 si error (en ese caso la memoria no se toca).
 int load_program(const char *filename);
 
+// Igual, pero desde un stream ya abierto (stdin, pipes, sockets...)
+int load_program_stream(FILE *f, const char *name);
+
 #endif // LOADER_H
@@ -4,6 +4,9 @@
 #include "logger.h"
 
 static FILE *log_file = NULL;
+static int muted = 0;
+static int console_on = 1;
+static __thread int last_interrupt = -1;  // Ver log_last_interrupt
 
 void logger_init(const char *filename) {
     log_file = fopen(filename, "w");
@@ -19,8 +22,16 @@ void logger_close() {
     }
 }
 
+void logger_mute(int mute) {
+    muted = mute;
+}
+
+void logger_console(int on) {
+    console_on = on;
+}
+
 void log_event(const char *format, ...) {
-    if (!log_file) return;
+    if (!log_file || muted) return;
 
     va_list args;
     
@@ -38,13 +49,24 @@ void log_event(const char *format, ...) {
 }
 
 void log_interrupt(int code, const char *description) {
+    last_interrupt = code;
+
     // Imprimir en Log
     log_event("INTERRUPCION Generada: Codigo %d - %s", code, description);
     
     // Imprimir en Salida Estándar (Consola) como pide el requerimiento
+    if (muted || !console_on) return;
     printf("\n!!! INTERRUPCION: Codigo %d - %s !!!\n", code, description);
 }
 
+int log_last_interrupt() {
+    return last_interrupt;
+}
+
+void log_last_interrupt_reset() {
+    last_interrupt = -1;
+}
+
 void log_instruction(int pc, const char *mnemonic, int operand) {
     log_event("Ejecutando [PC: %05d]: %s %05d", pc, mnemonic, operand);
 }
@@ -7,12 +7,23 @@ void logger_init(const char *filename);
 // Cierra el archivo de log
 void logger_close();
 
+// Silencia (1) o reactiva (0) el log y la consola (pruebas masivas)
+void logger_mute(int mute);
+
+// Apaga (0) o prende (1) el eco de interrupciones en la consola
+void logger_console(int on);
+
 // Registra un mensaje en el log (y opcionalmente en stdout)
 void log_event(const char *format, ...);
 
 // Registra una interrupción (Log + Stdout obligatoriamente)
 void log_interrupt(int code, const char *description);
 
+// Ultimo codigo que paso por log_interrupt en este hilo (-1 = ninguno),
+// aunque el log este silenciado. Lo usa el selftest para comparar.
+int log_last_interrupt();
+void log_last_interrupt_reset();
+
 // Registra una instrucción ejecutada (para debug)
 void log_instruction(int pc, const char *mnemonic, int operand);
 
@@ -3,8 +3,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
 #include "hardware.h"
 #include "loader.h"
+#include "assembler.h"
+#include "fuzzer.h"
+#include "server.h"
+#include "verifier.h"
 #include "logger.h"
 
 // Este es el programa principal.
@@ -12,11 +17,32 @@
 
 void print_help() {
     printf("\n--- MUNDO DE CONTROL ---\n");
-    printf(" load <archivo> : Carga tu programa a memoria\n");
+    printf(" load <archivo> : Carga tu programa a memoria (\"-\" = stdin, termina en \".\")\n");
+    printf(" asm <fuente> <salida> [-O] : Ensambla mnemonicos (-O optimiza)\n");
     printf(" run            : Corre todo de un jalon (hasta que termine o se cicle)\n");
     printf(" debug          : Corre paso a paso para ver que pasa\n");
     printf(" registers      : Chismea como estan los registros ahorita\n");
     printf(" memory <dir>   : Ve que hay en esa direccion de memoria\n");
+    printf(" meminfo        : Tamaño de la memoria y paginas usadas en el host\n");
+    printf(" memdump <desde> <hasta> <archivo> [texto|bin] : Guarda un rango (bin = imagen)\n");
+    printf(" memfill <desde> <hasta> <valor> : Llena un rango con un valor\n");
+    printf(" memfind <desde> <hasta> <valor>... : Busca un valor o una secuencia\n");
+    printf(" memdiff <imagen> : Compara la memoria contra un memdump bin\n");
+    printf(" paging [on|off]: Memoria paginada con TLB (antes de load) / estadisticas\n");
+    printf(" disk [<n>] [attach <imagen> [C P S]] : Info de los discos / conecta otro\n");
+    printf(" dma [sync|async]: Estadisticas de los canales DMA / terminar dentro de SDMAON\n");
+    printf(" diskcache [<n>|off|flush] : Buffer de n sectores por canal con read-ahead\n");
+    printf(" console [input <archivo>] : Estadisticas de la consola / de donde lee\n");
+    printf(" svc [on|off]   : Servicios del sistema en el host (sin SO) / llamadas\n");
+    printf(" cache [off|reset|i|d|l2 <palabras> <linea> <vias> [wb|wt]] : Simulador de cache\n");
+    printf(" pipeline [on|off|reset] : Modo de tiempos (ciclos de reloj, CPI y burbujas)\n");
+    printf(" verify [on|off]: Verificar al cargar y correr sin chequeos lo verificado\n");
+    printf(" lockstep [<n>|off] : Compara cada instruccion con la referencia (memoria cada n)\n");
+    printf(" smp [<n>]      : Correr con n CPUs que comparten la memoria / estadisticas\n");
+    printf(" monitor [<nombre>|off] : Memoria y registros en memoria compartida (para --watch)\n");
+    printf(" selftest       : Compara los manejadores especializados con los genericos\n");
+    printf(" bench int [n]  : Mide la latencia de entrar y salir de una interrupcion\n");
+    printf(" bench dma [n] [us] : E/S con 1..%d canales a la vez (n por canal, busqueda en us)\n", DMA_CHANNELS);
     printf(" exit           : Vamonos\n");
     printf("----------------------------\n");
 }
@@ -29,6 +55,9 @@ void show_registers() {
     printf(" SP (Pila)      : %05d\n", cpu_registers.SP);
     printf(" PSW (Estado)   : CC=%d Modo=%d (0=Usuario, 1=Kernel) Int=%d\n", cpu_registers.PSW.condition_code, cpu_registers.PSW.operation_mode, cpu_registers.PSW.interrupt_enable);
     printf(" IR (Instrucc)  : Op=%02d Dir=%d Val=%05d\n", cpu_registers.IR.cod_op, cpu_registers.IR.direccionamiento, cpu_registers.IR.valor);
+    if (paging_enabled) {
+        printf(" PTBR/PTLR      : %05d / %d  MAR=%d\n", cpu_registers.PTBR, cpu_registers.PTLR, word_to_int(cpu_registers.MAR));
+    }
 }
 
 // El Modo Debugger: te deja dar ENTER para avanzar
@@ -37,6 +66,7 @@ void debug_loop() {
     printf("Dale ENTER para avanzar, o escribe 'q' para salir.\n");
     
     cpu_running = 1; // Asegurar que la CPU esta activa
+    cpu_idle_halt = 0;
     
     char buf[10];
     while (1) {
@@ -47,11 +77,17 @@ void debug_loop() {
         
         // Ejecutamos solo UN ciclo de reloj
         cpu_cycle();
+        if (monitor_active) monitor_publish();
+        console_flush(); // Paso a paso se ve todo lo que escribe
         
         // Mostramos que paso
         printf(" ... Ejecutado. Nuevo estado:\n");
         show_registers();
         
+        if (!cpu_running && cpu_idle_halt) {
+             printf("\n>>> CPU DETENIDA: se quedo en un J a si misma sin E/S pendiente. Saliendo de Debug. <<<\n");
+             break;
+        }
         if (!cpu_running) {
              printf("\n>>> FIN DE PROGRAMA Detectado. Saliendo de Debug. <<<\n");
              break;
@@ -59,41 +95,463 @@ void debug_loop() {
     }
 }
 
-// El Modo Normal: corre rapido
-void run_normal() {
-    printf("\n*** EJECUTANDO MODO RAPIDO ***\n");
-    printf("Si se cicla, usa Ctrl+C :)\n");
-    
-    // Le puse un limite por si acaso hacen un loop infinito los alumnos
-    int cycles = 0;
+/* =========================================================================
+ * RANGOS DE MEMORIA (memdump, memfill, memfind, memdiff)
+ * Cada comando toma el bus una sola vez (mem_range_* en memory.c) y lo
+ * lento (archivos, printf) se hace ya con el bus suelto.
+ * La imagen binaria es MemImage y luego las palabras tal cual estan en
+ * memoria (del host: no se lleva entre maquinas de distinto endianness).
+ * No hay volcado en hexadecimal: las palabras son signo y digitos
+ * decimales, el texto usa el formato de las lineas MEM de --batch.
+ * ========================================================================= */
+
+#define MEM_RANGE_SHOW    16        // Direcciones que se listan (el total siempre)
+#define MEM_FIND_MAX      8         // Palabras del patron de memfind
+#define MEM_IMAGE_MAGIC   "MEMIMG1"
+#define MEM_VALUE_MAX     99999999  // 8 digitos (como SENTINEL_VAL)
+
+typedef struct {
+    char magic[8];
+    int from;       // Direccion de la primera palabra
+    int count;      // Cuantas vienen despues
+} MemImage;
+
+static int mem_range_valid(int from, int to) {
+    if (from < 0 || to >= MEM_SIZE || from > to) {
+        printf("Error: Rango invalido %d-%d (la memoria es 0-%d)\n", from, to, MEM_SIZE - 1);
+        return 0;
+    }
+    return 1;
+}
+
+// Un valor de memfill/memfind (entero con signo, nada mas). 0 si no sirve
+static int mem_parse_value(const char *text, Word *out) {
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end || value < -MEM_VALUE_MAX || value > MEM_VALUE_MAX) {
+        printf("Error: Valor invalido: %s\n", text);
+        return 0;
+    }
+    *out = int_to_word((int)value);
+    return 1;
+}
+
+static void mem_range_list(const int *addrs, int shown, int total) {
+    printf(" ");
+    for (int i = 0; i < shown; i++) printf(" %05d", addrs[i]);
+    printf("%s\n", total > shown ? " ..." : "");
+}
+
+static void mem_dump_file(int from, int to, const char *file, int binary) {
+    int n = to - from + 1;
+    Word *buf = malloc(n * sizeof(Word));
+    if (!buf) {
+        printf("Error: Sin memoria para copiar %d palabras\n", n);
+        return;
+    }
+    mem_range_read(from, n, buf);
+
+    FILE *f = fopen(file, binary ? "wb" : "w");
+    if (!f) {
+        printf("Error: No se pudo crear %s\n", file);
+        free(buf);
+        return;
+    }
+    if (binary) {
+        MemImage h = {MEM_IMAGE_MAGIC, from, n};
+        fwrite(&h, sizeof(h), 1, f);
+        fwrite(buf, sizeof(Word), n, f);
+    } else {
+        for (int i = 0; i < n; i++) fprintf(f, "MEM %05d [%d] %08d\n", from + i, buf[i].sign, buf[i].digits);
+    }
+    fclose(f);
+    free(buf);
+    printf(" %d palabras (%d-%d) guardadas en %s (%s)\n", n, from, to, file, binary ? "imagen" : "texto");
+}
+
+static void mem_find_words(int from, int to, char *values) {
+    Word pattern[MEM_FIND_MAX];
+    int len = 0;
+    for (char *t = strtok(values, " "); t; t = strtok(NULL, " ")) {
+        if (len == MEM_FIND_MAX) {
+            printf("Error: El patron puede tener hasta %d palabras\n", MEM_FIND_MAX);
+            return;
+        }
+        if (!mem_parse_value(t, &pattern[len++])) return;
+    }
+    int hits[MEM_RANGE_SHOW];
+    int count = mem_range_find(from, to - from + 1, pattern, len, hits, MEM_RANGE_SHOW);
+    printf(" %d %s en %d-%d\n", count, count == 1 ? "vez" : "veces", from, to);
+    if (count) mem_range_list(hits, count < MEM_RANGE_SHOW ? count : MEM_RANGE_SHOW, count);
+}
+
+static void mem_diff_file(const char *file) {
+    FILE *f = fopen(file, "rb");
+    if (!f) {
+        printf("Error: No se pudo abrir %s\n", file);
+        return;
+    }
+    MemImage h;
+    Word *image = NULL;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, MEM_IMAGE_MAGIC, sizeof(h.magic)) != 0) {
+        printf("Error: %s no es una imagen de memdump bin\n", file);
+    } else if (h.from < 0 || h.from >= MEM_SIZE || h.count <= 0 || h.count > MEM_SIZE - h.from) {
+        // La cabecera viene de un archivo: se revisa sin sumar (no se desborde)
+        printf("Error: %s trae un rango invalido (la memoria es 0-%d)\n", file, MEM_SIZE - 1);
+    } else {
+        image = malloc(h.count * sizeof(Word));
+        if (!image || fread(image, sizeof(Word), h.count, f) != (size_t)h.count) {
+            printf("Error: %s viene incompleta\n", file);
+            free(image);
+            image = NULL;
+        }
+    }
+    fclose(f);
+    if (!image) return;
+
+    int diffs[MEM_RANGE_SHOW];
+    int count = mem_range_diff(h.from, h.count, image, diffs, MEM_RANGE_SHOW);
+    printf(" %d de %d palabras distintas (%d-%d)\n", count, h.count, h.from, h.from + h.count - 1);
+    for (int i = 0; i < count && i < MEM_RANGE_SHOW; i++) {
+        Word old = image[diffs[i] - h.from], now = mem_read(diffs[i]);
+        printf("  %05d: [%d] %08d -> [%d] %08d\n", diffs[i], old.sign, old.digits, now.sign, now.digits);
+    }
+    if (count > MEM_RANGE_SHOW) printf("  ...\n");
+    free(image);
+}
+
+// Limite de ciclos por si acaso hacen un loop infinito los alumnos
+#define RUN_MAX_CYCLES 100000
+
+// Corre en MODO USUARIO hasta que termine o se acaben los ciclos.
+// Retorna cuantos ciclos se ejecutaron.
+long run_cycles(long max_cycles) {
+    long cycles = 0;
     
     // Cambiar a MODO USUARIO para que sirva la proteccion de memoria
     cpu_registers.PSW.operation_mode = MODE_USER;
+    cpu_refresh_translation();
     cpu_running = 1; // Reactivar CPU si estaba detenida
+    cpu_idle_halt = 0;
     
+    // Varias CPUs: cada una en su hilo (ver smp.c)
+    if (smp_cpus > 1) {
+        cycles = smp_run(max_cycles);
+    }
+    // Lockstep: cada instruccion se compara contra la referencia (lento)
+    else if (cpu_lockstep_every) {
+        if (cpu_lockstep_start() < 0) return 0;
+        while (cycles < max_cycles && cpu_running) {
+            cpu_lockstep_cycle();
+            cycles++;
+        }
+        cpu_lockstep_stop();
+    }
+    // Monitor: el mismo ciclo, pero publicando los registros de vez en cuando
+    // (aparte para que sin monitor el ciclo de siempre no cheque nada)
+    else if (monitor_active) {
+        while (cycles < max_cycles && cpu_running) {
+            cpu_cycle();
+            if (++cycles % MONITOR_PUBLISH_CYCLES == 0) monitor_publish();
+        }
+    }
+    else {
+        while (cycles < max_cycles && cpu_running) {
+            cpu_cycle();
+            cycles++;
+        }
+    }
+    if (monitor_active) monitor_publish(); // Como quedo al parar
+    return cycles;
+}
+
+// El Modo Normal: corre rapido
+void run_normal() {
+    printf("\n*** EJECUTANDO MODO RAPIDO ***\n");
+    printf("Si se cicla, usa Ctrl+C :)\n");
     printf("[Simulador] Cambiando a Modo USUARIO para ejecucion.\n");
     
-    while (cycles < 100000 && cpu_running) { // 100k ciclos es suficiente para pruebas
-        cpu_cycle();
-        cycles++;
-        
-        // El chequeo de ceros ya no es necesario con el Sentinel
-        // Pero lo dejamos por si acaso.
-    }
+    run_cycles(RUN_MAX_CYCLES); // 100k ciclos es suficiente para pruebas
+    console_flush();
     
-    if (!cpu_running) {
+    if (cpu_idle_halt) {
+        printf("\n>>> Programa detenido: se quedo en un J a si misma sin E/S pendiente <<<\n");
+    } else if (!cpu_running) {
         printf("\n>>> Programa finalizado correctamente (END_PROGRAM) <<<\n");
     } else {
         printf("Terminamos la ejecucion (limite de ciclos).\n");
     }
+    if (pipeline_enabled) {
+        printf("Con el pipeline serian %ld ciclos de reloj (\"pipeline\" para el detalle)\n", pipeline_cycles());
+    }
+}
+
+/* =========================================================================
+ * MODO BATCH (sin consola)
+ * Carga un programa, lo corre como "run" y escribe un resumen fijo:
+ * registros, rangos de memoria y la secuencia de interrupciones. Es lo que
+ * usan las pruebas "golden" (tests/run_golden.sh). El rendimiento va aparte
+ * (a stderr) porque cambia de corrida en corrida.
+ * ========================================================================= */
+
+#define MAX_DUMPS 32
+
+typedef struct {
+    int mem_size;
+    int os_size;
+    const char *batch_program;  // NULL = consola interactiva
+    int dumps[MAX_DUMPS][2];    // Rangos [desde, hasta] a imprimir
+    int dump_count;
+    long max_cycles;
+    int use_log;
+    const char *fuzz_dir;       // NULL = no fuzzear
+    const char *server_path;    // Socket del servidor (NULL = no es servidor)
+    const char *client_path;    // Socket al que se manda stdin (--client)
+    int jobs;                   // Procesos del fuzzer/servidor (0 = uno por nucleo)
+    int fuzz_seconds;           // 0 = hasta Ctrl+C
+    unsigned long fuzz_seed;
+    const char *console_input;  // NULL = la consola no tiene entrada
+    const char *disk_files[DMA_CHANNELS]; // Uno por canal, en orden (ninguno = virtual_disk.bin)
+    int disk_count;
+    int disk_geometry[3];       // Cilindros, pistas, sectores (0 = por defecto)
+    int cache[4];               // Palabras, linea, vias, write-back (0 = sin cache)
+    int smp_cpus;               // CPUs (0 = una)
+    int diskcache;              // Sectores del buffer por canal (0 = sin buffer)
+    const char *monitor_name;   // Segmento compartido (NULL = sin monitor)
+    const char *watch_name;     // Monitor a leer (--watch)
+} Options;
+
+static Options options = {
+    MEM_SIZE_DEFAULT, OS_MEM_SIZE_DEFAULT, NULL, {{0, 0}}, 0, RUN_MAX_CYCLES, 1,
+    NULL, NULL, NULL, 0, 0, 0, NULL, {NULL}, 0, {0, 0, 0}, {0, 0, 0, 0}, 0, 0, NULL, NULL
+};
+
+// El resumen de un trabajo (batch o servidor): registros, interrupciones
+// y los rangos de memoria pedidos
+static void print_summary(const char *name, int loaded, long cycles, const int dumps[][2], int dump_count) {
+    printf("== RESUMEN %s ==\n", name);
+    printf("CARGA %s\n", loaded ? "OK" : "ERROR");
+    printf("CICLOS %ld (%s)\n", cycles, !loaded ? "sin carga" : cpu_running ? "limite" :
+           cpu_idle_halt ? "detenida" : "fin");
+    printf("AC [%d] %07d\n", cpu_registers.AC.sign, cpu_registers.AC.digits);
+    printf("PC %05d SP %05d RX %05d RB %05d RL %05d\n", cpu_registers.PSW.pc, cpu_registers.SP,
+           cpu_registers.RX, cpu_registers.RB, cpu_registers.RL);
+    printf("PSW CC=%d Modo=%d Int=%d\n", cpu_registers.PSW.condition_code,
+           cpu_registers.PSW.operation_mode, cpu_registers.PSW.interrupt_enable);
+    printf("IR Op=%02d Dir=%d Val=%05d\n", cpu_registers.IR.cod_op,
+           cpu_registers.IR.direccionamiento, cpu_registers.IR.valor);
+    cpu_trace_print(stdout);
+    for (int d = 0; d < dump_count; d++) {
+        for (int a = dumps[d][0]; a <= dumps[d][1]; a++) {
+            Word w = mem_read(a);
+            printf("MEM %05d [%d] %08d\n", a, w.sign, w.digits);
+        }
+    }
+}
+
+int run_batch() {
+    logger_console(0); // Las interrupciones van al resumen, no a la pantalla
+    cpu_trace_reset();
+
+    int loaded = load_program(options.batch_program) == 0;
+    long cycles = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (loaded) cycles = run_cycles(options.max_cycles);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    console_flush(); // Lo que escribio el programa va antes del resumen
+
+    print_summary(options.batch_program, loaded, cycles, options.dumps, options.dump_count);
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "RENDIMIENTO %ld instrucciones en %.6f s (%.0f instr/s)\n",
+            cycles, secs, secs > 0 ? cycles / secs : 0.0);
+    if (cache_enabled) cache_print_stats(stderr);
+    if (pipeline_enabled) pipeline_print_stats(stderr);
+    if (verify_enabled) verify_print_report(stderr);
+    if (cpu_lockstep_every) cpu_lockstep_print_stats(stderr);
+    if (smp_cpus > 1) smp_print_stats(stderr);
+    if (diskcache_sectors) diskcache_print_stats(stderr);
+    if (monitor_active) monitor_print_stats(stderr);
+    if (!loaded) return 2;
+    return cpu_lockstep_every && !cpu_lockstep_ok() ? 3 : 0;
 }
 
-int main() {
+// Un trabajo del servidor: igual que batch, pero el programa viene del socket
+// y la maquina ya esta reiniciada
+static void server_job(FILE *in, const ServerJob *job) {
+    int loaded = load_program_stream(in, job->name) == 0;
+    long cycles = loaded ? run_cycles(job->max_cycles) : 0;
+    console_flush();
+    print_summary(job->name, loaded, cycles, job->dumps, job->dump_count);
+}
+
+// Opciones de arranque:
+//   --mem <palabras>  Tamaño de la RAM (hasta MEM_SIZE_MAX)
+//   --os <palabras>   Cuantas son del Sistema Operativo (= USER_MEM_START)
+//   --batch <prog>    Sin consola: carga, corre e imprime un resumen
+//   --dump <a>-<b>    (batch) Rango de memoria a imprimir, se puede repetir
+//   --cycles <n>      (batch) Limite de ciclos (por defecto 100000)
+//   --nolog           No escribir virtual_machine.log
+//   --input <archivo> De donde lee la consola (SVC_GET_*, "-" = stdin)
+//   --nosvc           Todo SVC va al manejador del programa (sin servicios del host)
+//   --noidle          Un J a si misma corre hasta el limite (para medir rendimiento)
+//   --dma-sync        El DMA termina dentro de SDMAON, sin hilo ni busqueda
+//                     (resultados repetibles, para las pruebas)
+//   --disk <imagen>   Disco a conectar (por defecto virtual_disk.bin). Repetido
+//                     conecta el siguiente canal DMA (0, 1, ...)
+//   --geometry CxPxS  Geometria si la imagen es nueva (cilindros x pistas x sectores)
+//   --cache P/L/V[/wt] Simula L1 de instrucciones y de datos (P palabras, lineas
+//                     de L, V vias; write-back salvo /wt). En batch reporta a stderr
+//   --pipeline        Modo de tiempos: en batch reporta ciclos de reloj y CPI a stderr
+//   --verify          Verifica el programa al cargar y corre lo verificado sin
+//                     chequeos (ver verifier.c). En batch reporta a stderr
+//   --lockstep <n>    Corre cada instruccion tambien con la implementacion de
+//                     referencia y compara (la memoria cada n). En batch sale
+//                     con 3 si hubo diferencia
+//   --smp <n>         Corre con n CPUs que comparten memoria y discos, cada una
+//                     en su hilo (ver smp.c). En batch reporta a stderr
+//   --diskcache <n>   Buffer de n sectores por canal en el controlador del disco
+//                     (read-ahead de la pista y write-back, ver diskcache.c)
+//   --monitor <nombre> Memoria, registros y contadores en un segmento de
+//                     memoria compartida POSIX para verlos desde otro proceso
+//                     mientras corre (ver monitor.c). Se borra al salir
+//   --watch <nombre>  Lee ese monitor, imprime registros y los --dump y sale
+//   --fuzz <dir>      Fuzzea CPU y loader, hallazgos en <dir> (ver fuzzer.h)
+//   --server <socket> Corre los programas que lleguen al socket (ver server.h)
+//   --client <socket> Manda stdin al servidor y escribe lo que conteste
+//   --jobs <n>        (fuzz/server) Procesos en paralelo (por defecto uno por nucleo)
+//   --time <s>        (fuzz) Segundos a correr (por defecto hasta Ctrl+C)
+//   --seed <n>        (fuzz) Semilla (por defecto la hora)
+int parse_options(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mem") == 0 && i + 1 < argc) {
+            options.mem_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--os") == 0 && i + 1 < argc) {
+            options.os_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            options.batch_program = argv[++i];
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc && options.dump_count < MAX_DUMPS) {
+            int *range = options.dumps[options.dump_count++];
+            if (sscanf(argv[++i], "%d-%d", &range[0], &range[1]) != 2) range[1] = range[0];
+        } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            options.max_cycles = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--nolog") == 0) {
+            options.use_log = 0;
+        } else if (strcmp(argv[i], "--noidle") == 0) {
+            cpu_idle_detect = 0;
+        } else if (strcmp(argv[i], "--dma-sync") == 0) {
+            dma_synchronous = 1;
+        } else if (strcmp(argv[i], "--nosvc") == 0) {
+            svc_native = 0;
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            options.console_input = argv[++i];
+        } else if (strcmp(argv[i], "--disk") == 0 && i + 1 < argc && options.disk_count < DMA_CHANNELS) {
+            options.disk_files[options.disk_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--geometry") == 0 && i + 1 < argc) {
+            int *g = options.disk_geometry;
+            if (sscanf(argv[++i], "%dx%dx%d", &g[0], &g[1], &g[2]) != 3) g[0] = -1;
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            int *c = options.cache;
+            char policy[4] = "wb";
+            if (sscanf(argv[++i], "%d/%d/%d/%3s", &c[0], &c[1], &c[2], policy) < 3) c[0] = -1;
+            c[3] = strcmp(policy, "wt") != 0;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipeline_enabled = 1;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify_enabled = 1;
+        } else if (strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc) {
+            cpu_lockstep_every = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--diskcache") == 0 && i + 1 < argc) {
+            options.diskcache = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--monitor") == 0 && i + 1 < argc) {
+            options.monitor_name = argv[++i];
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            options.watch_name = argv[++i];
+        } else if (strcmp(argv[i], "--smp") == 0 && i + 1 < argc) {
+            options.smp_cpus = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc) {
+            options.fuzz_dir = argv[++i];
+        } else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) {
+            options.server_path = argv[++i];
+        } else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc) {
+            options.client_path = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            options.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc) {
+            options.fuzz_seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options.fuzz_seed = strtoul(argv[++i], NULL, 10);
+        } else {
+            printf("Uso: %s [--mem <palabras>] [--os <palabras>] [--nolog] [--nosvc] [--noidle] [--dma-sync] [--input <archivo>]\n", argv[0]);
+            printf("       [--disk <imagen>]... [--geometry <cil>x<pistas>x<sectores>]\n");
+            printf("       [--cache <palabras>/<linea>/<vias>[/wt]] [--pipeline] [--verify] [--lockstep <n>] [--smp <n>]\n");
+            printf("       [--diskcache <sectores>] [--monitor <nombre>]\n");
+            printf("       [--batch <programa> [--dump <desde>-<hasta>]... [--cycles <n>]]\n");
+            printf("       [--fuzz <dir> [--jobs <n>] [--time <s>] [--seed <n>]]\n");
+            printf("       [--server <socket> [--jobs <n>] [--cycles <n>]] [--client <socket>]\n");
+            printf("       [--watch <nombre> [--dump <desde>-<hasta>]...]\n");
+            return -1;
+        }
+    }
+    return memory_configure(options.mem_size, options.os_size);
+}
+
+int main(int argc, char **argv) {
+    if (parse_options(argc, argv) < 0) return 1;
+
+    // El fuzzer arma sus propias maquinas (una por proceso), sin log
+    if (options.fuzz_dir) {
+        unsigned long seed = options.fuzz_seed ? options.fuzz_seed : (unsigned long)time(NULL);
+        return fuzz_run(options.fuzz_dir, options.jobs, options.fuzz_seconds, seed) == 0 ? 0 : 1;
+    }
+    if (options.client_path) return server_client(options.client_path) == 0 ? 0 : 1;
+    if (options.watch_name) {
+        return monitor_watch(options.watch_name, (const int (*)[2])options.dumps, options.dump_count) == 0 ? 0 : 1;
+    }
+    // Los trabajadores del servidor compartirian el mismo segmento
+    if (options.monitor_name && options.server_path) {
+        printf("Error: --monitor no se puede con --server\n");
+        return 1;
+    }
+
     // 1. Preparamos componentes
-    logger_init("virtual_machine.log");
+    // (el servidor no escribe log: serian varios procesos en el mismo archivo)
+    if (options.use_log && !options.server_path) logger_init("virtual_machine.log");
     memory_init();
-    disk_init(); // Aunque no hace mucho todavia
+    console_init(stdout);
+    if (console_open_input(options.console_input) < 0) return 1;
+    if (options.disk_count || options.disk_geometry[0]) {
+        int *g = options.disk_geometry;
+        if (!options.disk_count) options.disk_files[options.disk_count++] = "virtual_disk.bin";
+        for (int d = 0; d < options.disk_count; d++) {
+            if (disk_attach(&disks[d], options.disk_files[d], g[0], g[1], g[2]) < 0) return 1;
+        }
+    } else {
+        disk_init();
+    }
     cpu_reset();
+    pipeline_reset();
+    if (options.cache[0]) {
+        int *c = options.cache;
+        if (cache_configure(CACHE_INST, c[0], c[1], c[2], 0) < 0 ||
+            cache_configure(CACHE_DATA, c[0], c[1], c[2], c[3]) < 0) return 1;
+    }
+    if (options.smp_cpus && smp_configure(options.smp_cpus) < 0) return 1;
+    if (options.diskcache && diskcache_configure(options.diskcache) < 0) return 1;
+    if (options.monitor_name && monitor_open(options.monitor_name) < 0) return 1;
+
+    // Los trabajadores heredan la maquina ya preparada (y el disco ya leido)
+    if (options.server_path) {
+        return server_run(options.server_path, options.jobs, options.max_cycles, server_job) == 0 ? 0 : 1;
+    }
+
+    if (options.batch_program) {
+        int rc = run_batch();
+        monitor_close();
+        logger_close();
+        return rc;
+    }
     
     printf(" === MI MAQUINA VIRTUAL 2025 ===\n");
     print_help();
@@ -114,7 +572,20 @@ int main() {
         } 
         else if (strncmp(command, "load ", 5) == 0) {
             sscanf(command, "load %s", arg);
-            load_program(arg);
+            if (load_program(arg) == 0) { // Estadisticas por programa
+                dma_ring_reset();
+                cache_reset();
+                pipeline_reset();
+            }
+        }
+        else if (strncmp(command, "asm ", 4) == 0) {
+            char out[64];
+            char opt[8] = "";
+            if (sscanf(command, "asm %63s %63s %7s", arg, out, opt) < 2) {
+                printf("Uso: asm <fuente> <salida> [-O]\n");
+            } else {
+                assemble_file(arg, out, strcmp(opt, "-O") == 0);
+            }
         }
         else if (strcmp(command, "run") == 0) {
             run_normal();
@@ -131,6 +602,162 @@ int main() {
             Word w = mem_read(addr);
             printf(" Memoria[%d] = %d (Signo: %d)\n", addr, w.digits, w.sign);
         }
+        else if (strncmp(command, "memdump ", 8) == 0) {
+            int from, to;
+            char format[8] = "texto";
+            if (sscanf(command, "memdump %d %d %63s %7s", &from, &to, arg, format) < 3 ||
+                (strcmp(format, "texto") != 0 && strcmp(format, "bin") != 0)) {
+                printf("Uso: memdump <desde> <hasta> <archivo> [texto|bin]\n");
+            } else if (mem_range_valid(from, to)) {
+                mem_dump_file(from, to, arg, strcmp(format, "bin") == 0);
+            }
+        }
+        else if (strncmp(command, "memfill ", 8) == 0) {
+            int from, to;
+            Word w;
+            if (sscanf(command, "memfill %d %d %63s", &from, &to, arg) != 3) {
+                printf("Uso: memfill <desde> <hasta> <valor>\n");
+            } else if (mem_range_valid(from, to) && mem_parse_value(arg, &w)) {
+                mem_range_fill(from, to - from + 1, w);
+                printf(" %d-%d = [%d] %08d\n", from, to, w.sign, w.digits);
+            }
+        }
+        else if (strncmp(command, "memfind ", 8) == 0) {
+            int from, to, skip = 0;
+            if (sscanf(command, "memfind %d %d %n", &from, &to, &skip) != 2 || !command[skip]) {
+                printf("Uso: memfind <desde> <hasta> <valor> [<valor>...]\n");
+            } else if (mem_range_valid(from, to)) {
+                mem_find_words(from, to, command + skip);
+            }
+        }
+        else if (strncmp(command, "memdiff ", 8) == 0) {
+            if (sscanf(command, "memdiff %63s", arg) != 1) printf("Uso: memdiff <imagen>\n");
+            else mem_diff_file(arg);
+        }
+        else if (strcmp(command, "meminfo") == 0) {
+            int pages = mem_pages_touched();
+            printf(" Memoria: %d palabras (SO: 0-%d, Usuario: %d-%d)\n",
+                   MEM_SIZE, OS_MEM_SIZE - 1, USER_MEM_START, MEM_SIZE - 1);
+            printf(" Paginas en el host: %d de %d (%zu bytes)\n", pages,
+                   (MEM_SIZE + MEM_PAGE_WORDS - 1) / MEM_PAGE_WORDS,
+                   (size_t)pages * MEM_PAGE_WORDS * sizeof(Word));
+        }
+        else if (strncmp(command, "paging", 6) == 0) {
+            if (strcmp(command, "paging on") == 0) paging_set(1);
+            else if (strcmp(command, "paging off") == 0) paging_set(0);
+            paging_print_stats();
+        }
+        else if (strncmp(command, "disk", 4) == 0 && (command[4] == 0 || command[4] == ' ')) {
+            // disk                             -> Info de todos los discos
+            // disk [<n>] attach <imagen> [C P S] -> Conecta otro al canal n (0 si no se
+            //                                      dice); el que estaba se guarda
+            char file[64];
+            int g[3] = {0, 0, 0};
+            int unit = 0;
+            int n = sscanf(command, "disk attach %63s %d %d %d", file, &g[0], &g[1], &g[2]);
+            if (n <= 0) {
+                n = sscanf(command, "disk %d attach %63s %d %d %d", &unit, file, &g[0], &g[1], &g[2]) - 1;
+            }
+            if ((n == 1 || n == 4) && unit >= 0 && unit < DMA_CHANNELS) {
+                disk_attach(&disks[unit], file, g[0], g[1], g[2]);
+                disk_print_info(&disks[unit]);
+            } else if (strcmp(command, "disk") == 0) {
+                for (int d = 0; d < DMA_CHANNELS; d++) disk_print_info(&disks[d]);
+            } else {
+                printf("Uso: disk | disk [<canal>] attach <imagen> [cilindros pistas sectores]\n");
+            }
+        }
+        else if (strncmp(command, "dma", 3) == 0 && (command[3] == 0 || command[3] == ' ')) {
+            // sync = como --dma-sync (sin hilo ni busqueda, repetible)
+            if (strcmp(command, "dma sync") == 0) dma_synchronous = 1;
+            else if (strcmp(command, "dma async") == 0) dma_synchronous = 0;
+            dma_print_stats();
+        }
+        else if (strncmp(command, "diskcache", 9) == 0) {
+            int n;
+            if (strcmp(command, "diskcache off") == 0) diskcache_configure(0);
+            else if (strcmp(command, "diskcache flush") == 0) {
+                for (int d = 0; d < DMA_CHANNELS; d++) diskcache_flush(&disks[d]);
+            }
+            else if (sscanf(command, "diskcache %d", &n) == 1) diskcache_configure(n);
+            diskcache_print_stats(stdout);
+        }
+        else if (strncmp(command, "svc", 3) == 0) {
+            if (strcmp(command, "svc on") == 0) svc_native = 1;
+            else if (strcmp(command, "svc off") == 0) svc_native = 0;
+            svc_print_stats();
+        }
+        else if (strncmp(command, "cache", 5) == 0) {
+            // cache i|d|l2 <palabras> <linea> <vias> [wb|wt] -> prende ese nivel
+            char level[4], policy[4] = "wb";
+            int words, line, ways;
+            if (strcmp(command, "cache off") == 0) {
+                cache_disable();
+            } else if (strcmp(command, "cache reset") == 0) {
+                cache_reset();
+            } else if (sscanf(command, "cache %3s %d %d %d %3s", level, &words, &line, &ways, policy) >= 4) {
+                int kind = strcmp(level, "i") == 0 ? CACHE_INST : strcmp(level, "d") == 0 ? CACHE_DATA :
+                           strcmp(level, "l2") == 0 ? CACHE_L2 : -1;
+                if (kind < 0) printf("Uso: cache i|d|l2 <palabras> <linea> <vias> [wb|wt]\n");
+                else cache_configure(kind, words, line, ways, strcmp(policy, "wt") != 0);
+            }
+            cache_print_stats(stdout);
+        }
+        else if (strncmp(command, "pipeline", 8) == 0) {
+            if (strcmp(command, "pipeline on") == 0) {
+                pipeline_enabled = 1;
+                pipeline_reset();
+            } else if (strcmp(command, "pipeline off") == 0) {
+                pipeline_enabled = 0;
+            } else if (strcmp(command, "pipeline reset") == 0) {
+                pipeline_reset();
+            }
+            pipeline_print_stats(stdout);
+        }
+        else if (strncmp(command, "lockstep", 8) == 0) {
+            int every;
+            if (strcmp(command, "lockstep off") == 0) cpu_lockstep_every = 0;
+            else if (sscanf(command, "lockstep %d", &every) == 1 && every > 0) cpu_lockstep_every = every;
+            cpu_lockstep_print_stats(stdout);
+        }
+        else if (strncmp(command, "smp", 3) == 0) {
+            // "smp <n>" solo dice cuantas quedaron (las estadisticas cambian en cada corrida)
+            int n;
+            if (sscanf(command, "smp %d", &n) != 1) smp_print_stats(stdout);
+            else if (smp_configure(n) == 0) printf(" SMP: %d CPU%s\n", n, n == 1 ? "" : "s");
+        }
+        else if (strncmp(command, "monitor", 7) == 0) {
+            if (strcmp(command, "monitor off") == 0) monitor_close();
+            else if (sscanf(command, "monitor %63s", arg) == 1 && monitor_open(arg) < 0) continue;
+            monitor_print_stats(stdout);
+        }
+        else if (strncmp(command, "verify", 6) == 0) {
+            // Cuenta desde el siguiente load (lo ya cargado se queda como esta)
+            if (strcmp(command, "verify on") == 0) {
+                verify_enabled = 1;
+            } else if (strcmp(command, "verify off") == 0) {
+                verify_enabled = 0;
+                cpu_trust_drop();
+            }
+            verify_print_report(stdout);
+        }
+        else if (strncmp(command, "console", 7) == 0) {
+            if (sscanf(command, "console input %63s", arg) == 1) console_open_input(arg);
+            console_print_stats();
+        }
+        else if (strcmp(command, "selftest") == 0) {
+            cpu_selftest();
+        }
+        else if (strncmp(command, "bench int", 9) == 0) {
+            int n = 1000000;
+            sscanf(command, "bench int %d", &n);
+            cpu_bench_interrupts(n);
+        }
+        else if (strncmp(command, "bench dma", 9) == 0) {
+            int n = 50, seek_us = 2000;
+            sscanf(command, "bench dma %d %d", &n, &seek_us);
+            dma_bench(n, seek_us);
+        }
         else if (strcmp(command, "help") == 0) {
             print_help();
         }
@@ -140,6 +767,8 @@ int main() {
     }
     
     // Limpiar antes de irnos
+    console_flush();
+    monitor_close();
     logger_close();
     disk_save();
     
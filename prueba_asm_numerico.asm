@@ -0,0 +1,13 @@
+// Programa: operandos numericos que apuntan dentro del propio programa.
+// Con -O, "load 306" despues de "str 306" sobra, pero si se borra el .word
+// se corre de 306 a 305 y los operandos ya no apuntarian a el: el
+// optimizador no tiene que borrar nada (ver input_test_asm.txt).
+.base 0
+        load #1
+        sum  #2
+        str  306
+        load 306
+        load 306
+        j    fin
+x:      .word 42
+fin:    load 306
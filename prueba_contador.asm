@@ -0,0 +1,18 @@
+// Programa: Contador Regresivo (igual que prueba_debug.txt) pero en mnemonicos.
+// Ensamblar con:  asm prueba_contador.asm prueba_contador.txt -O
+// Las etiquetas quedan relativas a RB (300), asi sirve con "run" (modo usuario).
+_start 300
+.NombreProg Contador
+        load #3         // AC = 3
+        sum  #2         // El optimizador lo pliega con el load (AC = 5)
+ciclo:  str  200        // Mem[200 + RB] = AC
+        load 200        // Redundante: el optimizador lo elimina
+        res  #1         // AC = AC - 1
+        psh             // Tope de la pila = AC (para comparar)
+        load #0
+        jmpne salto     // Si el contador no llego a 0, vamos a "salto"...
+        j    fin
+salto:  pop             // Recuperamos el contador
+        j    otro       // ...que a su vez salta a "otro" (cadena de saltos)
+otro:   j    ciclo
+fin:    pop             // Al terminar cae en el Sentinel
@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "hardware.h"
+#include "logger.h"
+#include "server.h"
+
+/*
+ * SERVIDOR
+ * Correr un programa con --batch cuesta mas en arrancar que en correr:
+ * lanzar el proceso, memory_init, leer la imagen del disco, cpu_reset...
+ * Aqui eso se hace UNA vez: el padre prepara la maquina y abre el socket, y
+ * luego hace fork de los trabajadores (como el fuzzer, cada proceso tiene
+ * su maquina completa). Los trabajadores hacen accept() directo sobre el
+ * mismo socket, asi que el padre no pasa nada de mano en mano; solo vigila
+ * y revive al que se muera.
+ *
+ * Entre trabajo y trabajo la maquina se reinicia barato: se sueltan las
+ * paginas de memoria que se usaron, registros y DMA a cero, y el disco se
+ * vuelve a copiar (en memoria) solo si el trabajo escribio en el. Nada se
+ * guarda en la imagen del disco: cada trabajo ve el disco como estaba al
+ * arrancar el servidor.
+ *
+ * La salida del trabajo (loader, consola y resumen) se escribe con printf
+ * normal: mientras dura la conexion el stdout del trabajador ES el socket.
+ */
+
+#define SERVER_MAX_WORKERS 64
+#define SERVER_BACKLOG     64
+
+typedef struct {
+    long jobs[SERVER_MAX_WORKERS];  // Trabajos terminados por cada trabajador
+} ServerShared;
+
+static ServerShared *shared;
+static volatile sig_atomic_t server_stop = 0;
+static int listen_fd = -1;
+
+// Estado de cada trabajador
+static HardDisk pristine[DMA_CHANNELS]; // Los discos como los dejo el padre
+static long server_default_cycles;
+
+/* =========================================================================
+ * TRABAJADOR (proceso hijo)
+ * ========================================================================= */
+
+// Deja la maquina como recien arrancada (sin volver a leer nada del host)
+static void server_reset() {
+    // Un DMA de un trabajo anterior podria seguir escribiendo en memoria
+    int pending = __atomic_load_n(&interrupt_pending_dma, __ATOMIC_ACQUIRE);
+    while (dma_wait_event(pending)) pending = __atomic_load_n(&interrupt_pending_dma, __ATOMIC_ACQUIRE);
+
+    memory_init();
+    cpu_reset();
+    cpu_trace_reset();
+    interrupt_pending_dma = 0;
+    dma_selected = 0;
+    memset(dma_channels, 0, sizeof(dma_channels));
+    dma_ring_reset();
+    for (int n = 0; n < DMA_CHANNELS; n++) {
+        diskcache_drop(&disks[n]); // Lo que quedo en el buffer era del trabajo anterior
+        if (disks[n].writes) disk_clone(&disks[n], &pristine[n]);
+    }
+    console_init(stdout);
+    if (cache_enabled) cache_reset();
+    pipeline_reset();
+}
+
+// "DUMP <desde>[-<hasta>]" con el rango dentro de la memoria. 0 = no sirve
+static int parse_dump(const char *line, int *range) {
+    int n = sscanf(line, "DUMP %d-%d", &range[0], &range[1]);
+    if (n < 1) return 0;
+    if (n == 1) range[1] = range[0];
+    return range[0] >= 0 && range[0] <= range[1] && range[1] < MEM_SIZE;
+}
+
+/*
+ * Lee la cabecera de un trabajo (hasta la linea PROGRAMA).
+ * Retorna 1 si hay trabajo, 0 al cerrar la conexion, -1 si la cabecera no
+ * sirve (el error ya se le contesto al cliente).
+ */
+static int read_job(FILE *in, ServerJob *job) {
+    char line[256];
+    job->name[0] = 0;
+    job->max_cycles = server_default_cycles;
+    job->dump_count = 0;
+
+    while (fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] == 0) continue;
+
+        int *range = job->dumps[job->dump_count];
+        if (sscanf(line, "PROGRAMA %63s", job->name) == 1) {
+            return 1;
+        } else if (sscanf(line, "CICLOS %ld", &job->max_cycles) == 1 && job->max_cycles >= 0) {
+            continue;
+        } else if (strncmp(line, "DUMP ", 5) == 0 && job->dump_count < SERVER_MAX_DUMPS && parse_dump(line, range)) {
+            job->dump_count++;
+        } else {
+            printf("ERROR cabecera invalida: %s\n== FIN ==\n", line);
+            // El resto del trabajo (hasta el ".") no son mas cabeceras:
+            // se tira, como hace el loader cuando aborta
+            while (fgets(line, sizeof(line), in)) {
+                line[strcspn(line, "\r\n")] = 0;
+                if (strcmp(line, ".") == 0) break;
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void serve_connection(int conn, int id, ServerJobFunc run_job) {
+    FILE *in = fdopen(conn, "r");
+    if (!in) {
+        close(conn);
+        return;
+    }
+    fflush(stdout);
+    int devnull = dup(STDOUT_FILENO);
+    dup2(conn, STDOUT_FILENO);
+
+    ServerJob job;
+    int rc;
+    while ((rc = read_job(in, &job)) != 0) {
+        if (rc > 0) {
+            server_reset();
+            run_job(in, &job);
+            printf("== FIN ==\n");
+            __atomic_add_fetch(&shared->jobs[id], 1, __ATOMIC_RELAXED);
+        }
+        fflush(stdout);
+    }
+
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+    fclose(in);
+}
+
+static void server_worker(int id, ServerJobFunc run_job) {
+    signal(SIGINT, SIG_IGN);  // Al Ctrl+C lo detiene el padre
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN); // Si el cliente se va, el write falla y ya
+    if (!freopen("/dev/null", "w", stdout)) exit(1);
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+    logger_console(0);
+    console_open_input(NULL); // Los trabajos no tienen entrada de consola
+
+    // Copia propia de los discos: lo del padre queda intacto para restaurar
+    memcpy(pristine, disks, sizeof(pristine));
+    memset(disks, 0, sizeof(disks));
+    for (int n = 0; n < DMA_CHANNELS; n++) {
+        if (disk_clone(&disks[n], &pristine[n]) < 0) exit(1);
+    }
+
+    for (;;) {
+        int conn = accept(listen_fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            exit(1);
+        }
+        serve_connection(conn, id, run_job);
+    }
+}
+
+/* =========================================================================
+ * PADRE: abre el socket, arranca trabajadores y los revive
+ * ========================================================================= */
+
+static void on_signal(int sig) {
+    (void)sig;
+    server_stop = 1;
+}
+
+static int unix_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        printf("Error: Ruta del socket demasiado larga: %s\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static pid_t spawn_worker(int id, ServerJobFunc run_job) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        server_worker(id, run_job);
+        _exit(0);
+    }
+    return pid;
+}
+
+int server_run(const char *path, int workers, long default_cycles, ServerJobFunc run_job) {
+    if (workers <= 0) workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    if (workers > SERVER_MAX_WORKERS) workers = SERVER_MAX_WORKERS;
+    server_default_cycles = default_cycles;
+
+    struct sockaddr_un addr;
+    if (unix_address(path, &addr) < 0) return -1;
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path); // Uno que haya quedado de antes
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, SERVER_BACKLOG) < 0) {
+        printf("Error: No se pudo abrir el socket %s (%s)\n", path, strerror(errno));
+        if (listen_fd >= 0) close(listen_fd);
+        return -1;
+    }
+
+    shared = mmap(NULL, sizeof(ServerShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        printf("Error: Sin memoria compartida para el servidor\n");
+        close(listen_fd);
+        unlink(path);
+        return -1;
+    }
+
+    pid_t pids[SERVER_MAX_WORKERS];
+    int restarts = 0;
+    for (int w = 0; w < workers; w++) pids[w] = spawn_worker(w, run_job);
+    printf("[server] %d maquinas escuchando en %s (Ctrl+C para terminar)\n", workers, path);
+    fflush(stdout);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    while (!server_stop) {
+        sleep(1);
+
+        // Un trabajador que se murio (un programa tumbo al simulador): otro igual
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (int w = 0; w < workers; w++) {
+                if (pids[w] != pid) continue;
+                printf("[server] El trabajador %d termino (estado %d), arrancando otro\n", w, status);
+                pids[w] = spawn_worker(w, run_job);
+                restarts++;
+            }
+        }
+    }
+
+    for (int w = 0; w < workers; w++) kill(pids[w], SIGTERM);
+    for (int w = 0; w < workers; w++) waitpid(pids[w], NULL, 0);
+    close(listen_fd);
+    unlink(path);
+
+    long total = 0;
+    for (int w = 0; w < workers; w++) total += shared->jobs[w];
+    printf("[server] Fin: %ld trabajos, %d trabajadores revividos\n", total, restarts);
+    munmap(shared, sizeof(ServerShared));
+    return 0;
+}
+
+/* =========================================================================
+ * CLIENTE (para probar y para scripts): stdin -> socket -> stdout
+ * ========================================================================= */
+
+int server_client(const char *path) {
+    struct sockaddr_un addr;
+    if (unix_address(path, &addr) < 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        printf("Error: No se pudo conectar a %s (%s)\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // Se lee y escribe a la vez: si mandamos todo primero, con muchos
+    // trabajos las respuestas llenan el socket y nos trabamos los dos
+    char buf[4096];
+    struct pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {fd, POLLIN, 0}};
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[0].revents) {
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n <= 0) {
+                shutdown(fd, SHUT_WR); // Ya no hay mas trabajos
+                fds[0].fd = -1;
+            } else if (write(fd, buf, n) != n) {
+                break;
+            }
+        }
+        if (fds[1].revents) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0) break; // El servidor termino de contestar
+            if (write(STDOUT_FILENO, buf, n) != n) break;
+        }
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+
+// Modo servidor (ver server.c)
+//
+// Escucha en un socket Unix y corre programas que le mandan, en una alberca
+// de 'workers' procesos (uno por nucleo si workers <= 0) que ya tienen su
+// maquina lista. Cada trabajo es:
+//
+//   CICLOS <n>          (opcional, por defecto el de --cycles)
+//   DUMP <desde>-<hasta> (opcional, se puede repetir)
+//   PROGRAMA <nombre>
+//   <el programa en formato del loader>
+//   .
+//
+// y la respuesta es lo mismo que imprime --batch, terminada en "== FIN ==".
+// Una cabecera que no sirve (o un DUMP fuera de la memoria) se contesta con
+// "ERROR ..." y ese trabajo se tira completo, hasta su ".".
+// Por una conexion se pueden mandar todos los trabajos que se quieran.
+
+#define SERVER_MAX_DUMPS 32
+
+typedef struct {
+    char name[64];
+    long max_cycles;
+    int dumps[SERVER_MAX_DUMPS][2];
+    int dump_count;
+} ServerJob;
+
+// Corre un trabajo en la maquina ya reiniciada: carga el programa de 'in'
+// (hasta la linea ".") y escribe el resumen en stdout
+typedef void (*ServerJobFunc)(FILE *in, const ServerJob *job);
+
+// Hasta Ctrl+C (o SIGTERM). Retorna 0, o -1 si no se pudo abrir el socket.
+int server_run(const char *path, int workers, long default_cycles, ServerJobFunc run_job);
+
+// Manda lo que venga en stdin al servidor y escribe la respuesta en stdout
+int server_client(const char *path);
+
+#endif // SERVER_H
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Compara el rendimiento (instrucciones/segundo) de varios ejecutables.
+#
+#   tests/bench_builds.sh machine machine-release machine-pgo
+#
+# Cada uno corre BENCH_CYCLES ciclos de cada programa (por --batch, sin log)
+# BENCH_RUNS veces y se queda con la mejor corrida.
+
+cd "$(dirname "$0")/.." || exit 1
+
+BENCH_CYCLES=${BENCH_CYCLES:-20000000}
+BENCH_RUNS=${BENCH_RUNS:-3}
+# Los que se ciclan (corren hasta el limite) y el que mas trabaja antes de acabar
+BENCH_PROGRAMS=${BENCH_PROGRAMS:-"prueba_prot.txt prueba_under.txt prueba_normal.txt"}
+
+printf "%-22s" "programa"
+for bin in "$@"; do printf "%18s" "$bin"; done
+echo
+
+for prog in $BENCH_PROGRAMS; do
+    printf "%-22s" "$prog"
+    for bin in "$@"; do
+        best=0
+        i=0
+        while [ $i -lt "$BENCH_RUNS" ]; do
+            ips=$(./"$bin" --nolog --noidle --batch "$prog" --cycles "$BENCH_CYCLES" 2>&1 >/dev/null |
+                  sed -n 's/.*(\([0-9]*\) instr\/s).*/\1/p')
+            [ "${ips:-0}" -gt "$best" ] && best=$ips
+            i=$((i + 1))
+        done
+        printf "%18s" "$best"
+    done
+    echo
+done
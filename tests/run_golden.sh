@@ -0,0 +1,167 @@
+#!/bin/sh
+# Pruebas "golden": corre todos los programas de ejemplo y compara el
+# resultado contra lo guardado en tests/golden/.
+#
+#   tests/run_golden.sh            Compara (falla si algo cambio)
+#   tests/run_golden.sh --record   Vuelve a grabar los .out
+#
+# Por programa se guardan los registros finales, unos rangos de memoria y la
+# secuencia de interrupciones (./machine --batch). Si hay un <programa>.in
+# es la entrada de su consola (--input). El DMA va con --dma-sync: sin hilo
+# ni busqueda de 1 s, y las terminaciones siempre en el mismo ciclo. Los
+# input_test_*.txt se comparan con la salida completa de la consola. Al
+# final se levanta --server y se le mandan unos programas por el socket
+# (golden server.out).
+#
+# Nada de esto toca el virtual_disk.bin del repo: cada programa usa un disco
+# nuevo en $TMP, y cada script corre en su propio directorio dentro de $TMP
+# (con una copia de los programas), donde "exit" y "diskcache flush" guardan
+# su disco y quedan los archivos que escriba (memdump, asm). En los scripts,
+# @MONITOR@ se cambia por un segmento del monitor propio de esta corrida (y
+# de vuelta en la salida), asi dos "make test" a la vez no se pisan.
+#
+# Rendimiento (solo si se pide, "make perf"): con PERF_TOLERANCE=<n>, para
+# los programas que corren al menos PERF_MIN_CYCLES se mide
+# instrucciones/segundo (el mejor de PERF_RUNS corridas) y falla si baja mas
+# de n por ciento contra tests/golden/perf.txt (con --record se regraba).
+# Son numeros absolutos de la maquina donde se grabo perf.txt: en otra, o
+# con la maquina cargada, no dicen nada. Por eso "make test" no lo revisa.
+# Las medidas van con --noidle: si no, un J a si misma detiene la maquina y
+# no queda nada que medir.
+
+cd "$(dirname "$0")/.." || exit 1
+ROOT=$(pwd)
+
+MACHINE=${MACHINE:-./machine}   # Otro ejecutable: MACHINE=./machine-release
+case $MACHINE in /*) ;; *) MACHINE=$ROOT/$MACHINE ;; esac # Los scripts corren en otro dir
+GOLDEN=tests/golden
+MONITOR=/maquina_prueba_$$
+PERF_FILE=$GOLDEN/perf.txt
+PERF_MIN_CYCLES=${PERF_MIN_CYCLES:-10000}
+PERF_RUNS=${PERF_RUNS:-3}
+PERF_TOLERANCE=${PERF_TOLERANCE:-off}
+DUMPS="--dump 0-9 --dump 300-339 --dump 500-509 --dump 800-809 --dump 1990-1999"
+
+# prueba.txt es el texto del enunciado, no un programa
+PROGRAMS="prueba_*.txt pruebaA.txt pruebaB.txt pruebapdf.txt"
+SCRIPTS="input_test_*.txt"
+
+RECORD=0
+[ "$1" = "--record" ] && RECORD=1
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+FAILS=0
+NEW_PERF=$TMP/perf.txt
+: > "$NEW_PERF"
+
+fail() {
+    echo "FALLA $1"
+    FAILS=$((FAILS + 1))
+}
+
+# Compara (o graba) la salida $2 contra el golden $1
+check() {
+    if [ $RECORD = 1 ]; then
+        cp "$2" "$GOLDEN/$1"
+        echo "grabado $1"
+    elif [ ! -f "$GOLDEN/$1" ]; then
+        fail "$1: no hay golden (corre make golden)"
+    elif ! diff -u "$GOLDEN/$1" "$2" > "$TMP/diff"; then
+        fail "$1: la salida cambio"
+        head -40 "$TMP/diff"
+    else
+        echo "ok     $1"
+    fi
+}
+
+for prog in $PROGRAMS; do
+    out=$TMP/$prog.out
+    input=
+    [ -f "${prog%.txt}.in" ] && input="--input ${prog%.txt}.in"
+    rm -f "$TMP/disk.bin"
+    $MACHINE --nolog --dma-sync --disk "$TMP/disk.bin" $input --batch "$prog" $DUMPS > "$out" 2> /dev/null
+    # Las lineas de "Parseo" traen tiempos, no se comparan
+    grep -v "^Parseo:" "$out" > "$TMP/clean"
+    check "${prog%.txt}.out" "$TMP/clean"
+
+    [ "$PERF_TOLERANCE" = off ] && continue
+
+    # Mejor de PERF_RUNS corridas (la primera dice si vale la pena medir)
+    best=0
+    i=0
+    while [ $i -lt "$PERF_RUNS" ]; do
+        rm -f "$TMP/disk.bin"
+        cycles=$($MACHINE --nolog --noidle --dma-sync --disk "$TMP/disk.bin" $input --batch "$prog" 2> "$TMP/perf" |
+                 sed -n 's/^CICLOS \([0-9]*\).*/\1/p')
+        [ "${cycles:-0}" -lt "$PERF_MIN_CYCLES" ] && break
+        ips=$(sed -n 's/.*(\([0-9]*\) instr\/s).*/\1/p' "$TMP/perf")
+        [ "${ips:-0}" -gt "$best" ] && best=$ips
+        i=$((i + 1))
+    done
+    [ $best -eq 0 ] && continue
+    echo "$prog $best" >> "$NEW_PERF"
+
+    [ $RECORD = 1 ] && continue
+    base=$(awk -v p="$prog" '$1 == p { print $2 }' "$PERF_FILE" 2>/dev/null)
+    if [ -z "$base" ]; then
+        echo "aviso  $prog: sin linea base de rendimiento ($best instr/s)"
+    elif [ $((best * 100)) -lt $((base * (100 - PERF_TOLERANCE))) ]; then
+        fail "$prog: rendimiento $best instr/s, la base es $base (tolerancia $PERF_TOLERANCE%)"
+    else
+        echo "ok     $prog: $best instr/s (base $base)"
+    fi
+done
+
+for script in $SCRIPTS; do
+    work=$TMP/${script%.txt}
+    mkdir "$work"
+    cp ./*.txt ./*.in ./*.asm ./*.img "$work"/
+    sed "s|@MONITOR@|$MONITOR|g" "$script" |
+        (cd "$work" && $MACHINE --nolog --disk virtual_disk.bin) 2>&1 |
+        grep -v "^Parseo:" | sed "s|$MONITOR|@MONITOR@|g" > "$TMP/clean"
+    check "${script%.txt}.out" "$TMP/clean"
+done
+
+# Modo servidor: los mismos trabajos dan lo mismo que --batch, uno tras
+# otro en la misma maquina (se tiene que reiniciar bien entre ellos)
+SOCK=$TMP/server.sock
+rm -f "$TMP/disk.bin"
+$MACHINE --server "$SOCK" --jobs 1 --disk "$TMP/disk.bin" > "$TMP/server.log" 2>&1 &
+SERVER_PID=$!
+i=0
+while [ ! -S "$SOCK" ] && [ $i -lt 50 ]; do sleep 0.1; i=$((i + 1)); done
+for prog in prueba_suma.txt prueba_prot.txt prueba_suma.txt; do
+    echo "DUMP 700"
+    echo "PROGRAMA $prog"
+    cat "$prog"
+    echo "."
+done > "$TMP/jobs"
+# Cabeceras que no sirven: se contesta un ERROR por trabajo y se tira su
+# programa, el siguiente trabajo sale bien
+for dump in "DUMP foo" "DUMP 0-2000000000" "DUMP 9-3" "DUMP 700"; do
+    echo "$dump"
+    echo "PROGRAMA prueba_suma.txt"
+    cat prueba_suma.txt
+    echo "."
+done >> "$TMP/jobs"
+echo "CICLO 5" >> "$TMP/jobs"
+$MACHINE --client "$SOCK" < "$TMP/jobs" | grep -v "^Parseo:" > "$TMP/clean"
+kill -INT $SERVER_PID
+wait $SERVER_PID
+check server.out "$TMP/clean"
+
+if [ $RECORD = 1 ]; then
+    if [ "$PERF_TOLERANCE" != off ]; then
+        cp "$NEW_PERF" "$PERF_FILE"
+        echo "grabado perf.txt"
+    fi
+    exit 0
+fi
+
+if [ $FAILS -gt 0 ]; then
+    echo "$FAILS prueba(s) fallaron"
+    exit 1
+fi
+echo "Todas las pruebas pasaron"
@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hardware.h"
+#include "logger.h"
+#include "verifier.h"
+
+/*
+ * VERIFICADOR
+ * Cada instruccion de un programa de usuario paga siempre lo mismo: leer la
+ * palabra con el bus, ver si es el centinela, decodificarla y revisar su
+ * direccion contra RB/RL. Casi todo eso se puede saber al cargar: si el
+ * programa no se modifica a si mismo la palabra no cambia, y una direccion
+ * directa que cae dentro de RB/RL cae siempre.
+ *
+ * Se recorren las instrucciones alcanzables desde la entrada (siguiendo la
+ * siguiente y los saltos directos) y cada una tiene que cumplir:
+ *   - Opcode que exista y direccionamiento 0-2 (inmediato solo si el
+ *     operando es un dato)
+ *   - Direccion directa dentro de RB/RL
+ *   - Salto directo dentro del programa (o a su centinela)
+ * Las que pasan se le dan a la CPU (cpu_trust_code) ya decodificadas. Las
+ * que no pasan, las indexadas y lo que no se alcanza desde la entrada (datos,
+ * codigo al que solo se llega con un salto indexado) corren como siempre.
+ *
+ * Si algo escribe en el codigo verificado (el mismo programa o el DMA) la
+ * CPU se entera por mem_watch y regresa al modo revisado.
+ */
+
+int verify_enabled = 0;
+
+// Por que una instruccion alcanzable no quedo confiable
+enum {
+    VERIFY_BAD_OPCODE,
+    VERIFY_BAD_MODE,
+    VERIFY_OUT_OF_BOUNDS,
+    VERIFY_JUMP_OUTSIDE,
+    VERIFY_REASONS
+};
+
+static const char *reason_names[VERIFY_REASONS] = {
+    "opcode invalido",
+    "direccionamiento invalido",
+    "direccion fuera de RB/RL",
+    "salto fuera del programa",
+};
+
+static struct {
+    int done;
+    int skipped;            // Con paginacion (o varias CPUs) no se verifica
+    int start, count;
+    int reachable;
+    int trusted;
+    int rejected[VERIFY_REASONS];
+    int first_bad[VERIFY_REASONS]; // Direccion de la primera de cada tipo
+} report;
+
+static int is_jump(int op) {
+    return op == OP_J || op == OP_JMPE || op == OP_JMPNE || op == OP_JMPLT || op == OP_JMPLGT;
+}
+
+static void reject(int reason, int addr) {
+    if (report.rejected[reason]++ == 0) report.first_bad[reason] = addr;
+}
+
+int verify_program(int start, int count, int entry) {
+    memset(&report, 0, sizeof(report));
+    report.done = 1;
+    report.start = start;
+    report.count = count;
+    cpu_trust_drop();
+    if (paging_enabled || smp_cpus > 1) {
+        // La traduccion depende de la tabla de paginas, no de RB/RL (y con
+        // varias CPUs el modo confiable no se usa)
+        report.skipped = 1;
+        return 0;
+    }
+    if (count <= 0) return 0;
+
+    Word *words = malloc(sizeof(Word) * count);
+    unsigned char *seen = calloc(count, 1);
+    unsigned char *ok = calloc(count, 1);
+    int *work = malloc(sizeof(int) * count);
+    if (!words || !seen || !ok || !work) {
+        free(words);
+        free(seen);
+        free(ok);
+        free(work);
+        return 0;
+    }
+    mem_read_block(start, words, count);
+
+    int rb = cpu_registers.RB;
+    int span = cpu_registers.RL - cpu_registers.RB;
+    int top = 0;
+    if (entry >= start && entry < start + count) {
+        seen[entry - start] = 1;
+        work[top++] = entry - start;
+    }
+
+    while (top > 0) {
+        int i = work[--top];
+        int raw = words[i].digits;
+        int op = raw / 1000000;
+        int mode = (raw / 100000) % 10;
+        int val = raw % 100000;
+        int kind = isa_operand_kind(op);
+        int next = i + 1;   // La que sigue (-1 si no hay)
+        int target = -1;    // El destino de un salto directo
+        report.reachable++;
+
+        if (raw == SENTINEL_VAL) continue;
+        if (op == OP_RETRN) next = -1;
+        if (op == OP_J && mode != ADDR_IMMEDIATE) next = -1;
+
+        int reason = -1;
+        if (kind < 0) {
+            reason = VERIFY_BAD_OPCODE;
+            next = -1;      // Ni idea de que sigue: que la CPU lo resuelva
+        } else if (mode > ADDR_INDEXED || (mode == ADDR_IMMEDIATE && kind == ISA_ARG_ADDR)) {
+            reason = VERIFY_BAD_MODE;
+        } else if (mode == ADDR_DIRECT && (kind == ISA_ARG_DATA || kind == ISA_ARG_ADDR)) {
+            if (val > span) {
+                reason = VERIFY_OUT_OF_BOUNDS;
+            } else if (is_jump(op)) {
+                target = rb + val - start;
+                if (target < 0 || target > count) { // count = el centinela
+                    reason = VERIFY_JUMP_OUTSIDE;
+                    target = -1;
+                }
+            }
+        }
+        if (reason >= 0) reject(reason, start + i);
+        else ok[i] = 1;
+
+        if (next >= count) next = -1; // El centinela
+        if (target >= count) target = -1;
+        if (next >= 0 && !seen[next]) {
+            seen[next] = 1;
+            work[top++] = next;
+        }
+        if (target >= 0 && !seen[target]) {
+            seen[target] = 1;
+            work[top++] = target;
+        }
+    }
+
+    report.trusted = cpu_trust_code(start, count, ok);
+    log_event("Verificador: %d de %d instrucciones alcanzables quedaron confiables (%d palabras)",
+              report.trusted, report.reachable, count);
+
+    free(words);
+    free(seen);
+    free(ok);
+    free(work);
+    return report.trusted;
+}
+
+void verify_print_report(FILE *out) {
+    if (!verify_enabled || !report.done) {
+        fprintf(out, " Verificador: %s\n", verify_enabled ? "no se ha cargado nada" : "apagado (verify on)");
+        return;
+    }
+    if (report.skipped) {
+        fprintf(out, " Verificador: no aplica con paginacion ni con varias CPUs\n");
+        return;
+    }
+    fprintf(out, " Verificador: %d-%d, %d alcanzables, %d confiables\n", report.start,
+            report.start + report.count - 1, report.reachable, report.trusted);
+    for (int r = 0; r < VERIFY_REASONS; r++) {
+        if (report.rejected[r]) {
+            fprintf(out, "  %-26s: %d (la primera en %d)\n", reason_names[r], report.rejected[r],
+                    report.first_bad[r]);
+        }
+    }
+    cpu_trust_print_stats(out);
+}
@@ -0,0 +1,22 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <stdio.h>
+
+// Verificador de programas al cargar (ver verifier.c)
+//
+// Recorre las instrucciones alcanzables desde la entrada y marca las que
+// se pueden correr sin chequeos (modo confiable de la CPU). Se prende con
+// --verify o "verify on"; apagado el loader no lo llama.
+
+extern int verify_enabled;
+
+// Verifica [start, start + count) con la entrada en 'entry' (direcciones
+// fisicas, con el RB/RL y el modo que tenga la CPU). Retorna cuantas
+// instrucciones quedaron confiables.
+int verify_program(int start, int count, int entry);
+
+// Lo que encontro la ultima verificacion (y como le va al modo confiable)
+void verify_print_report(FILE *out);
+
+#endif // VERIFIER_H